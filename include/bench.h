@@ -0,0 +1,53 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Evaluate the same expression in 1, 2, 4 .. max_threads independent contexts at once and report
+// how throughput scales. Returns 1 if every thread computed the same result.
+int bench_contexts(int max_threads, long evaluations);
+
+// Time a corpus of expressions before and after optimize_program and compare their results.
+// Returns 1 if every optimized result is within the optimizer's documented tolerance.
+int bench_optimizer(long evaluations);
+
+// Time scan_number against strtod on typical inputs and check that random doubles survive a
+// print/scan round trip. Returns 1 if every value came back exactly.
+int bench_numbers(long iterations);
+
+// Time format_shortest against snprintf and check that random doubles scan back exactly from its output,
+// and that a sample has no more digits than necessary. Returns 1 if every value came back exactly and
+// the sample was shortest.
+int bench_format(long iterations);
+
+// Time each vector math kernel against libm per element and measure its error in ulps; check the
+// exact degree-mode values and that batched programs match run_program. Returns 1 if all pass.
+int bench_kernels(long iterations);
+
+// Check ►Frac results and exact rational arithmetic against 128-bit cross multiplication, and time
+// rational against double arithmetic. Returns 1 if every result is right.
+int bench_fractions(long iterations);
+
+// Time each complex kernel against <complex.h> per element and measure its error relative to the
+// magnitude of the result; check exact a+bi results and that real programs agree in complex
+// arithmetic. Returns 1 if all pass.
+int bench_complex(long iterations);
+
+// Check each regression against a long double reference fit, and the stored equation against the fit;
+// compare QR with the normal equations on ill-conditioned data, and time fits over the given number of
+// points. Returns 1 if every fit is within tolerance.
+int bench_regression(long points);
+
+// Check random edits of the input line against a plain string model, and time keystrokes in the middle
+// of lines from 10 to max_length characters. Returns 1 if the line always matched the model.
+int bench_editor(long max_length);
+
+// Check SEQ mode terms against the same recurrences computed directly, invalid definitions, and batches
+// against single terms; time u(n) up to the given number of terms. Returns 1 if every term matched.
+int bench_sequences(long terms);
+
+// Load the evaluation service listening at path: one connection waiting for each answer, one keeping
+// requests in flight, then the given number of connections at once. Reports requests per second and
+// latency percentiles, and checks a sample of the answers against local evaluation. Returns 1 if the
+// server answered every request correctly.
+int bench_server(const char* path, int connections, long requests);
+
+#endif
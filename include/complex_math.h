@@ -0,0 +1,45 @@
+#ifndef COMPLEX_MATH_H
+#define COMPLEX_MATH_H
+
+#include "math_engine.h"
+
+// Complex kernels work on values split into an array of real parts and an array of imaginary parts,
+// so each loop reads plain doubles and vectorizes like the real kernels. Outputs may be the same
+// arrays as the inputs. Lanes the fast formulas would overflow on are handed to libm's <complex.h>.
+
+void complex_kernel_multiply(const double* a_re, const double* a_im, const double* b_re, const double* b_im,
+                             double* re, double* im, int count);
+// Smith's algorithm, so neither the quotient nor the scaling overflows for ordinary operands.
+// Division by zero gives NaN, as in real division.
+void complex_kernel_divide(const double* a_re, const double* a_im, const double* b_re, const double* b_im,
+                           double* re, double* im, int count);
+// a^b as exp(b ln a), except for small integer real exponents which are repeated multiplications,
+// so (1+i)^2 is exactly 2i. 0^b is 0 for positive real b.
+void complex_kernel_power(const double* a_re, const double* a_im, const double* b_re, const double* b_im,
+                          double* re, double* im, int count);
+
+// Principal square root, with the branch cut along the negative real axis: sqrt(-4) = 2i
+void complex_kernel_sqrt(const double* x_re, const double* x_im, double* re, double* im, int count);
+void complex_kernel_exp(const double* x_re, const double* x_im, double* re, double* im, int count);
+// Principal logarithm: ln|z| + i arg(z) with -pi < arg(z) <= pi
+void complex_kernel_log(const double* x_re, const double* x_im, double* re, double* im, int count);
+// Trigonometric functions with the real part in the given angle mode, and the imaginary part converted
+// with it, so sin(30+0i) in degrees is exactly .5 as in real mode
+void complex_kernel_sin(AngleMode angle, const double* x_re, const double* x_im, double* re, double* im, int count);
+void complex_kernel_cos(AngleMode angle, const double* x_re, const double* x_im, double* re, double* im, int count);
+void complex_kernel_tan(AngleMode angle, const double* x_re, const double* x_im, double* re, double* im, int count);
+
+// Apply a parser function to count complex values in place
+void complex_apply_function(const CalcContext* context, FunctionId func, double* re, double* im, int count);
+
+// Evaluate a compiled expression for count real values of X in complex arithmetic, PROGRAM_BATCH
+// values at a time. The imaginary unit i and the imaginary parts of the variables take part.
+void run_program_complex(CalcContext* context, const Program* program, const double* x, double* re, double* im, int count);
+
+// Evaluate an expression in a+bi or re^θi mode. Expressions that need no complex arithmetic are run
+// by run_program and only redone in complex numbers when that is undefined (sqrt(-1), ln(-2)).
+// Returns the real part, sets *imaginary, and makes the result Ans unless it is an error (NaN) or the
+// evaluation was cancelled.
+double evaluate_complex_expression(CalcContext* context, const char* expression, double* imaginary);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef EVAL_WORKER_H
+#define EVAL_WORKER_H
+
+#include "math_engine.h"
+#include "rational.h"
+
+#define EVAL_QUEUE_SIZE 16
+
+typedef enum {
+    EVAL_OK,
+    EVAL_CANCELLED   // Stopped by the ON key (ERR:BREAK)
+} EvalStatus;
+
+typedef struct {
+    unsigned id;
+    double value;
+    double imaginary;   // Imaginary part of the value in a+bi and re^θi modes
+    EvalStatus status;
+    int has_fraction;   // The expression ended in ►Frac and fraction holds the result
+    Rational fraction;
+} EvalResult;
+
+// Start and stop the background evaluation thread
+int eval_worker_start();
+void eval_worker_stop();
+
+// Queue an expression for evaluation in a context (UI thread only). Returns its id, or 0 if the
+// queue is full. The worker owns the context until the result with that id has been polled.
+unsigned eval_worker_submit(CalcContext* context, const char* expression);
+
+// Take the next finished result, if any (UI thread only). Never blocks.
+int eval_worker_poll(EvalResult* result);
+
+// Cancel every expression submitted so far; the running one stops at its next cancellation point
+void eval_worker_cancel();
+
+#endif
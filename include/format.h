@@ -0,0 +1,31 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "math_engine.h"
+#include "rational.h"
+
+#define FORMAT_LENGTH 32          // Room for any formatted number and its terminator
+#define FORMAT_DISPLAY_DIGITS 10  // Significant digits of a home screen result
+#define FORMAT_CELL_DIGITS 6      // Significant digits of TABLE cells and the TRACE readout
+#define FORMAT_COMPLEX_LENGTH (2 * FORMAT_LENGTH + 8)  // Room for two numbers and the e^( i) around them
+
+// Write the shortest decimal that scans back to exactly this double, the closest one if several have
+// that length (Grisu3, with an exact fallback for the values it cannot decide).
+// Plain notation from 1E-7 up to 1E21, otherwise d.dddE±n. Returns the length written.
+int format_shortest(double value, char* out);
+
+// Write a value the way the calculator shows it: rounded to at most the given number of significant
+// digits, in the context's NORMAL/SCI/ENG notation and FLOAT/FIX decimals, without a leading zero
+// (.5). Undefined values are written as ERROR and infinite ones as ERR:OVERFLOW, returning 0.
+int format_number(const CalcContext* context, double value, int digits, char* out);
+
+// Write a complex value in the context's mode, each part as format_number would: a+bi as 3-2i, i or
+// -1.5i, re^θi as 2e^(1.047197551i) with θ in radians. Real values are written as by format_number.
+// Returns 0 for undefined or infinite values like format_number.
+int format_complex(const CalcContext* context, double re, double im, int digits, char* out);
+
+// Write a fraction as n/d, or n for a whole number. Returns the length written, or 0 if it needs
+// more than FORMAT_LENGTH - 1 characters.
+int format_fraction(Rational value, char* out);
+
+#endif
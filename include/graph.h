@@ -0,0 +1,80 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include "math_engine.h"
+#include "sequence.h"
+
+#define GRAPH_MAX_FUNCTIONS 10      // Y1..Y9 and Y0
+#define GRAPH_EXPRESSION_LENGTH 256
+#define GRAPH_SUBPIXEL_DEPTH 8      // Bisect up to 1/256 of a pixel column around discontinuities
+#define GRAPH_MIN_ZOOM -20
+#define GRAPH_MAX_ZOOM 30
+
+// The WINDOW settings
+typedef struct {
+    double xmin, xmax;
+    double ymin, ymax;
+} GraphWindow;
+
+// Where the graph area sits on an infinite pixel grid. Global column c starts at
+// x = c * pixel width and global row r at y = -r * pixel height, at the current zoom level,
+// so the grid (and every cached tile) stays put while panning.
+typedef struct {
+    int zoom;            // Each level halves the pixel size
+    long column;         // Global column of the leftmost pixel
+    long row;            // Global row of the top pixel
+    double base_dx;      // Pixel size at zoom level 0
+    double base_dy;
+} GraphView;
+
+// A filled block of pixels the plotter wants drawn, in graph-area coordinates (row 0 is the top)
+typedef struct {
+    short x0, x1;  // First and last pixel column
+    short y0, y1;  // First and last pixel row
+} GraphSpan;
+
+typedef struct {
+    GraphSpan* spans;
+    int count;
+    int capacity;
+    long interval_evaluations;  // Interval evaluations spent by the adaptive sampler
+    long uniform_evaluations;   // What one sample per pixel column would have cost
+    int tiles_computed;         // Tiles sampled for this plot
+    int tiles_cached;           // Tiles read straight from the cache
+    int columns_reused;         // Columns copied from a parent tile on zoom-in
+} GraphPlot;
+
+extern char graph_functions[GRAPH_MAX_FUNCTIONS][GRAPH_EXPRESSION_LENGTH];  // Y= expressions
+extern GraphView graph_view;
+extern Sequences graph_sequences;  // u, v and w of the Y= editor in SEQ mode
+
+// Store an expression into a Y= slot (0-based)
+void graph_set_function(int slot, const char* expression);
+const Program* graph_get_program(int slot);  // Compiles on first use; NULL when the slot is empty or invalid
+
+// Modes and variables the functions are graphed with (the graph keeps its own copy)
+void graph_set_context(const CalcContext* context);
+const CalcContext* graph_get_context();
+
+// ZStandard: -10..10 on both axes for a width x height graph area
+void graph_reset_view(int width, int height);
+GraphWindow graph_view_window(const GraphView* view, int width, int height);
+double graph_pixel_width(const GraphView* view);
+double graph_pixel_height(const GraphView* view);
+
+void graph_pan(long columns, long rows);
+// Zoom in (steps > 0) or out around a pixel of the graph area
+void graph_zoom(int steps, int center_x, int center_y);
+
+// Plot every defined Y= function for the current view, replacing the plot's previous contents.
+// Only tiles missing from the cache are sampled.
+void graph_render(int width, int height, GraphPlot* plot);
+
+// Value of a function at the left edge of a graph-area column, read from the tile cache.
+// Returns 0 if the slot has no valid function.
+int graph_trace(int slot, int column, double* x, double* y);
+
+void graph_clear_plot(GraphPlot* plot);
+void graph_free_plot(GraphPlot* plot);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef GRAPH_CACHE_H
+#define GRAPH_CACHE_H
+
+#include <stddef.h>
+
+#define GRAPH_TILE_COLUMNS 32                      // Pixel columns per tile
+#define GRAPH_CACHE_DEFAULT_BYTES (1024 * 1024)    // Default memory budget
+
+// Range of values a function takes over (part of) one pixel column
+typedef struct {
+    double lo, hi;
+    short column;       // Column within the tile
+    short full_column;  // 1 if this piece covers the whole column
+} GraphRange;
+
+typedef enum {
+    GRAPH_CACHE_LRU,   // Evict the least recently used tile
+    GRAPH_CACHE_FIFO   // Evict the oldest tile, ignoring hits
+} GraphCachePolicy;
+
+// Samples of one function over GRAPH_TILE_COLUMNS pixel columns at one zoom level.
+// Only x is tiled: the ranges are function values, so panning up or down reuses them as is.
+typedef struct GraphTile {
+    int slot;      // Y= slot
+    int zoom;      // Zoom level; each level halves the pixel size
+    long tile_x;   // Tile index: covers global columns tile_x * GRAPH_TILE_COLUMNS onwards
+
+    GraphRange* ranges;                           // Continuous pieces, in column order
+    int range_count;
+    int range_capacity;
+    short column_start[GRAPH_TILE_COLUMNS + 1];   // Column c owns ranges[column_start[c] .. column_start[c + 1])
+    size_t bytes;                                 // Memory charged against the budget
+
+    double trace_values[GRAPH_TILE_COLUMNS];      // f at the left edge of each column, for TRACE
+    int trace_ready;
+
+    struct GraphTile* hash_next;
+    struct GraphTile* prev;  // Eviction order: the head is kept longest, the tail goes first
+    struct GraphTile* next;
+} GraphTile;
+
+// Set the memory budget and eviction policy. Shrinking the budget evicts immediately.
+void graph_cache_configure(size_t max_bytes, GraphCachePolicy policy);
+
+// Find a cached tile, counting the lookup as a use. Returns NULL on a miss.
+GraphTile* graph_cache_lookup(int slot, int zoom, long tile_x);
+
+// Hand a tile to the cache, evicting others to stay within budget. The new tile is never evicted here.
+void graph_cache_insert(GraphTile* tile);
+
+// Building a tile: add ranges in column order, then finish before inserting it
+GraphTile* graph_tile_create(int slot, int zoom, long tile_x);
+void graph_tile_add_range(GraphTile* tile, int column, double lo, double hi, int full_column);
+void graph_tile_finish(GraphTile* tile);
+void graph_tile_free(GraphTile* tile);
+
+void graph_cache_drop_slot(int slot);  // Forget a function after it changes
+void graph_cache_clear();
+size_t graph_cache_bytes();
+int graph_cache_tile_count();
+
+#endif
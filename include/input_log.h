@@ -0,0 +1,27 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <SDL2/SDL.h>
+
+// Record the key and mouse events handle_input sees, or feed a recording back in their place
+int input_log_record(const char* path);
+int input_log_replay(const char* path, int full_speed);  // full_speed: no waiting between frames
+int input_log_replaying();
+int input_log_full_speed();
+
+// Drop-in for SDL_PollEvent. evaluating tells a replay that an evaluation is running: input recorded
+// while it ran, such as ON, is delivered as it was, and input recorded after its result waits for it.
+int input_poll_event(SDL_Event* event, int evaluating);
+
+// Evaluation results are part of a recording. A replay lets the result of the running evaluation be shown
+// only where the recording showed it, after the same input; once shown, report it.
+int input_log_result_due();
+void input_log_result_shown();
+
+// End of a main loop iteration: closes the latency of the events replayed during it
+void input_log_frame_done();
+
+// Print total time, per-event latency and the final screen checksum of a replay; close a recording
+void input_log_finish(unsigned long checksum);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include "math_engine.h"
+
+// A closed range [lo, hi] that is guaranteed to contain every value a
+// function takes over an input range.
+typedef struct {
+    double lo;
+    double hi;
+    int continuous;  // 1 if the function is defined and continuous over the whole input range
+    int empty;       // 1 if the function is defined nowhere on the input range
+} Interval;
+
+Interval make_interval(double lo, double hi);
+
+// Interval counterparts of apply_operation, negate and apply_function
+Interval interval_apply_operation(Interval a, Interval b, char op);
+Interval interval_negate(Interval a);
+Interval interval_apply_function(const CalcContext* context, FunctionId func, Interval a);
+
+// Evaluate a compiled expression with X ranging over x
+Interval run_program_interval(const CalcContext* context, const Program* program, Interval x);
+
+#endif
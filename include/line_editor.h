@@ -0,0 +1,62 @@
+#ifndef LINE_EDITOR_H
+#define LINE_EDITOR_H
+
+#include <stddef.h>
+
+#define LINE_EDITOR_INITIAL_CAPACITY 64  // Bytes allocated for a new line; the buffer doubles as needed
+#define LINE_EDITOR_GLYPHS 256           // Entries in an advance-width table, one per byte value
+
+// The home screen input line as a gap buffer: the text before the cursor sits at the start of the
+// buffer and the text after it at the end, with the free space (the gap) in between. Typing,
+// deleting and moving the cursor by one character touch only the edges of the gap, so they take
+// the same time however long the line is. The line has no length limit.
+typedef struct {
+    char* buffer;
+    size_t capacity;
+    size_t gap_start;      // Where the gap begins: the text before it is the start of the line
+    size_t gap_end;        // Where the text after the gap begins
+    size_t cursor;         // Cursor position in the line; the gap follows it on the next edit
+    int overwrite;         // Typing replaces the character under the cursor (the TI-84 default); INS switches to inserting
+    long cursor_x;         // Width of the text before the cursor, in pixels
+    long width;            // Width of the whole line
+    const int* advances;   // Width of each character, LINE_EDITOR_GLYPHS entries; NULL counts 1 per character
+} LineEditor;
+
+// Start an empty line measured with the given advance widths (kept by reference, may be NULL).
+// Returns 0 if out of memory.
+int line_editor_init(LineEditor* editor, const int* advances);
+void line_editor_free(LineEditor* editor);
+void line_editor_clear(LineEditor* editor);
+
+// Type text at the cursor and move past it. In overwrite mode it replaces as many characters as
+// it has, as far as the end of the line. Returns 0 if out of memory.
+int line_editor_insert(LineEditor* editor, const char* text);
+
+// DEL under the cursor, and the backspace before it. Return 0 if there is nothing to delete.
+int line_editor_delete(LineEditor* editor);
+int line_editor_backspace(LineEditor* editor);
+
+// Move the cursor by one character, or to the start or end of the line. Return 0 if it cannot move.
+int line_editor_left(LineEditor* editor);
+int line_editor_right(LineEditor* editor);
+void line_editor_home(LineEditor* editor);
+void line_editor_end(LineEditor* editor);
+
+void line_editor_toggle_insert(LineEditor* editor);
+
+size_t line_editor_length(const LineEditor* editor);
+size_t line_editor_cursor(const LineEditor* editor);
+// Character at a position of the line, or '\0' past its end
+char line_editor_char_at(const LineEditor* editor, size_t position);
+// Width of one character
+int line_editor_advance(const LineEditor* editor, char c);
+
+// Copy up to size - 1 characters starting at a position into out and terminate it. Returns the
+// number copied.
+size_t line_editor_copy(const LineEditor* editor, size_t start, char* out, size_t size);
+
+// The whole line as one string, valid until the next edit. Closes the gap by moving it to the end,
+// so it costs time in proportion to the text after the cursor: call it on ENTER, not every frame.
+const char* line_editor_text(LineEditor* editor);
+
+#endif
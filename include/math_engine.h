@@ -1,6 +1,14 @@
 #ifndef MATH_ENGINE_H
 #define MATH_ENGINE_H
 
+#define MAX_PROGRAM_LENGTH 256  // Maximum number of tokens in a compiled expression
+#define CALC_VARIABLES 33       // A..Z, Ans, then the previous terms of u, v and w
+#define CALC_ANS 26             // Index of Ans among the variables
+#define CALC_TERMS 27           // u(n-1), u(n-2), v(n-1), v(n-2), w(n-1), w(n-2): set while a sequence is stepped
+#define CALC_FLOAT -1           // fix_digits value for FLOAT mode
+#define MAX_PROGRAM_TEMPS 32    // Shared subexpressions an optimized program can keep
+#define PROGRAM_BATCH 16        // Values of X run_program_batch evaluates side by side
+
 // Functions for basic arithmetic
 double add(double a, double b);
 double subtract(double a, double b);
@@ -14,7 +22,126 @@ double sine(double a);
 double cosine(double a);
 double tangent(double a);
 
-// Expression evaluation function
-double evaluate_expression(const char* expression);  // <-- Add this line
+// Functions understood by the expression parser
+typedef enum {
+    FUNC_LOG,
+    FUNC_LN,
+    FUNC_SIN,
+    FUNC_COS,
+    FUNC_TAN,
+    FUNC_SQRT,
+    FUNC_SEQ_U,    // Terms of the SEQ mode sequences (see sequence.h)
+    FUNC_SEQ_V,
+    FUNC_SEQ_W,
+    FUNC_UNKNOWN
+} FunctionId;
+
+// Kinds of tokens in a compiled (postfix) expression
+typedef enum {
+    TOKEN_NUMBER,      // Push a constant
+    TOKEN_VARIABLE_X,  // Push the value of X
+    TOKEN_VARIABLE,    // Push a variable of the context (A..Z other than X, Ans)
+    TOKEN_OPERATOR,    // Pop two values, push the result of + - * / ^
+    TOKEN_NEGATE,      // Negate the top of the stack
+    TOKEN_FUNCTION,    // Replace the top of the stack with func(top)
+    TOKEN_POWER_INT,   // Raise the top of the stack to a small integer power by multiplying (optimizer)
+    TOKEN_STORE,       // Copy the top of the stack into a temporary (optimizer)
+    TOKEN_LOAD,        // Push a temporary stored earlier (optimizer)
+    TOKEN_IMAGINARY    // Push the imaginary unit i (undefined outside a+bi and re^θi modes)
+} TokenType;
+
+typedef struct {
+    TokenType type;
+    double value;     // Constant for TOKEN_NUMBER, exponent for TOKEN_POWER_INT
+    char op;          // Operator for TOKEN_OPERATOR
+    FunctionId func;  // Function for TOKEN_FUNCTION
+    int variable;     // Variable index for TOKEN_VARIABLE, temporary for TOKEN_STORE and TOKEN_LOAD
+} Token;
+
+// An expression compiled to postfix order, ready to be evaluated many times
+typedef struct {
+    Token tokens[MAX_PROGRAM_LENGTH];
+    int length;
+} Program;
+
+typedef enum {
+    ANGLE_RADIAN,
+    ANGLE_DEGREE
+} AngleMode;
+
+typedef enum {
+    NOTATION_NORMAL,
+    NOTATION_SCI,
+    NOTATION_ENG
+} NotationMode;
+
+typedef enum {
+    COMPLEX_REAL,         // Real results only; sqrt(-1) is an error
+    COMPLEX_RECTANGULAR,  // a+bi
+    COMPLEX_POLAR         // re^θi
+} ComplexMode;
+
+struct Sequences;
+
+// Everything an evaluation reads or writes: the MODE settings, the variables and the value stack.
+// Each thread evaluates in its own context, so evaluations share no mutable state other than a
+// Sequences set, which has its own lock.
+typedef struct {
+    AngleMode angle;
+    NotationMode notation;
+    int fix_digits;                         // 0..9 for FIX, CALC_FLOAT for FLOAT
+    ComplexMode complex_mode;
+    struct Sequences* sequences;            // u, v and w of SEQ mode (see sequence.h); NULL = none defined
+    double variables[CALC_VARIABLES];       // A..Z, Ans, then the sequence terms
+    double imaginary[CALC_VARIABLES];       // Imaginary parts of the variables, 0 unless set in complex mode
+    double scratch[MAX_PROGRAM_LENGTH];     // Value stack of run_program
+    double temps[MAX_PROGRAM_TEMPS];        // Temporaries of optimized programs
+    int (*cancel_check)(void);              // Returns nonzero to stop the evaluation; NULL = never
+} CalcContext;
+
+// Default modes (DEGREE, NORMAL, FLOAT, REAL) with every variable cleared
+void calc_context_init(CalcContext* context);
+// Copy the modes, variables and sequences of another context, but not its scratch memory or cancel hook
+void calc_context_copy_modes(CalcContext* context, const CalcContext* source);
+
+// Helpers shared by the evaluators
+int precedence(char op);
+double apply_operation(double a, double b, char op);
+double negate(double value);
+double power_int(double base, int exponent);
+double convert_to_radians(const CalcContext* context, double value);
+FunctionId lookup_function(const char* name);
+// Whether a function reads the u, v and w definitions, so its value is not fixed by its argument alone
+int is_sequence_function(FunctionId func);
+double apply_function(const CalcContext* context, FunctionId func, double value);
+double evaluate_function(const CalcContext* context, const char* func, double value);
+
+// Compile an expression to postfix form. Returns 1 on success, 0 on a syntax error.
+int compile_expression(const char* expression, Program* program);
+
+// Evaluate a compiled expression with the variable X (n in a sequence) set to x. Real numbers only: i evaluates to NaN.
+// Polls the context's cancel hook after each function and returns NaN once it fires.
+double run_program(CalcContext* context, const Program* program, double x);
+
+// Whether a program stays in the real numbers as far as its inputs go: it does not use i or a variable
+// holding a complex value. Checked once per evaluation, so run_program itself never tests for complex values.
+int program_is_real(const CalcContext* context, const Program* program);
+
+// The variables (A..Z, Ans) a program reads, bit v for variables[v]: every bit if it calls u, v or w,
+// whose definitions may read any of them. What cached results of the program depend on.
+unsigned long program_variables_read(const Program* program);
+
+// Evaluate a compiled expression for count values of X at once, each token over a batch of values
+// through the vector math kernels. Results are identical to calling run_program for each value. The
+// cancel hook is polled between batches; values not computed when it fires are NaN.
+void run_program_batch(CalcContext* context, const Program* program, const double* x, double* out, int count);
+
+// Cooperative cancellation: long-running evaluations poll this and stop early
+int evaluation_cancelled(const CalcContext* context);
+
+// Evaluate an expression with X taken from the context's variables in real numbers (see
+// evaluate_complex_expression for the complex modes); a successful result becomes Ans, and an error
+// (NaN) leaves it unchanged
+double evaluate_expression(CalcContext* context, const char* expression);
 
 #endif
@@ -0,0 +1,37 @@
+#ifndef MATH_KERNELS_H
+#define MATH_KERNELS_H
+
+#include "math_engine.h"
+
+#define KERNEL_BATCH 64  // Elements a kernel works on at a time; arrays of any length are accepted
+
+// Elementwise math over count values, written as branch-free loops the compiler turns into SIMD code.
+// out may be the same array as the input. Arguments a kernel's fast path does not cover (huge
+// angles, overflow, zero or negative logarithms, NaN) are handed to libm, so results are always defined.
+
+// Radians: Cody-Waite reduction by pi/2 and fdlibm polynomials
+void kernel_sin(const double* x, double* out, int count);
+void kernel_cos(const double* x, double* out, int count);
+void kernel_tan(const double* x, double* out, int count);
+
+// Degrees: reduced exactly modulo 360 and then to within 45 degrees of a multiple of 90 before the
+// single conversion to radians, so sin(180) and cos(90) are exactly 0, sin(30) is exactly .5,
+// tan(45) exactly 1, and tan(90) undefined (NaN)
+void kernel_sin_degrees(const double* x, double* out, int count);
+void kernel_cos_degrees(const double* x, double* out, int count);
+void kernel_tan_degrees(const double* x, double* out, int count);
+
+void kernel_exp(const double* x, double* out, int count);
+void kernel_log(const double* x, double* out, int count);
+void kernel_log10(const double* x, double* out, int count);
+void kernel_sqrt(const double* x, double* out, int count);
+
+// base^exponent through a double-double logarithm. Integer exponents go to libm's pow, so
+// exactly representable results such as 3^10 stay exact.
+void kernel_pow(const double* base, const double* exponent, double* out, int count);
+
+// Apply a parser function to count values in the context's angle mode. As on the calculator, ln and
+// log of 0 are undefined (NaN) rather than -inf, which would show as an overflow.
+void kernel_apply_function(const CalcContext* context, FunctionId func, const double* x, double* out, int count);
+
+#endif
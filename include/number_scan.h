@@ -0,0 +1,10 @@
+#ifndef NUMBER_SCAN_H
+#define NUMBER_SCAN_H
+
+// Read a number at the start of text: digits with an optional decimal point, then an optional
+// TI exponent E followed by an optional sign (-, +, ~ or neg) and digits (1.5E-7, 6.02E23). The result is the
+// double nearest to the decimal value.
+// Returns the number of characters read, or 0 if text does not start with a number.
+int scan_number(const char* text, double* value);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "math_engine.h"
+
+#define OPTIMIZER_MAX_POWER 16  // Largest integer power rewritten to multiplications
+
+// Rewrite a compiled program so it evaluates faster in the given context:
+//   - constant subexpressions are folded, using the context's angle mode (sin(30) depends on it),
+//     so the program must be optimized again when the angle mode changes;
+//   - X^n for integer 0 <= n <= OPTIMIZER_MAX_POWER becomes repeated multiplication;
+//   - repeated subexpressions are computed once and reused through temporaries.
+// Folding and subexpression reuse perform the same operations as before, so results are identical.
+// Powers may differ from pow() by up to n - 1 ulps (none for n <= 2).
+void optimize_program(const CalcContext* context, Program* program);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+
+#define PROFILE_RING_EVENTS 16384 // Most recent timed scopes kept per thread
+#define PROFILE_MAX_THREADS 16
+#define PROFILE_FRAME_SAMPLES 256 // Frames (and input latencies) the percentiles are taken over
+#define PROFILE_PENDING_INPUTS 32 // Key presses waiting for their first present
+
+// Monotonic clock in nanoseconds
+uint64_t profile_now();
+
+// Record a finished scope in the calling thread's ring buffer. name must be a string literal.
+void profile_record(const char* name, uint64_t start, uint64_t end);
+void profile_thread_name(const char* name);  // Label the calling thread in the trace
+
+// Time the rest of the enclosing block:  PROFILE_SCOPE("update_screen");
+typedef struct {
+    const char* name;
+    uint64_t start;
+} ProfileScope;
+
+void profile_scope_end(ProfileScope* scope);
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(label) \
+    ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__) __attribute__((cleanup(profile_scope_end))) = { label, profile_now() }
+
+// Main loop bookkeeping (UI thread only)
+void profile_frame_begin();
+void profile_frame_end();
+// A key went down queued_ns before it was dispatched (the time it waited in the event queue, which
+// counts); its latency ends at the present of the frame that handles it
+void profile_input_event(uint64_t queued_ns);
+void profile_present_done();   // The frame was presented
+
+// Percentiles over the recent frames and key-down-to-present latencies, in milliseconds
+typedef struct {
+    double frame_p50, frame_p99;
+    double latency_p50, latency_p99;
+    int frames, inputs;
+} ProfileSummary;
+
+ProfileSummary profile_summary();
+
+// Write every ring buffer as a Chrome trace (chrome://tracing, Perfetto) with the summary attached.
+// Only call once the other threads have stopped. Returns 1 on success.
+int profile_write_trace(const char* path);
+
+#endif
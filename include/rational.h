@@ -0,0 +1,56 @@
+#ifndef RATIONAL_H
+#define RATIONAL_H
+
+#include <stdint.h>
+#include "math_engine.h"
+
+#define FRAC_SUFFIX ">Frac"            // ►Frac, typed at the end of a home screen expression
+#define FRAC_MAX_DENOMINATOR 9999      // Largest denominator ►Frac finds for an inexact value, as on the TI-84
+#define FRAC_TOLERANCE 1e-12           // Relative distance at which such a fraction counts as the value
+
+// An exact fraction with a positive denominator, not necessarily in lowest terms. Numerator and
+// denominator stay above INT64_MIN, so negating never overflows.
+typedef struct {
+    int64_t num;
+    int64_t den;
+} Rational;
+
+// Greatest common divisor by binary GCD (Stein's algorithm); gcd(0, b) = b
+uint64_t rational_gcd(uint64_t a, uint64_t b);
+
+// The same fraction in lowest terms
+Rational rational_reduce(Rational value);
+
+// Arithmetic with 128-bit intermediates. Results are left unreduced while they fit in 64 bits, so
+// most operations need no GCD; on overflow the operands are reduced and the result is computed in
+// lowest terms. Returns 0 only when even that does not fit (or on division by zero), leaving the
+// caller to fall back to doubles.
+int rational_add(Rational a, Rational b, Rational* out);
+int rational_subtract(Rational a, Rational b, Rational* out);
+int rational_multiply(Rational a, Rational b, Rational* out);
+int rational_divide(Rational a, Rational b, Rational* out);
+int rational_power(Rational base, int64_t exponent, Rational* out);
+
+// A fraction as a double: the nearest one when numerator and denominator are below 2^53
+double rational_to_double(Rational value);
+
+// The first convergent of the continued fraction of x within a relative tolerance of x, in lowest
+// terms with a denominator of at most max_denominator. A tolerance of 0 asks for a fraction whose
+// nearest double is x itself, so the scanned 0.1 becomes 1/10. Returns 0 if there is none.
+int rational_from_double(double x, int64_t max_denominator, double tolerance, Rational* out);
+
+// Evaluate a compiled expression exactly, reading constants as the fractions they were typed as and
+// variables, which may hold inexact results like Ans, as the nearest fraction ►Frac would show, with
+// the result in lowest terms. Returns 0 if it leaves the rationals: a function,
+// a non-integer power, division by zero or a result too large for 64 bits.
+int run_program_rational(const CalcContext* context, const Program* program, Rational x, Rational* out);
+
+// If expression ends in FRAC_SUFFIX, remove it and return 1
+int strip_frac_suffix(char* expression);
+
+// Evaluate an expression for ►Frac: exactly when run_program_rational can, otherwise in doubles and
+// converted with rational_from_double like the TI-84. *value is the result as a double, which becomes
+// Ans unless it is an error (NaN) or the evaluation was cancelled. Returns 1 with the fraction in *fraction, or 0 if the value has no fraction to show.
+int evaluate_fraction(CalcContext* context, const char* expression, double* value, Rational* fraction);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <stddef.h>
+#include "math_engine.h"
+
+#define REGRESSION_MAX_TERMS 4        // Coefficients of CubicReg, the largest model
+#define REGRESSION_CHUNK 65536        // Points per chunk; chunks are summarized in parallel, then merged in order
+#define REGRESSION_BLOCK 64           // Points folded into a chunk's summary at a time
+#define REGRESSION_MAX_THREADS 16
+#define REGRESSION_SINGULAR 1e-13     // A fit is singular when a column is this close to depending on the others
+
+// The STAT CALC regressions. Each is a least-squares line or polynomial in transformed coordinates:
+// ExpReg fits ln y against x and PwrReg ln y against ln x, as on the TI-84.
+typedef enum {
+    REGRESSION_LINEAR,       // LinReg(ax+b): y = ax+b
+    REGRESSION_QUADRATIC,    // QuadReg: y = ax^2+bx+c
+    REGRESSION_CUBIC,        // CubicReg: y = ax^3+bx^2+cx+d
+    REGRESSION_EXPONENTIAL,  // ExpReg: y = a*b^x, for y > 0
+    REGRESSION_POWER         // PwrReg: y = a*x^b, for x > 0 and y > 0
+} RegressionModel;
+
+typedef struct {
+    RegressionModel model;
+    int terms;                                 // Coefficients in use
+    double coefficients[REGRESSION_MAX_TERMS]; // a, b, c, d in the order the TI-84 lists them
+    double r2;                                 // Coefficient of determination (of the transformed data for ExpReg and PwrReg)
+    double r;                                  // Correlation coefficient; NaN for QuadReg and CubicReg, which have only R^2
+    long count;                                // Points fitted
+} RegressionFit;
+
+// A data set read from a file, like the lists L1 and L2
+typedef struct {
+    double* x;
+    double* y;
+    long count;
+} RegressionData;
+
+// Fit a model to count points in one pass over the data. The points are split into chunks of
+// REGRESSION_CHUNK, and each chunk is reduced on a worker thread to the triangular factor R of its
+// rows [1 t t^2 .. | y] by Householder reflections (R^T R is the chunk's matrix of moment sums, but
+// forming R directly never squares the condition number like the normal equations do). Chunk factors
+// are merged in chunk order, so the result does not depend on the number of threads, and the
+// coefficients come from back substitution. x is shifted by the first point before the powers are taken.
+// Returns 1 on success, or 0 with a message if there are too few points, the fit is singular or a
+// point is outside the model's domain.
+int regression_fit(RegressionModel model, const double* x, const double* y, long count, RegressionFit* fit);
+
+// The fitted value at x
+double regression_evaluate(const RegressionFit* fit, double x);
+
+// Look up a model by its TI-84 name (LinReg, QuadReg, CubicReg, ExpReg, PwrReg), ignoring case.
+// Returns 0 if there is no such model.
+int regression_lookup(const char* name, RegressionModel* model);
+const char* regression_name(RegressionModel model);
+
+// Write the fitted equation as an expression in X, with every coefficient in the shortest digits that
+// read back exactly, ready for a Y= slot. Returns 0 if it does not fit in size characters.
+int regression_equation(const RegressionFit* fit, char* out, size_t size);
+
+// Store the fitted equation into a Y= slot (0-based), like RegEQ. Returns 1 on success.
+int regression_store(const RegressionFit* fit, int slot);
+
+// Show a fit the way the calculator does: the model, its coefficients and r^2 / R^2, in the context's modes
+void regression_print(const CalcContext* context, const RegressionFit* fit);
+
+// Read x,y pairs from a text file, one point per line separated by a comma, semicolon or white space.
+// Lines that do not start with two numbers, like a header, are skipped. Returns 1 on success.
+int regression_load(const char* path, RegressionData* data);
+void regression_free(RegressionData* data);
+
+#endif
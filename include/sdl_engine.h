@@ -9,8 +9,13 @@ extern SDL_Renderer* renderer;
 
 // Declare functions
 int init_sdl();
+int init_sdl_headless();          // Render into an offscreen surface instead of a window
+int save_screenshot(const char* path);  // Last frame rendered with capture set, as a PPM image
 void close_sdl();
 void render_calculator();
+void render_frame(int capture);   // Draw the active screen and present it, once per frame; capture keeps
+                                  // a copy for save_screenshot, read before presenting
 void handle_input(int* quit);
+unsigned long screen_checksum();  // Hash of the displayed state, for replay runs
 
 #endif
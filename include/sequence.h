@@ -0,0 +1,66 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "math_engine.h"
+
+#define SEQUENCE_COUNT 3            // u, v and w
+#define SEQUENCE_MAX_LAG 2          // A term may use the two terms before it, like u(n-2) on the TI-84
+#define SEQUENCE_WINDOW 256         // Recent terms each thread remembers; must be a power of two
+#define SEQUENCE_CANCEL_INTERVAL 4096  // Terms computed between checks for ON
+#define SEQUENCE_DEFAULT_NMIN 1
+#define SEQUENCE_EXPRESSION_LENGTH 256
+
+// SEQ mode: u(n), v(n) and w(n) defined in terms of n and their previous terms, as in
+// u(n) = u(n-1) + u(n-2) with u(nMin) = {1,1}. In an expression u(5) is the fifth term and n is the
+// independent variable, like X.
+//
+// A term is computed bottom-up from nMin, one step per term, keeping only the last SEQUENCE_WINDOW
+// terms of each sequence: u(10^7) takes 10^7 steps in constant memory instead of the exponential
+// recursion of the definition. Each thread keeps its own window, so asking for the next term, or for
+// one a little behind, costs at most one step; a term before the window starts over from nMin.
+// Sequences that do not refer to earlier terms are evaluated directly at n.
+//
+// The definitions belong to a Sequences set that a context points to, so contexts can hold different
+// sequences. Contexts copied with calc_context_copy_modes share the set, like the home screen, its
+// evaluation worker and the TABLE thread: one thread edits it while the others read it.
+
+extern int sequence_mode;  // MODE is SEQ: the Y= editor and TABLE show u, v and w instead of Y1..Y0
+
+struct Sequences {
+    char definitions[SEQUENCE_COUNT][SEQUENCE_EXPRESSION_LENGTH];  // As typed
+    char initials[SEQUENCE_COUNT][SEQUENCE_EXPRESSION_LENGTH];
+    long nmin;
+    pthread_mutex_t lock;   // Guards the above against readers on other threads
+    atomic_uint version;    // Changes on every edit, and differs from every other set's
+};
+typedef struct Sequences Sequences;
+
+#define SEQUENCES_INITIALIZER { .nmin = SEQUENCE_DEFAULT_NMIN, .lock = PTHREAD_MUTEX_INITIALIZER }
+
+// An empty set with nMin 1
+void sequences_init(Sequences* sequences);
+
+// Define u(n) (0), v(n) (1) or w(n) (2). References to earlier terms must have the form u(n-1) or
+// u(n-2), of any of the three sequences. The definition is compiled the next time a term is needed;
+// an empty one clears the sequence.
+void sequence_set(Sequences* sequences, int which, const char* expression);
+// The initial terms u(nMin): a number, or the list {u(nMin+1),u(nMin)} when the definition goes back
+// two terms, as on the TI-84. The braces may be left out.
+void sequence_set_initial(Sequences* sequences, int which, const char* values);
+// First n of every sequence (a whole number, 0 or more). Returns 0 if it is not.
+int sequence_set_nmin(Sequences* sequences, double nmin);
+
+// Only for the thread that edits the set
+const char* sequence_get(const Sequences* sequences, int which);
+const char* sequence_get_initial(const Sequences* sequences, int which);
+long sequence_get_nmin(const Sequences* sequences);
+int sequence_defined(const Sequences* sequences, int which);
+char sequence_name(int which);  // 'u', 'v' or 'w'
+
+// Term n of a sequence of the context's set, in its modes and variables. NaN if the context has no
+// set, n is not a whole number at least nMin, the definition is invalid or the computation was cancelled.
+double sequence_term(const CalcContext* context, int which, double n);
+
+#endif
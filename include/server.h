@@ -0,0 +1,59 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+#define SERVER_DEFAULT_WORKERS 4
+#define SERVER_MAX_FRAME (1 << 20)    // Largest request or response, in bytes after the size field
+#define SERVER_CACHE_SLOTS 32         // Compiled expressions remembered per connection
+#define SERVER_CACHE_WAYS 4           // Slots an expression may go in; the least recently used is replaced
+#define SERVER_MAX_EVENTS 64          // epoll events taken per wait
+#define SERVER_READ_CHUNK 65536
+#define SERVER_MAX_BUFFERED (4 * SERVER_MAX_FRAME)  // Input or unsent output at which a connection stops being read
+
+// The evaluation service: clients connect to a Unix domain socket and send frames, one request after
+// another without waiting for the answers (pipelining). Every frame starts with a header in the
+// machine's own byte order (the socket is local), followed by its data:
+//
+//   request:  ServerRequest, the expression (expression_length bytes, no terminator), count doubles of X
+//   response: ServerResponse, count doubles: the value of the expression at each X (NaN where undefined)
+//
+// Answers on a connection come back in the order of its requests. size counts the bytes after the
+// size field itself. A client may shut down its writing side after the last request and still read
+// every answer. The server stops reading from a client that lets SERVER_MAX_BUFFERED bytes of answers
+// pile up, until it reads them.
+typedef struct {
+    uint32_t size;
+    uint32_t id;                 // Echoed in the response
+    uint8_t op;                  // SERVER_OP_EVALUATE
+    uint8_t angle;               // ANGLE_RADIAN or ANGLE_DEGREE
+    uint16_t expression_length;
+    uint32_t count;              // Values of X; more than one are evaluated as a batch
+} ServerRequest;
+
+typedef struct {
+    uint32_t size;
+    uint32_t id;
+    uint8_t status;              // ServerStatus
+    uint8_t reserved[3];
+    uint32_t count;              // Values that follow: the request's count, or 0 on an error
+} ServerResponse;
+
+typedef enum {
+    SERVER_OP_EVALUATE = 1
+} ServerOp;
+
+typedef enum {
+    SERVER_OK,
+    SERVER_SYNTAX_ERROR,   // The expression does not compile
+    SERVER_BAD_REQUEST     // Unknown op, or the sizes in the header do not add up
+} ServerStatus;
+
+// Serve on a socket at path until SIGINT or SIGTERM. One thread runs the epoll loop, reading requests
+// and writing what the workers could not; a fixed pool of workers evaluates them. A connection is served
+// by one worker at a time, which takes every complete request it has, so its answers stay in order
+// and its cache of compiled expressions needs no lock, while separate connections run in parallel.
+// Returns 0 on a clean shutdown, -1 if the socket cannot be set up.
+int server_run(const char* path, int workers);
+
+#endif
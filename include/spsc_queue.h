@@ -0,0 +1,25 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Lock-free queue for exactly one producer thread and one consumer thread.
+// Items are copied in and out by value.
+typedef struct {
+    _Atomic size_t head;      // Next item to read, written only by the consumer
+    char head_padding[64];    // Keep head and tail on separate cache lines
+    _Atomic size_t tail;      // Next free slot, written only by the producer
+    char tail_padding[64];
+    size_t capacity;
+    size_t item_size;
+    unsigned char* items;
+} SpscQueue;
+
+int spsc_init(SpscQueue* queue, size_t capacity, size_t item_size);  // Returns 1 on success
+void spsc_destroy(SpscQueue* queue);
+
+int spsc_push(SpscQueue* queue, const void* item);  // Producer only. Returns 0 if full.
+int spsc_pop(SpscQueue* queue, void* item);         // Consumer only. Returns 0 if empty.
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stdio.h>
+#include "graph.h"
+
+#define TABLE_RING_ROWS 256   // Rows kept around the viewport
+#define TABLE_BATCH_ROWS 32   // Rows evaluated per batch by the background thread
+#define TABLE_PREFETCH_ROWS 64 // Rows produced ahead of the viewport
+
+// One row of the table: X (or n) and the value of every Y= column
+typedef struct {
+    double x;
+    double y[GRAPH_MAX_FUNCTIONS];
+} TableRow;
+
+// TBLSET
+extern double table_start;  // TblStart
+extern double table_step;   // ΔTbl
+
+// Start the background generator for the current Y= functions (call again after they change)
+void table_start_generator();
+void table_stop_generator();
+
+// Tell the generator which rows are on screen; rows are numbered from TblStart, may be negative
+void table_set_viewport(long top_row, int visible_rows);
+
+// Copy a row out of the ring buffer. Returns 0 if it has not been produced yet.
+int table_get_row(long row, TableRow* out);
+
+// Which Y= slots have a column in the table (in SEQ mode, which of u, v and w)
+int table_column_count();
+int table_column_slot(int column);
+// Column headers: X and Y1..Y0, or n and u, v, w in SEQ mode
+const char* table_variable_name();
+const char* table_column_name(int column);
+
+// Stream rows [0, rows) to a CSV file through the same generator, each value in the shortest digits that
+// read back exactly. Returns 1 on success.
+int table_export_csv(FILE* file, long rows);
+
+#endif
@@ -0,0 +1,1735 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include <pthread.h>
+#include <complex.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "bench.h"
+#include "math_engine.h"
+#include "optimizer.h"
+#include "number_scan.h"
+#include "format.h"
+#include "math_kernels.h"
+#include "rational.h"
+#include "complex_math.h"
+#include "regression.h"
+#include "graph.h"
+#include "line_editor.h"
+#include "sequence.h"
+#include "server.h"
+
+#define BENCH_EXPRESSION "sin(X)^2+cos(X)^2*3-ln(X+2)/(1+A)"
+
+typedef struct {
+    CalcContext* context;  // Private to the thread
+    const Program* program;
+    long evaluations;
+    double sum;
+} BenchThread;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cancel_polls, cancel_poll_limit;
+
+// ON pressed after cancel_poll_limit polls
+static int cancel_after_polls() {
+    return ++cancel_polls > cancel_poll_limit;
+}
+
+static void* bench_thread(void* arg) {
+    BenchThread* bench = arg;
+    double sum = 0.0;
+    for (long i = 0; i < bench->evaluations; i++) {
+        sum += run_program(bench->context, bench->program, (double)(i % 3600) / 10.0);
+    }
+    bench->sum = sum;
+    return NULL;
+}
+
+int bench_contexts(int max_threads, long evaluations) {
+    Program program;
+    if (max_threads < 1 || !compile_expression(BENCH_EXPRESSION, &program)) return 0;
+
+    BenchThread* threads = calloc(max_threads, sizeof(BenchThread));
+    pthread_t* handles = calloc(max_threads, sizeof(pthread_t));
+    if (threads == NULL || handles == NULL) {
+        free(threads);
+        free(handles);
+        return 0;
+    }
+
+    // Each context gets its own cache lines, so the only thing threads share is the read-only program
+    for (int t = 0; t < max_threads; t++) {
+        threads[t].context = aligned_alloc(64, (sizeof(CalcContext) + 63) / 64 * 64);
+        if (threads[t].context == NULL) {
+            printf("Error: Out of memory\n");
+            exit(1);
+        }
+        calc_context_init(threads[t].context);
+        threads[t].context->variables[0] = 1.0;  // A
+        threads[t].program = &program;
+        threads[t].evaluations = evaluations;
+    }
+
+    printf("Evaluating %s %ld times per context\n", BENCH_EXPRESSION, evaluations);
+    int consistent = 1;
+    double expected = 0.0, single_rate = 0.0;
+    for (int n = 1; ; n = n * 2 < max_threads ? n * 2 : max_threads) {
+        double start = now_seconds();
+        for (int t = 0; t < n; t++) pthread_create(&handles[t], NULL, bench_thread, &threads[t]);
+        for (int t = 0; t < n; t++) pthread_join(handles[t], NULL);
+        double rate = n * evaluations / (now_seconds() - start);
+
+        if (n == 1) {
+            expected = threads[0].sum;
+            single_rate = rate;
+        }
+        for (int t = 0; t < n; t++) {
+            if (threads[t].sum != expected) consistent = 0;
+        }
+        printf("%3d contexts: %12.0f evaluations/s, speedup %.2fx (%.0f%% of linear)\n",
+               n, rate, rate / single_rate, 100.0 * rate / (single_rate * n));
+        if (n == max_threads) break;
+    }
+    printf(consistent ? "All contexts computed the same result\n" : "Error: Contexts disagree\n");
+
+    for (int t = 0; t < max_threads; t++) free(threads[t].context);
+    free(threads);
+    free(handles);
+    return consistent;
+}
+
+// Representative Y= functions: constant subtrees, small powers and repeated subexpressions
+static const char* optimizer_corpus[] = {
+    "sin(30)*2*X",
+    "X^2+3X+2",
+    "X^3-2X^2+X-5",
+    "(X+1)^2*(X+1)^2",
+    "sin(X)^2+cos(X)^2",
+    "(sin(X)+cos(X))^4-(sin(X)+cos(X))^2",
+    "ln(X^2+1)/(1+ln(X^2+1))",
+    "log(2)*X^4+ln(10)*X^3+tan(45)",
+    "X^5/(X^2+1)-X^16",
+    "2^X+sin(X/2)*sin(X/2)",
+};
+
+// Difference between two results, relative to the larger of their magnitude and 1 (absolute near zero,
+// where cancellation makes ulps meaningless)
+static double relative_error(double a, double b) {
+    if (a == b || (isnan(a) && isnan(b))) return 0.0;
+    if (!isfinite(a) || !isfinite(b)) return INFINITY;
+    return fabs(a - b) / fmax(fmax(fabs(a), fabs(b)), 1.0);
+}
+
+// Worst distance in ulps between power_int and pow over a spread of bases, for exponents 2..n
+static double worst_power_ulps(int n) {
+    double worst = 0.0;
+    for (int exponent = 2; exponent <= n; exponent++) {
+        for (int i = 1; i <= 100000; i++) {
+            double base = (i % 2 ? -1.0 : 1.0) * i * 1.0001e-3;
+            double exact = pow(base, exponent), fast = power_int(base, exponent);
+            if (!isfinite(exact)) continue;
+            double ulp = nextafter(fabs(exact), INFINITY) - fabs(exact);
+            if (fabs(exact - fast) / ulp > worst) worst = fabs(exact - fast) / ulp;
+        }
+    }
+    return worst;
+}
+
+static double time_program(CalcContext* context, const Program* program, long evaluations, double* sum) {
+    double start = now_seconds();
+    double total = 0.0;
+    for (long i = 0; i < evaluations; i++) {
+        total += run_program(context, program, (double)(i % 2000) / 100.0 - 10.0);
+    }
+    *sum = total;
+    return (now_seconds() - start) / evaluations * 1e9;
+}
+
+int bench_optimizer(long evaluations) {
+    static CalcContext context;
+    int count = sizeof(optimizer_corpus) / sizeof(optimizer_corpus[0]);
+    int within_tolerance = 1;
+    double plain_total = 0.0, optimized_total = 0.0;
+
+    calc_context_init(&context);
+    double power_ulps = worst_power_ulps(OPTIMIZER_MAX_POWER);
+    printf("Integer powers up to %d: within %.1f ulps of pow()\n", OPTIMIZER_MAX_POWER, power_ulps);
+    if (power_ulps > OPTIMIZER_MAX_POWER - 1) within_tolerance = 0;
+
+    printf("%-40s %7s %9s %9s %8s %9s\n", "Expression", "Tokens", "Plain ns", "Opt ns", "Speedup", "Rel err");
+    for (int e = 0; e < count; e++) {
+        Program plain, optimized;
+        if (!compile_expression(optimizer_corpus[e], &plain)) return 0;
+        optimized = plain;
+        optimize_program(&context, &optimized);
+
+        // Same inputs through both programs; only the rewritten powers round differently
+        double worst = 0.0;
+        for (int i = 0; i <= 2000; i++) {
+            double x = i / 100.0 - 10.0;
+            double error = relative_error(run_program(&context, &plain, x), run_program(&context, &optimized, x));
+            if (error > worst) worst = error;
+        }
+        if (worst > 1e-12) within_tolerance = 0;
+
+        double plain_sum, optimized_sum;
+        double plain_ns = time_program(&context, &plain, evaluations, &plain_sum);
+        double optimized_ns = time_program(&context, &optimized, evaluations, &optimized_sum);
+        plain_total += plain_ns;
+        optimized_total += optimized_ns;
+
+        char tokens[16];
+        snprintf(tokens, sizeof(tokens), "%d->%d", plain.length, optimized.length);
+        printf("%-40s %7s %9.1f %9.1f %7.2fx %9.1e\n", optimizer_corpus[e], tokens, plain_ns, optimized_ns,
+               plain_ns / optimized_ns, worst);
+    }
+    printf("Corpus: %.2fx faster after optimization\n", plain_total / optimized_total);
+    printf(within_tolerance ? "All results within tolerance\n" : "Error: Optimized results differ beyond tolerance\n");
+    return within_tolerance;
+}
+
+// Numbers as they appear in typed expressions and Y= functions
+static const char* number_corpus[] = {
+    "0", "1", "2", "3", "10", "45", "90", "180", "360", "0.5", "0.25", "0.1", "0.3", "1.5",
+    "3.14159", "2.71828", "9.81", "6.02E23", "1.5E-7", "299792458", "0.001", "123.456", "1E10", "0.0001",
+};
+
+// Exponents typed with the (-) key, including those too long or too large for the fast path
+static const struct {
+    const char* text;
+    double value;
+} negative_exponent_cases[] = {
+    { "1E~30", 1e-30 },
+    { "1Eneg30", 1e-30 },
+    { "1E~5", 1e-5 },
+    { "2.5Eneg3", 2.5e-3 },
+    { "1E~400", 0.0 },
+    { "1Eneg330", 0.0 },
+    { "12345678901234567890123E~5", 12345678901234567890123e-5 },
+    { "12345678901234567890123Eneg5", 12345678901234567890123e-5 },
+    { "4.9406564584124654E~324", 4.9406564584124654e-324 },
+};
+
+static uint64_t random_state = 88172645463325252ull;
+
+static uint64_t random_bits() {
+    random_state ^= random_state << 13;  // xorshift64
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+// Scan text and compare bit for bit with the expected double
+static int scans_to(const char* text, double expected) {
+    double value;
+    int length = scan_number(text, &value);
+    return length == (int)strlen(text) && memcmp(&value, &expected, sizeof(double)) == 0;
+}
+
+int bench_numbers(long iterations) {
+    int count = sizeof(number_corpus) / sizeof(number_corpus[0]);
+    char strtod_text[sizeof(number_corpus) / sizeof(number_corpus[0])][32];
+    double sink = 0.0, value;
+    long failures = 0, checked = 0;
+
+    // strtod spells the exponent 'e'
+    for (int i = 0; i < count; i++) {
+        snprintf(strtod_text[i], sizeof(strtod_text[i]), "%s", number_corpus[i]);
+        for (char* c = strtod_text[i]; *c; c++) if (*c == 'E') *c = 'e';
+        if (!scans_to(number_corpus[i], strtod(strtod_text[i], NULL))) {
+            printf("Mismatch with strtod: %s\n", number_corpus[i]);
+            failures++;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(negative_exponent_cases) / sizeof(negative_exponent_cases[0]); i++) {
+        if (!scans_to(negative_exponent_cases[i].text, negative_exponent_cases[i].value)) {
+            scan_number(negative_exponent_cases[i].text, &value);
+            printf("Negative exponent misread: %s gave %.17g\n", negative_exponent_cases[i].text, value);
+            failures++;
+        }
+    }
+
+    double start = now_seconds();
+    for (long n = 0; n < iterations; n++) {
+        scan_number(number_corpus[n % count], &value);
+        sink += value;
+    }
+    double scan_ns = (now_seconds() - start) / iterations * 1e9;
+    start = now_seconds();
+    for (long n = 0; n < iterations; n++) {
+        sink += strtod(strtod_text[n % count], NULL);
+    }
+    double strtod_ns = (now_seconds() - start) / iterations * 1e9;
+    printf("Corpus of %d numbers: scan_number %.1f ns, strtod %.1f ns (%.2fx faster)\n",
+           count, scan_ns, strtod_ns, strtod_ns / scan_ns);
+    if (isnan(sink)) printf("\n");  // Keeps the timed loops from being optimized away
+
+    // Round trips: random finite doubles printed with 17 significant digits, plain and with E
+    for (long n = 0; n < iterations; n++) {
+        uint64_t bits = random_bits();
+        double original;
+        memcpy(&original, &bits, sizeof(double));
+        if (!isfinite(original)) continue;
+        original = fabs(original);  // Signs are the parser's negation, not part of a number
+
+        char text[64];
+        checked++;
+        snprintf(text, sizeof(text), "%.17g", original);
+        for (char* c = text; *c; c++) if (*c == 'e') *c = 'E';
+        if (!scans_to(text, original)) {
+            if (failures++ < 10) printf("Round trip failed: %s\n", text);
+        }
+    }
+
+    // Short decimal strings, where the fast path applies, against strtod
+    for (long n = 0; n < iterations; n++) {
+        char text[64], reference[64];
+        int digits = 1 + (int)(random_bits() % 17);
+        int point = (int)(random_bits() % (digits + 1));
+        int power = (int)(random_bits() % 61) - 30;
+        int used = 0;
+        for (int d = 0; d < digits; d++) {
+            if (d == point && d > 0) text[used++] = '.';
+            text[used++] = (char)('0' + random_bits() % 10);
+        }
+        used += snprintf(text + used, sizeof(text) - used, "E%d", power);
+        snprintf(reference, sizeof(reference), "%s", text);
+        checked++;
+        *strchr(reference, 'E') = 'e';
+        if (!scans_to(text, strtod(reference, NULL))) {
+            if (failures++ < 10) printf("Mismatch with strtod: %s\n", text);
+        }
+    }
+
+    printf(failures == 0 ? "All %ld round trips exact\n" : "Error: %ld numbers scanned incorrectly\n",
+           failures == 0 ? checked : failures);
+    return failures == 0;
+}
+
+// Digits of the shortest %.*e output that reads back as value, for comparison with format_shortest
+static int shortest_digits(double value) {
+    char text[64];
+    for (int digits = 1; digits < 17; digits++) {
+        snprintf(text, sizeof(text), "%.*e", digits - 1, value);
+        if (strtod(text, NULL) == value) return digits;
+    }
+    return 17;
+}
+
+// Significant digits written by format_shortest, ignoring zeros that only place the point
+static int written_digits(const char* text) {
+    const char* end = strchr(text, 'E');
+    const char* first = text;
+    if (end == NULL) end = text + strlen(text);
+    while (first < end && (*first == '-' || *first == '0' || *first == '.')) first++;
+    const char* last = end;
+    if (strchr(text, '.') == NULL) {
+        while (last > first && last[-1] == '0') last--;
+    }
+    int digits = 0;
+    for (const char* c = first; c < last; c++) {
+        if (*c != '.') digits++;
+    }
+    return digits;
+}
+
+int bench_format(long iterations) {
+    int count = 4096;
+    double* values = malloc(count * sizeof(double));
+    char text[64];
+    long failures = 0, longer = 0, checked = 0;
+    size_t sink = 0;
+    if (values == NULL) return 0;
+
+    // Table-like values (short decimals) and arbitrary doubles, half and half
+    for (int i = 0; i < count; i++) {
+        if (i % 2 == 0) {
+            values[i] = (double)(int64_t)(random_bits() % 2000001 - 1000000) / 1000.0;
+        } else {
+            uint64_t bits;
+            do {
+                bits = random_bits();
+                memcpy(&values[i], &bits, sizeof(double));
+            } while (!isfinite(values[i]));
+        }
+    }
+
+    double start = now_seconds();
+    for (long n = 0; n < iterations; n++) {
+        sink += format_shortest(values[n % count], text);
+    }
+    double format_ns = (now_seconds() - start) / iterations * 1e9;
+    start = now_seconds();
+    for (long n = 0; n < iterations; n++) {
+        sink += snprintf(text, sizeof(text), "%.17g", values[n % count]);
+    }
+    double snprintf_ns = (now_seconds() - start) / iterations * 1e9;
+    printf("format_shortest %.1f ns, snprintf %%.17g %.1f ns (%.2fx faster)\n",
+           format_ns, snprintf_ns, snprintf_ns / format_ns);
+    if (sink == 0) printf("\n");  // Keeps the timed loops from being optimized away
+    free(values);
+
+    // Every output must scan back exactly, with no more digits than necessary
+    for (long n = 0; n < iterations; n++) {
+        uint64_t bits = random_bits();
+        double original;
+        memcpy(&original, &bits, sizeof(double));
+        if (!isfinite(original)) continue;
+        original = fabs(original);  // Signs are the parser's negation, not part of a number
+
+        checked++;
+        format_shortest(original, text);
+        if (!scans_to(text, original)) {
+            if (failures++ < 10) printf("Round trip failed: %s\n", text);
+        }
+        if (n % 16 == 0 && written_digits(text) > shortest_digits(original)) longer++;
+    }
+    if (longer > 0) {
+        printf("Error: %ld of %ld sampled values longer than the shortest\n", longer, (checked + 15) / 16);
+    } else {
+        printf("All %ld sampled values shortest\n", (checked + 15) / 16);
+    }
+
+    printf(failures == 0 ? "All %ld round trips exact\n" : "Error: %ld values formatted incorrectly\n",
+           failures == 0 ? checked : failures);
+    return failures == 0 && longer == 0;
+}
+
+#define KERNEL_BENCH_VALUES 4096
+#define PI_LONG 3.141592653589793238462643383279502884L
+
+// References for the degree kernels: x = 90q + d reduced exactly, then d converted in extended
+// precision, so the reference keeps full relative accuracy next to the zeros
+static long double sin_degrees_quadrant(double x, int shift) {
+    long double r = fmodl(x, 360.0L);
+    long double q = nearbyintl(r / 90.0L);
+    long double d = (r - q * 90.0L) * (PI_LONG / 180.0L);
+    switch (((long)q + shift) & 3) {
+        case 0: return sinl(d);
+        case 1: return cosl(d);
+        case 2: return -sinl(d);
+        default: return -cosl(d);
+    }
+}
+static double sin_degrees_reference(double x) { return (double)sin_degrees_quadrant(x, 0); }
+static double cos_degrees_reference(double x) { return (double)sin_degrees_quadrant(x, 1); }
+static double tan_degrees_reference(double x) { return (double)(sin_degrees_quadrant(x, 0) / sin_degrees_quadrant(x, 1)); }
+
+// What apply_function used to compute in degree mode
+static double sin_degrees_libm(double x) { return sin(x * M_PI / 180.0); }
+static double cos_degrees_libm(double x) { return cos(x * M_PI / 180.0); }
+static double tan_degrees_libm(double x) { return tan(x * M_PI / 180.0); }
+
+typedef struct {
+    const char* name;
+    void (*kernel)(const double* x, double* out, int count);
+    double (*reference)(double x);  // Accurate result to measure ulps against
+    double (*libm)(double x);       // Scalar code the kernel replaces, for timing
+    double lo, hi;                  // Arguments drawn uniformly from here
+    double max_ulps;                // Largest error accepted
+} KernelCase;
+
+static const KernelCase kernel_cases[] = {
+    {"sin",      kernel_sin,         sin,                   sin,              -10.0, 10.0, 2.0},
+    {"sin",      kernel_sin,         sin,                   sin,              -1e5, 1e5, 2.0},
+    {"cos",      kernel_cos,         cos,                   cos,              -10.0, 10.0, 2.0},
+    {"tan",      kernel_tan,         tan,                   tan,              -1.5, 1.5, 4.0},
+    {"sin deg",  kernel_sin_degrees, sin_degrees_reference, sin_degrees_libm, -720.0, 720.0, 2.0},
+    {"cos deg",  kernel_cos_degrees, cos_degrees_reference, cos_degrees_libm, -720.0, 720.0, 2.0},
+    {"tan deg",  kernel_tan_degrees, tan_degrees_reference, tan_degrees_libm, -89.0, 89.0, 4.0},
+    {"exp",      kernel_exp,         exp,                   exp,              -700.0, 700.0, 2.0},
+    {"log",      kernel_log,         log,                   log,              1e-3, 1e3, 2.0},
+    {"log",      kernel_log,         log,                   log,              0.5, 2.0, 2.0},
+    {"log10",    kernel_log10,       log10,                 log10,            1e-3, 1e3, 2.0},
+};
+
+// Distance from a result to the reference in units of the reference's last place
+static double ulp_error(double value, double reference) {
+    if (value == reference || (isnan(value) && isnan(reference))) return 0.0;
+    if (!isfinite(value) || !isfinite(reference)) return INFINITY;
+    double ulp = nextafter(fabs(reference), INFINITY) - fabs(reference);
+    return fabs(value - reference) / ulp;
+}
+
+static double uniform(double lo, double hi) {
+    return lo + (hi - lo) * (double)(random_bits() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Arguments the calculator must get exactly right
+typedef struct {
+    FunctionId func;
+    AngleMode angle;
+    double x, expected;
+} ExactCase;
+
+static const ExactCase exact_cases[] = {
+    {FUNC_SIN, ANGLE_DEGREE, 180.0, 0.0},  {FUNC_SIN, ANGLE_DEGREE, -180.0, 0.0},
+    {FUNC_SIN, ANGLE_DEGREE, 360.0, 0.0},  {FUNC_SIN, ANGLE_DEGREE, 3600.0, 0.0},
+    {FUNC_SIN, ANGLE_DEGREE, 30.0, 0.5},   {FUNC_SIN, ANGLE_DEGREE, 150.0, 0.5},
+    {FUNC_SIN, ANGLE_DEGREE, 90.0, 1.0},   {FUNC_SIN, ANGLE_DEGREE, 1e20, -0.98480775301220802},
+    {FUNC_COS, ANGLE_DEGREE, 90.0, 0.0},   {FUNC_COS, ANGLE_DEGREE, 270.0, 0.0},
+    {FUNC_COS, ANGLE_DEGREE, 60.0, 0.5},   {FUNC_COS, ANGLE_DEGREE, 120.0, -0.5},
+    {FUNC_TAN, ANGLE_DEGREE, 45.0, 1.0},   {FUNC_TAN, ANGLE_DEGREE, 135.0, -1.0},
+    {FUNC_TAN, ANGLE_DEGREE, 180.0, 0.0},  {FUNC_TAN, ANGLE_DEGREE, 90.0, NAN},
+    {FUNC_SIN, ANGLE_RADIAN, 0.0, 0.0},    {FUNC_COS, ANGLE_RADIAN, 0.0, 1.0},
+    {FUNC_LN, ANGLE_DEGREE, 1.0, 0.0},     {FUNC_LN, ANGLE_DEGREE, -1.0, NAN},
+    {FUNC_LOG, ANGLE_DEGREE, 1.0, 0.0},    {FUNC_LOG, ANGLE_DEGREE, 0.0, NAN},
+    {FUNC_LN, ANGLE_DEGREE, 0.0, NAN},
+};
+
+int bench_kernels(long iterations) {
+    static double x[KERNEL_BENCH_VALUES], y[KERNEL_BENCH_VALUES], out[KERNEL_BENCH_VALUES];
+    long rounds = iterations / KERNEL_BENCH_VALUES > 0 ? iterations / KERNEL_BENCH_VALUES : 1;
+    double elements = (double)rounds * KERNEL_BENCH_VALUES;
+    double sink = 0.0;
+    int ok = 1;
+
+    printf("%-8s %-22s %9s %9s %8s %9s\n", "kernel", "arguments", "kernel ns", "libm ns", "speedup", "max ulps");
+    for (size_t k = 0; k < sizeof(kernel_cases) / sizeof(kernel_cases[0]); k++) {
+        const KernelCase* c = &kernel_cases[k];
+        for (int i = 0; i < KERNEL_BENCH_VALUES; i++) x[i] = uniform(c->lo, c->hi);
+
+        double start = now_seconds();
+        for (long r = 0; r < rounds; r++) {
+            c->kernel(x, out, KERNEL_BENCH_VALUES);
+            sink += out[r % KERNEL_BENCH_VALUES];
+        }
+        double kernel_ns = (now_seconds() - start) / elements * 1e9;
+        start = now_seconds();
+        for (long r = 0; r < rounds; r++) {
+            for (int i = 0; i < KERNEL_BENCH_VALUES; i++) out[i] = c->libm(x[i]);
+            sink += out[r % KERNEL_BENCH_VALUES];
+        }
+        double libm_ns = (now_seconds() - start) / elements * 1e9;
+
+        double worst = 0.0;
+        c->kernel(x, out, KERNEL_BENCH_VALUES);
+        for (int i = 0; i < KERNEL_BENCH_VALUES; i++) {
+            double error = ulp_error(out[i], c->reference(x[i]));
+            if (error > worst) worst = error;
+        }
+        if (worst > c->max_ulps) ok = 0;
+
+        char range[32];
+        snprintf(range, sizeof(range), "[%g, %g]", c->lo, c->hi);
+        printf("%-8s %-22s %9.2f %9.2f %7.2fx %9.2f\n", c->name, range, kernel_ns, libm_ns, libm_ns / kernel_ns, worst);
+    }
+
+    // pow: non-integer exponents take the kernel, integer ones go to libm
+    for (int i = 0; i < KERNEL_BENCH_VALUES; i++) {
+        x[i] = uniform(0.0, 100.0);
+        y[i] = uniform(-20.0, 20.0);
+    }
+    double start = now_seconds();
+    for (long r = 0; r < rounds; r++) {
+        kernel_pow(x, y, out, KERNEL_BENCH_VALUES);
+        sink += out[r % KERNEL_BENCH_VALUES];
+    }
+    double kernel_ns = (now_seconds() - start) / elements * 1e9;
+    start = now_seconds();
+    for (long r = 0; r < rounds; r++) {
+        for (int i = 0; i < KERNEL_BENCH_VALUES; i++) out[i] = pow(x[i], y[i]);
+        sink += out[r % KERNEL_BENCH_VALUES];
+    }
+    double libm_ns = (now_seconds() - start) / elements * 1e9;
+    double worst = 0.0;
+    kernel_pow(x, y, out, KERNEL_BENCH_VALUES);
+    for (int i = 0; i < KERNEL_BENCH_VALUES; i++) {
+        double error = ulp_error(out[i], pow(x[i], y[i]));
+        if (error > worst) worst = error;
+    }
+    if (worst > 2.0) ok = 0;
+    printf("%-8s %-22s %9.2f %9.2f %7.2fx %9.2f\n", "pow", "[0, 100]^[-20, 20]", kernel_ns, libm_ns, libm_ns / kernel_ns, worst);
+    if (isnan(sink)) printf("\n");  // Keeps the timed loops from being optimized away
+
+    // Exact values through apply_function, as the parser calls it
+    CalcContext context;
+    calc_context_init(&context);
+    for (size_t e = 0; e < sizeof(exact_cases) / sizeof(exact_cases[0]); e++) {
+        const ExactCase* c = &exact_cases[e];
+        context.angle = c->angle;
+        double value = apply_function(&context, c->func, c->x);
+        if (!(value == c->expected || (isnan(value) && isnan(c->expected)))) {
+            printf("Error: function %d of %g gave %.17g, expected %.17g\n", c->func, c->x, value, c->expected);
+            ok = 0;
+        }
+    }
+    for (int n = 0; n <= 22; n++) {
+        context.angle = ANGLE_DEGREE;
+        double value = apply_function(&context, FUNC_LOG, pow(10.0, n));
+        if (value != n) {
+            printf("Error: log(1E%d) gave %.17g\n", n, value);
+            ok = 0;
+        }
+    }
+
+    // Batched programs must match one-at-a-time evaluation bit for bit
+    context.angle = ANGLE_DEGREE;
+    context.variables[0] = 1.0;  // A
+    for (size_t e = 0; e < sizeof(optimizer_corpus) / sizeof(optimizer_corpus[0]) + 1; e++) {
+        const char* expression = e < sizeof(optimizer_corpus) / sizeof(optimizer_corpus[0]) ? optimizer_corpus[e] : BENCH_EXPRESSION;
+        Program program;
+        if (!compile_expression(expression, &program)) return 0;
+        optimize_program(&context, &program);
+        for (int i = 0; i < KERNEL_BENCH_VALUES; i++) x[i] = i / 10.0 - 200.0;
+        run_program_batch(&context, &program, x, out, KERNEL_BENCH_VALUES);
+        for (int i = 0; i < KERNEL_BENCH_VALUES; i++) {
+            double single = run_program(&context, &program, x[i]);
+            if (memcmp(&single, &out[i], sizeof(double)) != 0) {
+                printf("Error: batched %s at X=%g gave %.17g, one at a time %.17g\n", expression, x[i], out[i], single);
+                ok = 0;
+                break;
+            }
+        }
+    }
+
+    printf(ok ? "All kernels within tolerance, exact values exact\n" : "Error: Kernel results out of tolerance\n");
+    return ok;
+}
+
+#define FRACTION_BENCH_VALUES 4096
+
+// ►Frac results: den 0 means no fraction, so the result shows as a decimal
+typedef struct {
+    const char* expression;
+    int64_t num, den;
+} FractionCase;
+
+static const FractionCase fraction_cases[] = {
+    {"1/3+1/6", 1, 2},
+    {"0.1+0.2", 3, 10},
+    {"2/3*3/4-1/2", 0, 1},
+    {"(1/3)^20", 1, 3486784401},
+    {"2^~3+1/8", 1, 4},
+    {"(2/3)/(4/9)", 3, 2},
+    {"1E18*9", 9000000000000000000, 1},
+    {"sin(30)", 1, 2},               // Inexact: the double .5, converted back
+    {"1/3+sin(0)", 1, 3},
+    {"1E18*10", 0, 0},               // Overflows 64 bits; 1E19 has no fraction
+    {"1/3^40", 0, 0},                // Too small for a denominator up to 9999
+    {"ln(2)", 0, 0},
+    {"1/0", 0, 0},
+};
+
+// A random fraction a/b in lowest terms with |a| < 2^bits and 0 < b < 2^bits
+static Rational random_fraction(int bits) {
+    uint64_t mask = (1ull << bits) - 1;
+    int64_t num = (int64_t)(random_bits() & mask) - (int64_t)(mask / 2);
+    int64_t den = (int64_t)(random_bits() & mask) + 1;
+    int64_t g = (int64_t)rational_gcd(num < 0 ? -num : num, den);
+    Rational value = { num / g, den / g };
+    return value;
+}
+
+// r is exactly p/q
+static int is_fraction(Rational r, __int128 p, __int128 q) {
+    return r.den > 0 && (__int128)r.num * q == p * r.den;
+}
+
+int bench_fractions(long iterations) {
+    static Rational a[FRACTION_BENCH_VALUES], b[FRACTION_BENCH_VALUES], c[FRACTION_BENCH_VALUES];
+    static double x[FRACTION_BENCH_VALUES], y[FRACTION_BENCH_VALUES], z[FRACTION_BENCH_VALUES];
+    CalcContext context;
+    calc_context_init(&context);
+    int ok = 1;
+
+    // ►Frac of whole expressions
+    for (size_t i = 0; i < sizeof(fraction_cases) / sizeof(fraction_cases[0]); i++) {
+        const FractionCase* f = &fraction_cases[i];
+        double value;
+        Rational fraction;
+        int found = evaluate_fraction(&context, f->expression, &value, &fraction);
+        if (f->den == 0 ? found : !found || fraction.num != f->num || fraction.den != f->den) {
+            printf("Error: %s%s gave %lld/%lld\n", f->expression, FRAC_SUFFIX,
+                   found ? (long long)fraction.num : 0, found ? (long long)fraction.den : 0);
+            ok = 0;
+        }
+    }
+
+    // Ans►Frac after an inexact result: the variable reads as the small fraction near it
+    static const FractionCase ans_cases[] = { {"Ans", 3, 10}, {"Ans*3", 9, 10}, {"Ans+1/3", 19, 30} };
+    Program sum;
+    compile_expression("0.1+0.2", &sum);
+    for (size_t i = 0; i < sizeof(ans_cases) / sizeof(ans_cases[0]); i++) {
+        double value;
+        Rational fraction;
+        context.variables[CALC_ANS] = run_program(&context, &sum, 0.0);
+        int found = evaluate_fraction(&context, ans_cases[i].expression, &value, &fraction);
+        if (!found || fraction.num != ans_cases[i].num || fraction.den != ans_cases[i].den) {
+            printf("Error: %s%s after 0.1+0.2 gave %lld/%lld\n", ans_cases[i].expression, FRAC_SUFFIX,
+                   found ? (long long)fraction.num : 0, found ? (long long)fraction.den : 0);
+            ok = 0;
+        }
+    }
+
+    // ON while sin(30) is evaluated in doubles: Ans keeps its value
+    double cancelled;
+    Rational unused;
+    context.variables[CALC_ANS] = 7.0;
+    context.cancel_check = cancel_after_polls;
+    cancel_polls = 0;
+    cancel_poll_limit = 1;
+    int cancelled_found = evaluate_fraction(&context, "sin(30)+1/3", &cancelled, &unused);
+    context.cancel_check = NULL;
+    if (cancelled_found || !isnan(cancelled) || context.variables[CALC_ANS] != 7.0) {
+        printf("Error: Cancelled sin(30)+1/3%s gave %g, Ans %g\n", FRAC_SUFFIX, cancelled, context.variables[CALC_ANS]);
+        ok = 0;
+    }
+
+    // Random operands against 128-bit cross multiplication; an operation may only refuse when the
+    // exact result does not fit
+    long checked = 0, refused = 0;
+    for (long i = 0; i < 200000; i++) {
+        Rational p = random_fraction(i % 2 ? 31 : 62), q = random_fraction(i % 3 ? 31 : 20), r;
+        __int128 sum_num = (__int128)p.num * q.den + (__int128)q.num * p.den, sum_den = (__int128)p.den * q.den;
+        __int128 product_num = (__int128)p.num * q.num, product_den = (__int128)p.den * q.den;
+        if (rational_add(p, q, &r)) {
+            if (!is_fraction(r, sum_num, sum_den)) ok = 0;
+            checked++;
+        } else {
+            refused++;
+        }
+        if (rational_multiply(p, q, &r)) {
+            if (!is_fraction(r, product_num, product_den)) ok = 0;
+            checked++;
+        } else if (p.den == 1 && q.den == 1 && product_num > INT64_MIN && product_num <= INT64_MAX) {
+            ok = 0;  // Refused an integer product that fits
+        } else {
+            refused++;
+        }
+        if (!ok) {
+            printf("Error: Wrong result for %lld/%lld and %lld/%lld\n", (long long)p.num, (long long)p.den,
+                   (long long)q.num, (long long)q.den);
+            break;
+        }
+    }
+
+    // Continued fractions find small fractions back from their doubles, and exact conversions round trip
+    for (long i = 0; i < 100000 && ok; i++) {
+        Rational p = random_fraction(14), r;
+        if (p.den > FRAC_MAX_DENOMINATOR) continue;
+        if (!rational_from_double(rational_to_double(p), FRAC_MAX_DENOMINATOR, FRAC_TOLERANCE, &r) ||
+            r.num != p.num || r.den != p.den) {
+            printf("Error: %lld/%lld not found from its double\n", (long long)p.num, (long long)p.den);
+            ok = 0;
+        }
+        double d = uniform(-1e6, 1e6);
+        if (rational_from_double(d, INT64_MAX, 0, &r) && rational_to_double(r) != d) {
+            printf("Error: %.17g converted to %lld/%lld\n", d, (long long)r.num, (long long)r.den);
+            ok = 0;
+        }
+    }
+
+    // Time rational against double arithmetic on the fractions people type
+    for (int i = 0; i < FRACTION_BENCH_VALUES; i++) {
+        a[i] = random_fraction(10);
+        b[i] = random_fraction(10);
+        x[i] = rational_to_double(a[i]);
+        y[i] = rational_to_double(b[i]);
+    }
+    long rounds = iterations / FRACTION_BENCH_VALUES > 0 ? iterations / FRACTION_BENCH_VALUES : 1;
+    double operations = (double)rounds * FRACTION_BENCH_VALUES;
+    const char ops[] = "+*/";
+    int64_t rational_sink = 0;
+    double double_sink = 0.0;
+    printf("%-9s %12s %12s\n", "operation", "rational ns", "double ns");
+    for (int o = 0; o < 3; o++) {
+        double start = now_seconds();
+        for (long round = 0; round < rounds; round++) {
+            for (int i = 0; i < FRACTION_BENCH_VALUES; i++) {
+                switch (ops[o]) {
+                    case '+': rational_add(a[i], b[i], &c[i]); break;
+                    case '*': rational_multiply(a[i], b[i], &c[i]); break;
+                    default:  if (!rational_divide(a[i], b[i], &c[i])) c[i] = a[i]; break;
+                }
+            }
+            rational_sink += c[round % FRACTION_BENCH_VALUES].num;
+        }
+        double rational_ns = (now_seconds() - start) / operations * 1e9;
+        start = now_seconds();
+        for (long round = 0; round < rounds; round++) {
+            for (int i = 0; i < FRACTION_BENCH_VALUES; i++) z[i] = apply_operation(x[i], y[i], ops[o]);
+            double_sink += z[round % FRACTION_BENCH_VALUES];
+        }
+        double double_ns = (now_seconds() - start) / operations * 1e9;
+        printf("%-9c %12.2f %12.2f\n", ops[o], rational_ns, double_ns);
+    }
+
+    // Whole expressions, exactly and in doubles
+    Program program;
+    if (!compile_expression("1/3+X*(2/7-X/5)", &program)) return 0;
+    Rational exact_x = { 3, 4 }, result;
+    long evaluations = iterations / 10;
+    double start = now_seconds();
+    for (long i = 0; i < evaluations; i++) {
+        exact_x.num = i % 1000;
+        run_program_rational(&context, &program, exact_x, &result);
+        rational_sink += result.num;
+    }
+    double exact_ns = (now_seconds() - start) / evaluations * 1e9;
+    start = now_seconds();
+    for (long i = 0; i < evaluations; i++) {
+        double_sink += run_program(&context, &program, (i % 1000) / 4.0);
+    }
+    double float_ns = (now_seconds() - start) / evaluations * 1e9;
+    printf("%-9s %12.2f %12.2f\n", "program", exact_ns, float_ns);
+    if (rational_sink == 1 && isnan(double_sink)) printf("\n");  // Keeps the timed loops from being optimized away
+
+    printf("%ld random results exact, %ld refused as too large for 64 bits\n", checked, refused);
+    printf(ok ? "All fractions correct\n" : "Error: Wrong fraction results\n");
+    return ok;
+}
+
+#define COMPLEX_BENCH_VALUES 4096
+
+// Radian-mode wrappers, so every unary kernel has the same signature
+static void complex_sin_radians(const double* x_re, const double* x_im, double* re, double* im, int count) {
+    complex_kernel_sin(ANGLE_RADIAN, x_re, x_im, re, im, count);
+}
+static void complex_cos_radians(const double* x_re, const double* x_im, double* re, double* im, int count) {
+    complex_kernel_cos(ANGLE_RADIAN, x_re, x_im, re, im, count);
+}
+static void complex_tan_radians(const double* x_re, const double* x_im, double* re, double* im, int count) {
+    complex_kernel_tan(ANGLE_RADIAN, x_re, x_im, re, im, count);
+}
+static void complex_sin_degrees(const double* x_re, const double* x_im, double* re, double* im, int count) {
+    complex_kernel_sin(ANGLE_DEGREE, x_re, x_im, re, im, count);
+}
+
+static long double complex csin_degrees_reference(long double complex z) {
+    return csinl(z * (PI_LONG / 180.0L));
+}
+static double complex csin_degrees_libm(double complex z) { return csin(z * (M_PI / 180.0)); }
+
+typedef struct {
+    const char* name;
+    void (*kernel)(const double* x_re, const double* x_im, double* re, double* im, int count);
+    long double complex (*reference)(long double complex z);  // Accurate result to measure the error against
+    double complex (*libm)(double complex z);                  // <complex.h> function, for timing
+    double re_lo, re_hi, im_lo, im_hi;                         // Arguments drawn uniformly from here
+    double max_error;                                          // Largest error accepted, in units of DBL_EPSILON
+} ComplexCase;
+
+static const ComplexCase complex_cases[] = {
+    {"sqrt",    complex_kernel_sqrt, csqrtl,                  csqrt,             -1e3, 1e3, -1e3, 1e3, 2.0},
+    {"exp",     complex_kernel_exp,  cexpl,                   cexp,              -20.0, 20.0, -10.0, 10.0, 4.0},
+    {"ln",      complex_kernel_log,  clogl,                   clog,              -1e3, 1e3, -1e3, 1e3, 2.0},
+    {"ln",      complex_kernel_log,  clogl,                   clog,              -2.0, 2.0, -2.0, 2.0, 2.0},
+    {"sin",     complex_sin_radians, csinl,                   csin,              -10.0, 10.0, -5.0, 5.0, 4.0},
+    {"cos",     complex_cos_radians, ccosl,                   ccos,              -10.0, 10.0, -5.0, 5.0, 4.0},
+    {"tan",     complex_tan_radians, ctanl,                   ctan,              -1.5, 1.5, -2.0, 2.0, 8.0},
+    {"sin deg", complex_sin_degrees, csin_degrees_reference,  csin_degrees_libm, -720.0, 720.0, -90.0, 90.0, 4.0},
+};
+
+// Distance from a complex result to the reference relative to the reference's magnitude, in units of
+// DBL_EPSILON. One part may be far below the other, so this is not an ulp count for each part.
+static double complex_error(double re, double im, long double complex reference) {
+    long double complex difference = CMPLXL(re, im) - reference;
+    if (!isfinite(re) || !isfinite(im)) return isfinite(creall(reference)) ? INFINITY : 0.0;
+    return (double)(cabsl(difference) / cabsl(reference) / DBL_EPSILON);
+}
+
+// Expressions with known results in a+bi mode, evaluated one after the other so Ans carries over
+typedef struct {
+    const char* expression;
+    double re, im;
+} ComplexExactCase;
+
+static const ComplexExactCase complex_exact_cases[] = {
+    {"sqrt(~4)", 0.0, 2.0},
+    {"sqrt(~1)", 0.0, 1.0},
+    {"sqrt(3+4i)", 2.0, 1.0},
+    {"i^2", -1.0, 0.0},
+    {"i*i", -1.0, 0.0},
+    {"i^~1", 0.0, -1.0},
+    {"(1+i)^2", 0.0, 2.0},
+    {"Ans*i", -2.0, 0.0},
+    {"(3+4i)/(1-2i)", -1.0, 2.0},
+    {"ln(~1)", 0.0, M_PI},
+    {"sin(30)", 0.5, 0.0},
+    {"2+3", 5.0, 0.0},
+    {"1/0", NAN, NAN},
+    {"ln(0)", NAN, NAN},
+    {"log(0)", NAN, NAN},
+};
+
+int bench_complex(long iterations) {
+    static double x_re[COMPLEX_BENCH_VALUES], x_im[COMPLEX_BENCH_VALUES], y_re[COMPLEX_BENCH_VALUES], y_im[COMPLEX_BENCH_VALUES];
+    static double re[COMPLEX_BENCH_VALUES], im[COMPLEX_BENCH_VALUES];
+    static double complex z[COMPLEX_BENCH_VALUES], w[COMPLEX_BENCH_VALUES];
+    long rounds = iterations / COMPLEX_BENCH_VALUES > 0 ? iterations / COMPLEX_BENCH_VALUES : 1;
+    double elements = (double)rounds * COMPLEX_BENCH_VALUES;
+    double sink = 0.0;
+    int ok = 1;
+
+    printf("%-8s %-30s %9s %9s %8s %9s\n", "kernel", "arguments", "kernel ns", "libm ns", "speedup", "max eps");
+    for (size_t k = 0; k < sizeof(complex_cases) / sizeof(complex_cases[0]) + 3; k++) {
+        // The unary cases of the table, then the binary operators
+        const ComplexCase* c = k < sizeof(complex_cases) / sizeof(complex_cases[0]) ? &complex_cases[k] : NULL;
+        int op = c ? 0 : "*/^"[k - sizeof(complex_cases) / sizeof(complex_cases[0])];
+        double lo = c ? c->re_lo : op == '^' ? -10.0 : -1e3, hi = c ? c->re_hi : -lo;
+        double im_lo = c ? c->im_lo : lo, im_hi = c ? c->im_hi : hi;
+        for (int i = 0; i < COMPLEX_BENCH_VALUES; i++) {
+            x_re[i] = uniform(lo, hi);
+            x_im[i] = uniform(im_lo, im_hi);
+            y_re[i] = op == '^' ? uniform(-3.0, 3.0) : uniform(lo, hi);
+            y_im[i] = op == '^' ? uniform(-3.0, 3.0) : uniform(im_lo, im_hi);
+            z[i] = CMPLX(x_re[i], x_im[i]);
+            w[i] = CMPLX(y_re[i], y_im[i]);
+        }
+
+        double start = now_seconds();
+        for (long r = 0; r < rounds; r++) {
+            switch (op) {
+                case 0:   c->kernel(x_re, x_im, re, im, COMPLEX_BENCH_VALUES); break;
+                case '*': complex_kernel_multiply(x_re, x_im, y_re, y_im, re, im, COMPLEX_BENCH_VALUES); break;
+                case '/': complex_kernel_divide(x_re, x_im, y_re, y_im, re, im, COMPLEX_BENCH_VALUES); break;
+                default:  complex_kernel_power(x_re, x_im, y_re, y_im, re, im, COMPLEX_BENCH_VALUES); break;
+            }
+            sink += re[r % COMPLEX_BENCH_VALUES];
+        }
+        double kernel_ns = (now_seconds() - start) / elements * 1e9;
+        start = now_seconds();
+        for (long r = 0; r < rounds; r++) {
+            for (int i = 0; i < COMPLEX_BENCH_VALUES; i++) {
+                double complex result;
+                switch (op) {
+                    case 0:   result = c->libm(z[i]); break;
+                    case '*': result = z[i] * w[i]; break;
+                    case '/': result = z[i] / w[i]; break;
+                    default:  result = cpow(z[i], w[i]); break;
+                }
+                re[i] = creal(result);
+                im[i] = cimag(result);
+            }
+            sink += re[r % COMPLEX_BENCH_VALUES];
+        }
+        double libm_ns = (now_seconds() - start) / elements * 1e9;
+
+        switch (op) {
+            case 0:   c->kernel(x_re, x_im, re, im, COMPLEX_BENCH_VALUES); break;
+            case '*': complex_kernel_multiply(x_re, x_im, y_re, y_im, re, im, COMPLEX_BENCH_VALUES); break;
+            case '/': complex_kernel_divide(x_re, x_im, y_re, y_im, re, im, COMPLEX_BENCH_VALUES); break;
+            default:  complex_kernel_power(x_re, x_im, y_re, y_im, re, im, COMPLEX_BENCH_VALUES); break;
+        }
+        double worst = 0.0;
+        for (int i = 0; i < COMPLEX_BENCH_VALUES; i++) {
+            long double complex a = CMPLXL(x_re[i], x_im[i]), b = CMPLXL(y_re[i], y_im[i]), reference;
+            switch (op) {
+                case 0:   reference = c->reference(a); break;
+                case '*': reference = a * b; break;
+                case '/': reference = a / b; break;
+                default:  reference = cpowl(a, b); break;
+            }
+            double error = complex_error(re[i], im[i], reference);
+            if (error > worst) worst = error;
+        }
+        // a^b is exp(b ln a): the rounding of b ln a is magnified by its size, up to about 20 here
+        double max_error = c ? c->max_error : op == '^' ? 64.0 : 4.0;
+        if (worst > max_error) ok = 0;
+
+        char name[16], range[64];
+        snprintf(name, sizeof(name), "%c", op);
+        if (op == '^') {
+            snprintf(range, sizeof(range), "[%g, %g]^[-3, 3]", lo, hi);
+        } else {
+            snprintf(range, sizeof(range), "[%g, %g]+[%g, %g]i", lo, hi, im_lo, im_hi);
+        }
+        printf("%-8s %-30s %9.2f %9.2f %7.2fx %9.2f\n", c ? c->name : name, range, kernel_ns, libm_ns,
+               libm_ns / kernel_ns, worst);
+    }
+    if (isnan(sink)) printf("\n");  // Keeps the timed loops from being optimized away
+
+    // Whole expressions through the home screen path
+    CalcContext context;
+    calc_context_init(&context);
+    context.complex_mode = COMPLEX_RECTANGULAR;
+    for (size_t e = 0; e < sizeof(complex_exact_cases) / sizeof(complex_exact_cases[0]); e++) {
+        const ComplexExactCase* c = &complex_exact_cases[e];
+        double imaginary;
+        double value = evaluate_complex_expression(&context, c->expression, &imaginary);
+        if (!(value == c->re || (isnan(value) && isnan(c->re))) || !(imaginary == c->im || (isnan(imaginary) && isnan(c->im)))) {
+            printf("Error: %s gave %.17g%+.17gi, expected %.17g%+.17gi\n", c->expression, value, imaginary, c->re, c->im);
+            ok = 0;
+        }
+    }
+
+    // ON during the real pass of sqrt(~4): the complex pass does not run and Ans keeps its value
+    context.variables[CALC_ANS] = 7.0;
+    context.imaginary[CALC_ANS] = 0.0;
+    context.cancel_check = cancel_after_polls;
+    cancel_polls = 0;
+    cancel_poll_limit = 1;
+    double cancelled_im, cancelled = evaluate_complex_expression(&context, "sqrt(~4)", &cancelled_im);
+    context.cancel_check = NULL;
+    if (!isnan(cancelled) || context.variables[CALC_ANS] != 7.0 || context.imaginary[CALC_ANS] != 0.0) {
+        printf("Error: Cancelled sqrt(~4) gave %g%+gi, Ans %g%+gi\n", cancelled, cancelled_im,
+               context.variables[CALC_ANS], context.imaginary[CALC_ANS]);
+        ok = 0;
+    }
+
+    // An error leaves Ans as it was in every home screen evaluator, so Ans+1 still works after it
+    static const char* errors[] = { "1/0", "2+*3" };
+    for (size_t e = 0; e < sizeof(errors) / sizeof(errors[0]); e++) {
+        double imaginary, value;
+        Rational fraction;
+        for (int evaluator = 0; evaluator < 3; evaluator++) {
+            context.variables[CALC_ANS] = 7.0;
+            context.imaginary[CALC_ANS] = 0.0;
+            if (evaluator == 0) evaluate_expression(&context, errors[e]);
+            if (evaluator == 1) evaluate_complex_expression(&context, errors[e], &imaginary);
+            if (evaluator == 2) evaluate_fraction(&context, errors[e], &value, &fraction);
+            if (context.variables[CALC_ANS] != 7.0 || context.imaginary[CALC_ANS] != 0.0) {
+                printf("Error: %s changed Ans to %g%+gi\n", errors[e], context.variables[CALC_ANS], context.imaginary[CALC_ANS]);
+                ok = 0;
+            }
+        }
+    }
+
+    // Real programs give the same results in complex arithmetic wherever they are defined
+    context.variables[0] = 1.0;  // A
+    context.imaginary[CALC_ANS] = 0.0;
+    for (size_t e = 0; e < sizeof(optimizer_corpus) / sizeof(optimizer_corpus[0]) + 1; e++) {
+        const char* expression = e < sizeof(optimizer_corpus) / sizeof(optimizer_corpus[0]) ? optimizer_corpus[e] : BENCH_EXPRESSION;
+        Program program;
+        if (!compile_expression(expression, &program)) return 0;
+        for (int i = 0; i < COMPLEX_BENCH_VALUES; i++) x_re[i] = i / 10.0 - 200.0;
+        run_program_complex(&context, &program, x_re, re, im, COMPLEX_BENCH_VALUES);
+        for (int i = 0; i < COMPLEX_BENCH_VALUES; i++) {
+            double single = run_program(&context, &program, x_re[i]);
+            if (isfinite(single) && (relative_error(re[i], single) > 1e-9 || fabs(im[i]) > 1e-9 * fmax(fabs(single), 1.0))) {
+                printf("Error: complex %s at X=%g gave %.17g%+.17gi, real %.17g\n", expression, x_re[i], re[i], im[i], single);
+                ok = 0;
+                break;
+            }
+        }
+    }
+
+    // The real fast path against complex evaluation of the same real program
+    Program program;
+    if (!compile_expression(BENCH_EXPRESSION, &program)) return 0;
+    for (int i = 0; i < COMPLEX_BENCH_VALUES; i++) x_re[i] = uniform(0.0, 100.0);
+    long batches = rounds > 1 ? rounds / 4 : 1;
+    double start = now_seconds();
+    for (long r = 0; r < batches; r++) {
+        run_program_batch(&context, &program, x_re, re, COMPLEX_BENCH_VALUES);
+        sink += re[r % COMPLEX_BENCH_VALUES];
+    }
+    double real_ns = (now_seconds() - start) / ((double)batches * COMPLEX_BENCH_VALUES) * 1e9;
+    start = now_seconds();
+    for (long r = 0; r < batches; r++) {
+        run_program_complex(&context, &program, x_re, re, im, COMPLEX_BENCH_VALUES);
+        sink += re[r % COMPLEX_BENCH_VALUES];
+    }
+    double complex_ns = (now_seconds() - start) / ((double)batches * COMPLEX_BENCH_VALUES) * 1e9;
+    printf("Program per value: %.2f ns real, %.2f ns complex\n", real_ns, complex_ns);
+    if (isnan(sink)) printf("\n");
+
+    printf(ok ? "All complex kernels within tolerance, exact values exact\n" : "Error: Complex results out of tolerance\n");
+    return ok;
+}
+
+#define REGRESSION_CHECK_POINTS 100000
+
+// Solve the square system a c = b by Gaussian elimination with partial pivoting
+static void solve_long_double(long double a[][REGRESSION_MAX_TERMS], long double* b, long double* c, int terms) {
+    for (int j = 0; j < terms; j++) {
+        int pivot = j;
+        for (int i = j + 1; i < terms; i++) {
+            if (fabsl(a[i][j]) > fabsl(a[pivot][j])) pivot = i;
+        }
+        for (int l = 0; l < terms; l++) {
+            long double swap = a[j][l];
+            a[j][l] = a[pivot][l];
+            a[pivot][l] = swap;
+        }
+        long double swap = b[j];
+        b[j] = b[pivot];
+        b[pivot] = swap;
+        for (int i = j + 1; i < terms; i++) {
+            long double f = a[i][j] / a[j][j];
+            for (int l = j; l < terms; l++) a[i][l] -= f * a[j][l];
+            b[i] -= f * b[j];
+        }
+    }
+    for (int j = terms - 1; j >= 0; j--) {
+        long double sum = b[j];
+        for (int l = j + 1; l < terms; l++) sum -= a[j][l] * c[l];
+        c[j] = sum / a[j][j];
+    }
+}
+
+// Reference fit: the normal equations in long double, on x centered at its mean and scaled to about
+// [-1, 1] so they stay well conditioned, then expanded back. Returns r^2 / R^2.
+static double reference_fit(RegressionModel model, const double* x, const double* y, long count, double* coefficients) {
+    int terms = model == REGRESSION_QUADRATIC ? 3 : model == REGRESSION_CUBIC ? 4 : 2;
+    int logs = model == REGRESSION_EXPONENTIAL || model == REGRESSION_POWER;
+    long double center = 0.0L, scale = 0.0L, mean_y = 0.0L;
+    for (long i = 0; i < count; i++) {
+        center += model == REGRESSION_POWER ? logl(x[i]) : x[i];
+        mean_y += logs ? logl(y[i]) : y[i];
+    }
+    center /= count;
+    mean_y /= count;
+    for (long i = 0; i < count; i++) {
+        long double t = (model == REGRESSION_POWER ? logl(x[i]) : x[i]) - center;
+        if (fabsl(t) > scale) scale = fabsl(t);
+    }
+
+    long double a[REGRESSION_MAX_TERMS][REGRESSION_MAX_TERMS] = {{0}}, b[REGRESSION_MAX_TERMS] = {0}, c[REGRESSION_MAX_TERMS];
+    for (long i = 0; i < count; i++) {
+        long double t = ((model == REGRESSION_POWER ? logl(x[i]) : x[i]) - center) / scale;
+        long double v = logs ? logl(y[i]) : y[i], p[REGRESSION_MAX_TERMS] = { 1.0L, t, t * t, t * t * t };
+        for (int j = 0; j < terms; j++) {
+            for (int l = 0; l < terms; l++) a[j][l] += p[j] * p[l];
+            b[j] += p[j] * v;
+        }
+    }
+    solve_long_double(a, b, c, terms);
+
+    long double residual = 0.0L, spread = 0.0L;
+    for (long i = 0; i < count; i++) {
+        long double t = ((model == REGRESSION_POWER ? logl(x[i]) : x[i]) - center) / scale;
+        long double v = logs ? logl(y[i]) : y[i], fitted = 0.0L;
+        for (int j = terms - 1; j >= 0; j--) fitted = fitted * t + c[j];
+        residual += (v - fitted) * (v - fitted);
+        spread += (v - mean_y) * (v - mean_y);
+    }
+
+    // c_j (u - center)^j / scale^j expanded into powers of u = x (ln x for PwrReg), highest first
+    for (int k = 0; k < terms; k++) {
+        long double sum = 0.0L, binomial = 1.0L, power = 1.0L;
+        for (int j = k; j < terms; j++) {
+            sum += c[j] / powl(scale, j) * binomial * power;
+            binomial = binomial * (j + 1) / (j + 1 - k);
+            power *= -center;
+        }
+        coefficients[terms - 1 - k] = (double)sum;
+    }
+    if (model == REGRESSION_EXPONENTIAL) {
+        long double intercept = coefficients[1];
+        coefficients[1] = (double)expl(coefficients[0]);
+        coefficients[0] = (double)expl(intercept);
+    } else if (model == REGRESSION_POWER) {
+        long double intercept = coefficients[1];
+        coefficients[1] = coefficients[0];
+        coefficients[0] = (double)expl(intercept);
+    }
+    return (double)(1.0L - residual / spread);
+}
+
+// The textbook shortcut the QR fit replaces: raw moment sums of x in doubles, solved in place
+static void normal_equations_fit(const double* x, const double* y, long count, int terms, double* coefficients) {
+    long double a[REGRESSION_MAX_TERMS][REGRESSION_MAX_TERMS], b[REGRESSION_MAX_TERMS], c[REGRESSION_MAX_TERMS];
+    double sums[2 * REGRESSION_MAX_TERMS] = {0}, moments[REGRESSION_MAX_TERMS] = {0};
+    for (long i = 0; i < count; i++) {
+        double p = 1.0;
+        for (int k = 0; k < 2 * terms - 1; k++) {
+            sums[k] += p;
+            if (k < terms) moments[k] += p * y[i];
+            p *= x[i];
+        }
+    }
+    for (int j = 0; j < terms; j++) {
+        for (int l = 0; l < terms; l++) a[j][l] = sums[j + l];
+        b[j] = moments[j];
+    }
+    solve_long_double(a, b, c, terms);
+    for (int k = 0; k < terms; k++) coefficients[terms - 1 - k] = (double)c[k];
+}
+
+// Largest relative difference between two sets of coefficients
+static double coefficient_error(const double* a, const double* b, int terms) {
+    double worst = 0.0;
+    for (int k = 0; k < terms; k++) {
+        double error = fabs(a[k] - b[k]) / fabs(b[k]);
+        if (!(error <= worst)) worst = error;
+    }
+    return worst;
+}
+
+int bench_regression(long points) {
+    double* x = malloc(points * sizeof(double));
+    double* y = malloc(points * sizeof(double));
+    if (x == NULL || y == NULL) {
+        free(x);
+        free(y);
+        printf("Error: Out of memory\n");
+        return 0;
+    }
+    RegressionFit fit;
+    double expected[REGRESSION_MAX_TERMS];
+    int ok = 1;
+
+    // Noisy data in each model's shape, against the long double reference
+    static const char* shapes[] = { "3.5X-20", "X^2/50-X+8", "X^3/1000-X^2/20+X/2+3", "2.5*1.04^X", "3*X^~.7" };
+    printf("%-9s %12s %12s\n", "model", "coef error", "r^2 error");
+    for (int m = REGRESSION_LINEAR; m <= REGRESSION_POWER; m++) {
+        Program program;
+        CalcContext context;
+        calc_context_init(&context);
+        if (!compile_expression(shapes[m], &program)) return 0;
+        for (long i = 0; i < REGRESSION_CHECK_POINTS; i++) {
+            x[i] = uniform(1.0, 60.0);
+            y[i] = run_program(&context, &program, x[i]) * (1.0 + uniform(-0.05, 0.05));
+        }
+        if (!regression_fit((RegressionModel)m, x, y, REGRESSION_CHECK_POINTS, &fit)) return 0;
+        double r2 = reference_fit((RegressionModel)m, x, y, REGRESSION_CHECK_POINTS, expected);
+        double error = coefficient_error(fit.coefficients, expected, fit.terms);
+        printf("%-9s %12.3g %12.3g\n", regression_name((RegressionModel)m), error, fabs(fit.r2 - r2));
+        if (!(error < 1e-9) || !(fabs(fit.r2 - r2) < 1e-12)) ok = 0;
+
+        // The stored equation computes the same curve
+        char equation[GRAPH_EXPRESSION_LENGTH];
+        if (!regression_equation(&fit, equation, sizeof(equation)) || !compile_expression(equation, &program)) {
+            printf("Error: %s equation %s does not compile\n", regression_name((RegressionModel)m), equation);
+            ok = 0;
+            continue;
+        }
+        for (double at = 1.0; at < 60.0; at += 7.3) {
+            double value = run_program(&context, &program, at);
+            if (relative_error(value, regression_evaluate(&fit, at)) > 1e-12) {
+                printf("Error: %s at X=%g gave %.17g\n", equation, at, value);
+                ok = 0;
+            }
+        }
+    }
+
+    // Exact cubic data over years: QR recovers it, while raw moment sums in doubles lose every digit
+    long years = 1000;
+    double truth[REGRESSION_MAX_TERMS], naive[REGRESSION_MAX_TERMS];
+    for (long i = 0; i < years; i++) {
+        long double t = (long double)i / 25.0L;
+        x[i] = 1990.0 + (double)t;
+        y[i] = (double)(2.0L - 0.5L * t + 0.03L * t * t - 0.001L * t * t * t);
+    }
+    // The same cubic in powers of x, from a = -0.001, b = 0.03 + 0.003*1990, ...
+    long double s = 1990.0L;
+    truth[0] = (double)-0.001L;
+    truth[1] = (double)(0.03L + 3.0L * 0.001L * s);
+    truth[2] = (double)(-0.5L - 2.0L * 0.03L * s - 3.0L * 0.001L * s * s);
+    truth[3] = (double)(2.0L + 0.5L * s + 0.03L * s * s + 0.001L * s * s * s);
+    if (!regression_fit(REGRESSION_CUBIC, x, y, years, &fit)) return 0;
+    normal_equations_fit(x, y, years, 4, naive);
+    double qr_error = coefficient_error(fit.coefficients, truth, 4);
+    double naive_error = coefficient_error(naive, truth, 4);
+    printf("CubicReg over 1990..2030: QR coefficient error %.3g, normal equations %.3g\n", qr_error, naive_error);
+    if (!(qr_error < 1e-6)) ok = 0;
+
+    // Data the TI-84 refuses
+    double constant_x[3] = { 2.0, 2.0, 2.0 }, some_y[3] = { 1.0, -2.0, 3.0 };
+    if (regression_fit(REGRESSION_LINEAR, constant_x, some_y, 3, &fit) ||
+        regression_fit(REGRESSION_EXPONENTIAL, some_y, some_y, 3, &fit) ||
+        regression_fit(REGRESSION_POWER, some_y, constant_x, 3, &fit) ||
+        regression_fit(REGRESSION_CUBIC, some_y, some_y, 3, &fit)) {
+        printf("Error: A singular, out of domain or too small data set was fitted\n");
+        ok = 0;
+    }
+
+    // Time every model on all the points
+    for (long i = 0; i < points; i++) {
+        x[i] = 1.0 + 99.0 * (double)i / (double)points;
+        y[i] = 2.5 * pow(x[i], 1.3) * (1.0 + uniform(-0.01, 0.01));
+    }
+    printf("%-9s %10s %12s\n", "model", "ms", "ns/point");
+    for (int m = REGRESSION_LINEAR; m <= REGRESSION_POWER; m++) {
+        double start = now_seconds();
+        if (!regression_fit((RegressionModel)m, x, y, points, &fit)) ok = 0;
+        double elapsed = now_seconds() - start;
+        printf("%-9s %10.1f %12.2f\n", regression_name((RegressionModel)m), elapsed * 1e3, elapsed / points * 1e9);
+    }
+
+    free(x);
+    free(y);
+    printf(ok ? "All regressions match the reference\n" : "Error: Regression results out of tolerance\n");
+    return ok;
+}
+
+#define EDITOR_CHECK_EDITS 200000  // Random edits checked against the plain string model
+#define EDITOR_KEYSTROKES 1000000  // Keystrokes timed at each line length
+
+// The plain model: the line as a string, edited by shifting its tail
+typedef struct {
+    char* text;
+    size_t length;
+    size_t cursor;
+    int overwrite;
+} PlainLine;
+
+static void plain_insert(PlainLine* line, char c) {
+    if (line->overwrite && line->cursor < line->length) {
+        line->text[line->cursor++] = c;
+        return;
+    }
+    memmove(line->text + line->cursor + 1, line->text + line->cursor, line->length - line->cursor);
+    line->text[line->cursor++] = c;
+    line->length++;
+}
+
+static void plain_delete(PlainLine* line, size_t at) {
+    memmove(line->text + at, line->text + at + 1, line->length - at - 1);
+    line->length--;
+}
+
+static int editor_matches(LineEditor* editor, const PlainLine* line, const int* advances) {
+    if (line_editor_length(editor) != line->length || line_editor_cursor(editor) != line->cursor) return 0;
+    long cursor_x = 0, width = 0;
+    for (size_t i = 0; i < line->length; i++) {
+        if (line_editor_char_at(editor, i) != line->text[i]) return 0;
+        if (i < line->cursor) cursor_x += advances[(unsigned char)line->text[i]];
+        width += advances[(unsigned char)line->text[i]];
+    }
+    return editor->cursor_x == cursor_x && editor->width == width;
+}
+
+int bench_editor(long max_length) {
+    static int advances[LINE_EDITOR_GLYPHS];
+    for (int c = 0; c < LINE_EDITOR_GLYPHS; c++) advances[c] = 5 + c % 7;
+    static const char keys[] = "0123456789+-*/^().XsincotalgqrE";
+    LineEditor editor;
+    PlainLine line = { malloc(EDITOR_CHECK_EDITS + 1), 0, 0, 1 };
+    if (line.text == NULL || !line_editor_init(&editor, advances)) {
+        free(line.text);
+        printf("Error: Out of memory\n");
+        return 0;
+    }
+    int ok = 1;
+
+    // Random keystrokes against the model, checking the line, cursor and widths after each
+    for (long i = 0; i < EDITOR_CHECK_EDITS && ok; i++) {
+        int key = rand() % 16;
+        if (key < 7) {
+            char c = keys[rand() % (sizeof(keys) - 1)];
+            char text[2] = { c, '\0' };
+            line_editor_insert(&editor, text);
+            plain_insert(&line, c);
+        } else if (key < 9) {
+            if (line_editor_delete(&editor) != (line.cursor < line.length)) ok = 0;
+            if (line.cursor < line.length) plain_delete(&line, line.cursor);
+        } else if (key < 10) {
+            if (line_editor_backspace(&editor) != (line.cursor > 0)) ok = 0;
+            if (line.cursor > 0) plain_delete(&line, --line.cursor);
+        } else if (key < 12) {
+            if (line_editor_left(&editor) != (line.cursor > 0)) ok = 0;
+            if (line.cursor > 0) line.cursor--;
+        } else if (key < 14) {
+            if (line_editor_right(&editor) != (line.cursor < line.length)) ok = 0;
+            if (line.cursor < line.length) line.cursor++;
+        } else if (key < 15) {
+            line_editor_toggle_insert(&editor);
+            line.overwrite = !line.overwrite;
+        } else if (rand() % 2) {
+            line_editor_home(&editor);
+            line.cursor = 0;
+        } else {
+            line_editor_end(&editor);
+            line.cursor = line.length;
+        }
+        if (!editor_matches(&editor, &line, advances)) {
+            printf("Error: Line differs from the model after edit %ld\n", i);
+            ok = 0;
+        }
+    }
+    line.text[line.length] = '\0';
+    if (ok && strcmp(line_editor_text(&editor), line.text) != 0) {
+        printf("Error: Line text differs from the model\n");
+        ok = 0;
+    }
+    printf("%d random edits match the string model (final length %zu)\n", EDITOR_CHECK_EDITS, line.length);
+
+    // Typing and deleting in the middle of lines of growing length: the gap buffer stays flat
+    // while shifting the tail of a string grows with the line
+    printf("%10s %16s %16s\n", "length", "gap ns/key", "string ns/key");
+    char* plain = malloc(max_length + 2);
+    for (long length = 10; length <= max_length && plain != NULL; length *= 10) {
+        line_editor_clear(&editor);
+        editor.overwrite = 0;
+        for (long i = 0; i < length; i++) line_editor_insert(&editor, "1");
+        line_editor_home(&editor);
+        for (long i = 0; i < length / 2; i++) line_editor_right(&editor);
+
+        double start = now_seconds();
+        for (long i = 0; i < EDITOR_KEYSTROKES; i += 4) {
+            line_editor_insert(&editor, "2");
+            line_editor_left(&editor);
+            line_editor_right(&editor);
+            line_editor_backspace(&editor);
+        }
+        double gap = (now_seconds() - start) / EDITOR_KEYSTROKES;
+
+        PlainLine model = { plain, (size_t)length, (size_t)length / 2, 0 };
+        memset(plain, '1', length);
+        long keystrokes = length >= 100000 ? EDITOR_KEYSTROKES / 100 : EDITOR_KEYSTROKES;
+        start = now_seconds();
+        for (long i = 0; i < keystrokes; i += 4) {
+            plain_insert(&model, '2');
+            model.cursor--;
+            model.cursor++;
+            plain_delete(&model, --model.cursor);
+        }
+        double shifted = (now_seconds() - start) / keystrokes;
+        printf("%10ld %16.2f %16.2f\n", length, gap * 1e9, shifted * 1e9);
+        if (line_editor_length(&editor) != (size_t)length || model.length != (size_t)length) ok = 0;
+    }
+    free(plain);
+    free(line.text);
+    line_editor_free(&editor);
+    printf(ok ? "Line editor matches the model\n" : "Error: Line editor differs from the model\n");
+    return ok;
+}
+
+// Evaluate an expression of n for a term the way the home screen does
+static double sequence_expression(CalcContext* context, const char* expression, double n) {
+    Program program;
+    return compile_expression(expression, &program) ? run_program(context, &program, n) : NAN;
+}
+
+static void define_sequences(Sequences* sequences, const char* u, const char* u0, const char* v, const char* v0,
+                             const char* w, const char* w0) {
+    sequence_set(sequences, 0, u);
+    sequence_set_initial(sequences, 0, u0);
+    sequence_set(sequences, 1, v);
+    sequence_set_initial(sequences, 1, v0);
+    sequence_set(sequences, 2, w);
+    sequence_set_initial(sequences, 2, w0);
+}
+
+int bench_sequences(long terms) {
+    static CalcContext context, other_context;
+    static Sequences sequences, other_sequences;
+    calc_context_init(&context);
+    calc_context_init(&other_context);
+    sequences_init(&sequences);
+    sequences_init(&other_sequences);
+    context.sequences = &sequences;
+    other_context.sequences = &other_sequences;
+    int ok = 1;
+
+    // Fibonacci is exact in doubles up to F(78) < 2^53
+    define_sequences(&sequences, "u(n-1)+u(n-2)", "{1,1}", "", "", "", "");
+    uint64_t a = 1, b = 1;  // F(n-1), F(n)
+    for (long n = 2; n <= 78; n++) {
+        double value = sequence_expression(&context, "u(n)", (double)n);
+        if (value != (double)b) {
+            printf("Error: u(%ld) = %.17g, expected %llu\n", n, value, (unsigned long long)b);
+            ok = 0;
+        }
+        uint64_t next = a + b;
+        a = b;
+        b = next;
+    }
+
+    // Contexts with their own sets on one thread: each term comes from its context's definitions
+    define_sequences(&other_sequences, "2u(n-1)", "1", "", "", "", "");
+    for (int n = 10; n <= 40; n += 10) {
+        double mine = sequence_expression(&context, "u(n)", n), other = sequence_expression(&other_context, "u(n)", n);
+        if (mine != round(pow((1 + sqrt(5)) / 2, n) / sqrt(5)) || other != ldexp(1.0, n - 1)) {
+            printf("Error: u(%d) is %.17g and %.17g in two contexts\n", n, mine, other);
+            ok = 0;
+        }
+    }
+    if (!isnan(sequence_expression(&(CalcContext){ .angle = ANGLE_DEGREE }, "u(5)", 0))) {
+        printf("Error: A context without sequences has u(5)\n");
+        ok = 0;
+    }
+
+    // Sequences referring to each other, against the same recurrence written out in C: u and v step
+    // together, and w is closed-form
+    define_sequences(&sequences, "v(n-1)+u(n-2)/2", "{2,1}", "u(n-1)-v(n-1)/3", "5", "n^2-A", "");
+    context.variables[0] = 3.0;  // A
+    double u[64], v[64];
+    u[1] = 1.0; u[2] = 2.0; v[1] = 5.0;
+    v[2] = u[1] - v[1] / 3;
+    for (int n = 3; n < 64; n++) {
+        u[n] = v[n - 1] + u[n - 2] / 2;
+        v[n] = u[n - 1] - v[n - 1] / 3;
+    }
+    for (int n = 63; n >= 1; n -= 5) {  // Backwards: within the window, then starting over
+        double su = sequence_expression(&context, "u(n)", n), sv = sequence_expression(&context, "v(n)", n);
+        double sw = sequence_expression(&context, "w(n)", n);
+        if (su != u[n] || sv != v[n] || sw != (double)n * n - 3.0) {
+            printf("Error: u, v, w(%d) = %.17g, %.17g, %.17g; expected %.17g, %.17g, %.17g\n", n, su, sv, sw,
+                   u[n], v[n], (double)n * n - 3.0);
+            ok = 0;
+        }
+    }
+
+    // Terms that do not exist, and definitions the TI-84 rejects
+    if (!isnan(sequence_expression(&context, "u(0)", 0)) || !isnan(sequence_expression(&context, "u(2.5)", 0))) {
+        printf("Error: A term before nMin or between two terms has a value\n");
+        ok = 0;
+    }
+    static const char* invalid[][2] = { { "u(n)+1", "1" }, { "u(n-3)", "{1,2}" }, { "u(n-2)", "1" }, { "u(2n-1)", "1" }, { "u(5)", "1" } };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        define_sequences(&sequences, invalid[i][0], invalid[i][1], "", "", "", "");
+        if (!isnan(sequence_expression(&context, "u(10)", 0))) {
+            printf("Error: u(n)=%s with u(nMin)=%s was accepted\n", invalid[i][0], invalid[i][1]);
+            ok = 0;
+        }
+    }
+
+    // Batches, as in the TABLE, match one term at a time
+    define_sequences(&sequences, "1.5u(n-1)-u(n-2)/2+sin(n)", "{1,0}", "", "", "", "");
+    Program program;
+    double x[PROGRAM_BATCH * 4], batch[PROGRAM_BATCH * 4];
+    if (!compile_expression("u(X)*2+X", &program)) return 0;
+    for (int i = 0; i < PROGRAM_BATCH * 4; i++) x[i] = 40.0 + i;
+    run_program_batch(&context, &program, x, batch, PROGRAM_BATCH * 4);
+    define_sequences(&sequences, "1.5u(n-1)-u(n-2)/2+sin(n)", "{1,0}", "", "", "", "");  // A fresh window
+    for (int i = PROGRAM_BATCH * 4 - 1; i >= 0; i--) {
+        if (batch[i] != run_program(&context, &program, x[i])) {
+            printf("Error: Batched u(%g) differs\n", x[i]);
+            ok = 0;
+        }
+    }
+
+    // ON during a long evaluation: it stops within a poll interval and Ans keeps its value
+    define_sequences(&sequences, "u(n-1)+1", "0", "", "", "", "");
+    context.variables[CALC_ANS] = 7.0;
+    context.cancel_check = cancel_after_polls;
+    cancel_polls = 0;
+    cancel_poll_limit = 3;
+    double start = now_seconds();
+    double cancelled = evaluate_expression(&context, "u(1E12)+1");
+    double cancel_ms = (now_seconds() - start) * 1e3;
+    context.cancel_check = NULL;
+    if (!isnan(cancelled) || context.variables[CALC_ANS] != 7.0 || cancel_ms > 100.0) {
+        printf("Error: Cancelled u(1E12) gave %g in %.1f ms, Ans %g\n", cancelled, cancel_ms, context.variables[CALC_ANS]);
+        ok = 0;
+    }
+
+    // Linear time: each term is one step, so ten times the terms take ten times as long
+    define_sequences(&sequences, "0.999999u(n-1)+1/n", "0", "", "", "", "");
+    printf("%12s %12s %10s %10s\n", "n", "u(n)", "ms", "ns/term");
+    for (long n = terms / 100; n <= terms; n *= 10) {
+        sequence_set_nmin(&sequences, 1);  // A fresh window, so every term is computed
+        double start = now_seconds();
+        double value = sequence_expression(&context, "u(n)", (double)n);
+        double elapsed = now_seconds() - start;
+        printf("%12ld %12.10g %10.1f %10.2f\n", n, value, elapsed * 1e3, elapsed / n * 1e9);
+        if (isnan(value)) ok = 0;
+    }
+    start = now_seconds();
+    double next = sequence_expression(&context, "u(n)", (double)terms + 1);
+    printf("u(%ld) right after: %.1f us\n", terms + 1, (now_seconds() - start) * 1e6);
+    if (isnan(next)) ok = 0;
+
+    printf(ok ? "All sequences match\n" : "Error: Sequence results differ\n");
+    return ok;
+}
+
+// Load on the evaluation service: formulas that repeat, so the server's cache hits, with a batch every
+// eighth request, in both angle modes, and one that does not compile
+static const char* serve_corpus[] = {
+    "X^2+3X-1",
+    "sin(X)^2+cos(X)*A",
+    "ln(X^2+2)/(1+X^2)",
+    "sqrt(X)*10^(-X/100)",
+    "tan(X/4)-X^3/1000",
+    "2+*X",
+};
+#define SERVE_CORPUS (int)(sizeof(serve_corpus) / sizeof(serve_corpus[0]))
+#define SERVE_SAMPLE 17  // Every 17th answer is checked locally: prime, so every formula, angle and batch size comes up
+#define SERVE_DEPTH 32   // Requests a pipelining client keeps in flight
+
+typedef struct {
+    const char* path;
+    long requests;
+    int depth;            // Requests in flight
+    double* latencies;    // Seconds from sending each request to reading its answer
+    long wrong;
+    int failed;
+} ServeClient;
+
+static int connect_server(const char* path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0) return fd;
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+static int send_all(int fd, const unsigned char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent <= 0) return 0;
+        data += sent;
+        size -= sent;
+    }
+    return 1;
+}
+
+static int serve_count(long i) {
+    return i % 8 == 7 ? PROGRAM_BATCH : 1;
+}
+
+static double serve_x(long i, int k) {
+    return (double)((i * 7 + k * 13) % 2001) * 0.37 - 370.0;
+}
+
+// Append request i to a buffer with room for it
+static size_t write_request(unsigned char* out, long i) {
+    const char* expression = serve_corpus[i % SERVE_CORPUS];
+    int count = serve_count(i);
+    ServerRequest request = { 0, (uint32_t)i, SERVER_OP_EVALUATE, i % 3 == 0 ? ANGLE_DEGREE : ANGLE_RADIAN,
+                              (uint16_t)strlen(expression), (uint32_t)count };
+    request.size = sizeof(request) - sizeof(uint32_t) + request.expression_length + count * sizeof(double);
+    memcpy(out, &request, sizeof(request));
+    memcpy(out + sizeof(request), expression, request.expression_length);
+    for (int k = 0; k < count; k++) {
+        double x = serve_x(i, k);
+        memcpy(out + sizeof(request) + request.expression_length + k * sizeof(double), &x, sizeof(double));
+    }
+    return sizeof(uint32_t) + request.size;
+}
+
+// Whether the answer to request i is what this thread computes itself
+static int check_answer(CalcContext* context, Program programs[][2], int* valid, long i, const ServerResponse* response, const unsigned char* values) {
+    int e = i % SERVE_CORPUS, angle = i % 3 == 0 ? ANGLE_DEGREE : ANGLE_RADIAN;
+    if (!valid[e]) return response->status == SERVER_SYNTAX_ERROR && response->count == 0;
+    if (response->status != SERVER_OK || response->count != (uint32_t)serve_count(i)) return 0;
+    if (i % SERVE_SAMPLE != 0) return 1;
+    context->angle = angle;
+    for (uint32_t k = 0; k < response->count; k++) {
+        double value, expected = run_program(context, &programs[e][angle], serve_x(i, k));
+        memcpy(&value, values + k * sizeof(double), sizeof(double));
+        if (memcmp(&value, &expected, sizeof(double)) != 0 && !(isnan(value) && isnan(expected))) return 0;
+    }
+    return 1;
+}
+
+static void* serve_client_thread(void* arg) {
+    ServeClient* client = arg;
+    CalcContext* context = malloc(sizeof(CalcContext));
+    Program (*programs)[2] = malloc(SERVE_CORPUS * sizeof(*programs));
+    int valid[SERVE_CORPUS];
+    size_t frame = sizeof(ServerRequest) + 64 + PROGRAM_BATCH * sizeof(double);
+    unsigned char* out = malloc(client->depth * frame);
+    unsigned char* in = malloc(client->depth * frame);
+    double* sent_at = malloc(client->depth * sizeof(double));
+    int fd = connect_server(client->path);
+    client->failed = 1;
+    if (fd < 0 || context == NULL || programs == NULL || out == NULL || in == NULL || sent_at == NULL) goto done;
+
+    // The same programs the server evaluates: compiled, then optimized for each angle mode
+    calc_context_init(context);
+    for (int e = 0; e < SERVE_CORPUS; e++) {
+        valid[e] = compile_expression(serve_corpus[e], &programs[e][0]);
+        for (int angle = ANGLE_RADIAN; valid[e] && angle <= ANGLE_DEGREE; angle++) {
+            programs[e][angle] = programs[e][0];
+            context->angle = angle;
+            optimize_program(context, &programs[e][angle]);
+        }
+    }
+
+    long sent = 0, received = 0;
+    size_t buffered = 0;
+    while (received < client->requests) {
+        size_t used = 0;
+        while (sent < client->requests && sent - received < client->depth) {
+            used += write_request(out + used, sent);
+            sent_at[sent % client->depth] = now_seconds();
+            sent++;
+        }
+        if (used > 0 && !send_all(fd, out, used)) goto done;
+
+        ssize_t read = recv(fd, in + buffered, client->depth * frame - buffered, 0);
+        if (read <= 0) goto done;
+        buffered += read;
+        double now = now_seconds();
+        size_t offset = 0;
+        ServerResponse response;
+        while (buffered - offset >= sizeof(response)) {
+            memcpy(&response, in + offset, sizeof(response));
+            if (buffered - offset < sizeof(uint32_t) + response.size) break;
+            if (response.id != (uint32_t)received ||
+                !check_answer(context, programs, valid, received, &response, in + offset + sizeof(response))) {
+                client->wrong++;
+            }
+            client->latencies[received] = now - sent_at[received % client->depth];
+            received++;
+            offset += sizeof(uint32_t) + response.size;
+        }
+        memmove(in, in + offset, buffered - offset);
+        buffered -= offset;
+    }
+    client->failed = 0;
+
+done:
+    if (fd >= 0) close(fd);
+    free(context);
+    free(programs);
+    free(out);
+    free(in);
+    free(sent_at);
+    return NULL;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+int bench_server(const char* path, int connections, long requests) {
+    // One client waiting for each answer, one pipelining, then many pipelining at once
+    const int runs[][2] = { { 1, 1 }, { 1, SERVE_DEPTH }, { connections, SERVE_DEPTH } };
+    int ok = 1;
+    double* latencies = malloc(requests * sizeof(double));
+    ServeClient* clients = calloc(connections, sizeof(ServeClient));
+    pthread_t* handles = calloc(connections, sizeof(pthread_t));
+    if (latencies == NULL || clients == NULL || handles == NULL || connections < 1) {
+        free(latencies);
+        free(clients);
+        free(handles);
+        return 0;
+    }
+
+    printf("Sending %ld requests to %s per run\n", requests, path);
+    printf("%11s %5s %12s %10s %10s %10s %10s\n", "connections", "depth", "requests/s", "p50 us", "p99 us", "p99.9 us", "max us");
+    for (int run = 0; run < 3 && ok; run++) {
+        int n = runs[run][0], depth = runs[run][1];
+        double start = now_seconds();
+        for (int c = 0; c < n; c++) {
+            clients[c] = (ServeClient){ path, requests / n, depth, latencies + c * (requests / n), 0, 0 };
+            pthread_create(&handles[c], NULL, serve_client_thread, &clients[c]);
+        }
+        for (int c = 0; c < n; c++) pthread_join(handles[c], NULL);
+        double elapsed = now_seconds() - start;
+
+        long total = requests / n * n;
+        for (int c = 0; c < n; c++) {
+            if (clients[c].failed) {
+                printf("Error: Lost the connection to %s\n", path);
+                ok = 0;
+            }
+            if (clients[c].wrong > 0) {
+                printf("Error: %ld wrong answers\n", clients[c].wrong);
+                ok = 0;
+            }
+        }
+        if (!ok) break;
+        qsort(latencies, total, sizeof(double), compare_doubles);
+        printf("%11d %5d %12.0f %10.1f %10.1f %10.1f %10.1f\n", n, depth, total / elapsed,
+               latencies[total / 2] * 1e6, latencies[total * 99 / 100] * 1e6,
+               latencies[total * 999 / 1000] * 1e6, latencies[total - 1] * 1e6);
+    }
+
+    free(latencies);
+    free(clients);
+    free(handles);
+    printf(ok ? "Every answer matched\n" : "Error: The server answered wrongly\n");
+    return ok;
+}
@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include "complex_math.h"
+#include "math_kernels.h"
+#include "profiler.h"
+#include "format.h"
+#include "sequence.h"
+
+#define COMPLEX_MAX_PART 1e150      // Parts the fast formulas handle; the TI-84 stops at 1E100 anyway
+#define HYPERBOLIC_MAX 700.0        // cosh, sinh and exp of the real part stay finite below this
+#define SINH_SERIES_MAX 1.0         // Below this, sinh comes from its Taylor series instead of exp
+#define TAN_HYPERBOLIC_MAX 350.0    // sinh(b) cosh(b) stays finite below this
+#define COMPLEX_MAX_POWER 64        // Largest integer exponent done by repeated multiplication
+#define LOG_NEAR_ONE_MIN 0.5        // ln|z| is computed as log1p(|z|^2 - 1) / 2 for max(|re|, |im|) in this range
+#define LOG_NEAR_ONE_MAX 2.0
+
+static const double DEGREES_TO_RADIANS = 1.74532925199432954744e-02;
+static const double LOG10_OF_E = 4.34294481903251816668e-01;
+static const double TAN_PI_OVER_8 = 4.14213562373095034470e-01;
+
+// pi/4, pi/2 and pi split into a double and the rest
+static const double PI_OVER_4 = 7.85398163397448278999e-01, PI_OVER_4_LO = 3.06161699786838301793e-17;
+static const double PI_OVER_2 = 1.57079632679489655800e+00, PI_OVER_2_LO = 6.12323399573676603587e-17;
+static const double PI_HI = 3.14159265358979311600e+00, PI_LO = 1.22464679914735317723e-16;
+
+// fdlibm minimax polynomial for atan on |t| <= 7/16
+static const double AT0 = 3.33333333333329318027e-01, AT1 = -1.99999999998764832476e-01,
+                    AT2 = 1.42857142725034663711e-01, AT3 = -1.11111104054623557880e-01,
+                    AT4 = 9.09088713343650656196e-02, AT5 = -7.69187620504482999495e-02,
+                    AT6 = 6.66107313738753120669e-02, AT7 = -5.83357013379057348645e-02,
+                    AT8 = 4.97687799461593236017e-02, AT9 = -3.65315727442169155270e-02,
+                    AT10 = 1.62858201153657823623e-02;
+
+// Taylor coefficients 1/3!, 1/5!, ..., 1/17! of sinh; the next term is below half an ulp for |x| < 1
+static const double SH1 = 1.0 / 6.0, SH2 = 1.0 / 120.0, SH3 = 1.0 / 5040.0, SH4 = 1.0 / 362880.0,
+                    SH5 = 1.0 / 39916800.0, SH6 = 1.0 / 6227020800.0, SH7 = 1.0 / 1307674368000.0,
+                    SH8 = 1.0 / 355687428096000.0;
+
+static inline int chunk_length(int start, int count) {
+    return count - start < KERNEL_BATCH ? count - start : KERNEL_BATCH;
+}
+
+// Lanes with both parts finite and small enough to square
+static inline int complex_covered(double re, double im) {
+    return fabs(re) < COMPLEX_MAX_PART && fabs(im) < COMPLEX_MAX_PART;
+}
+
+// atan2(y, x) without branches: fold into the first octant as t = min/max in [0, 1], fold once more
+// around 1 with (t - 1) / (t + 1) so the polynomial applies, then unfold
+static inline double atan2_lane(double y, double x) {
+    double ax = fabs(x), ay = fabs(y);
+    double big = ax > ay ? ax : ay, small = ax > ay ? ay : ax;
+    double t = big == 0 ? 0.0 : small / big;
+    int upper = t > TAN_PI_OVER_8;
+    double u = upper ? (t - 1.0) / (t + 1.0) : t;
+
+    double z = u * u, w = z * z;
+    double s1 = z * (AT0 + w * (AT2 + w * (AT4 + w * (AT6 + w * (AT8 + w * AT10)))));
+    double s2 = w * (AT1 + w * (AT3 + w * (AT5 + w * (AT7 + w * AT9))));
+    double a = upper ? PI_OVER_4 - ((u * (s1 + s2) - PI_OVER_4_LO) - u) : u - u * (s1 + s2);
+
+    a = ay > ax ? (PI_OVER_2 - a) + PI_OVER_2_LO : a;
+    a = x < 0 ? (PI_HI - a) + PI_LO : a;
+    return copysign(a, y);
+}
+
+// sinh(x) given e = exp(|x|): the series near 0, where (e - 1/e) / 2 would cancel
+static inline double sinh_lane(double x, double e) {
+    double z = x * x;
+    double series = x + x * z * (SH1 + z * (SH2 + z * (SH3 + z * (SH4 + z * (SH5 + z * (SH6 + z * (SH7 + z * SH8)))))));
+    double large = copysign(0.5 * (e - 1.0 / e), x);
+    return fabs(x) < SINH_SERIES_MAX ? series : large;
+}
+
+void complex_kernel_multiply(const double* a_re, const double* a_im, const double* b_re, const double* b_im,
+                             double* re, double* im, int count) {
+    for (int i = 0; i < count; i++) {
+        double r = a_re[i] * b_re[i] - a_im[i] * b_im[i];
+        double m = a_re[i] * b_im[i] + a_im[i] * b_re[i];
+        re[i] = r;
+        im[i] = m;
+    }
+}
+
+void complex_kernel_divide(const double* a_re, const double* a_im, const double* b_re, const double* b_im,
+                           double* re, double* im, int count) {
+    for (int i = 0; i < count; i++) {
+        double a = a_re[i], b = a_im[i], c = b_re[i], d = b_im[i];
+        // Divide through by the larger part of the divisor; 0/0 in r makes division by zero NaN
+        int wide = fabs(c) >= fabs(d);
+        double p = wide ? d : c, q = wide ? c : d;
+        double r = p / q;
+        double denominator = q + p * r;
+        double re_numerator = wide ? a + b * r : a * r + b;
+        double im_numerator = wide ? b - a * r : b * r - a;
+        re[i] = re_numerator / denominator;
+        im[i] = im_numerator / denominator;
+    }
+}
+
+void complex_kernel_sqrt(const double* x_re, const double* x_im, double* re, double* im, int count) {
+    double result_re[KERNEL_BATCH], result_im[KERNEL_BATCH];
+    for (int start = 0; start < count; start += KERNEL_BATCH) {
+        int n = chunk_length(start, count);
+        const double* a = x_re + start;
+        const double* b = x_im + start;
+
+        // t = sqrt((|z| + |a|) / 2) is the part on the side of a; the other part is b / 2t
+        for (int i = 0; i < n; i++) {
+            double ax = fabs(a[i]), ay = fabs(b[i]);
+            double big = ax > ay ? ax : ay, small = ax > ay ? ay : ax;
+            double ratio = big == 0 ? 0.0 : small / big;
+            double magnitude = big * sqrt(1.0 + ratio * ratio);
+            double t = sqrt(0.5 * (magnitude + ax));
+            double other = t == 0 ? 0.0 : ay / (2.0 * t);
+            result_re[i] = a[i] >= 0 ? t : other;
+            result_im[i] = copysign(a[i] >= 0 ? other : t, b[i]);
+        }
+        for (int i = 0; i < n; i++) {
+            if (!complex_covered(a[i], b[i])) {
+                double complex z = csqrt(CMPLX(a[i], b[i]));
+                result_re[i] = creal(z);
+                result_im[i] = cimag(z);
+            }
+        }
+        memcpy(re + start, result_re, n * sizeof(double));
+        memcpy(im + start, result_im, n * sizeof(double));
+    }
+}
+
+void complex_kernel_exp(const double* x_re, const double* x_im, double* re, double* im, int count) {
+    double scale[KERNEL_BATCH], cosine[KERNEL_BATCH], sine[KERNEL_BATCH];
+    for (int start = 0; start < count; start += KERNEL_BATCH) {
+        int n = chunk_length(start, count);
+        const double* a = x_re + start;
+        const double* b = x_im + start;
+
+        // e^a (cos b + i sin b), all three from the real kernels
+        kernel_exp(a, scale, n);
+        kernel_cos(b, cosine, n);
+        kernel_sin(b, sine, n);
+        for (int i = 0; i < n; i++) {
+            cosine[i] *= scale[i];
+            sine[i] *= scale[i];
+        }
+        for (int i = 0; i < n; i++) {
+            if (!(fabs(a[i]) < HYPERBOLIC_MAX && isfinite(b[i]))) {
+                double complex z = cexp(CMPLX(a[i], b[i]));
+                cosine[i] = creal(z);
+                sine[i] = cimag(z);
+            }
+        }
+        memcpy(re + start, cosine, n * sizeof(double));
+        memcpy(im + start, sine, n * sizeof(double));
+    }
+}
+
+void complex_kernel_log(const double* x_re, const double* x_im, double* re, double* im, int count) {
+    double big[KERNEL_BATCH], spread[KERNEL_BATCH], shifted[KERNEL_BATCH], angle[KERNEL_BATCH];
+    for (int start = 0; start < count; start += KERNEL_BATCH) {
+        int n = chunk_length(start, count);
+        const double* a = x_re + start;
+        const double* b = x_im + start;
+
+        // ln|z| = ln(max) + ln(1 + (min/max)^2) / 2, which cannot overflow. Near the unit circle that
+        // cancels, so there ln|z| = log1p(u) / 2 with u = |z|^2 - 1 = (max - 1)(max + 1) + min^2, and
+        // log1p(u) = ln(w) u / (w - 1) for w = 1 + u (Goldberg). Then add the angle.
+        for (int i = 0; i < n; i++) {
+            double ax = fabs(a[i]), ay = fabs(b[i]);
+            double larger = ax > ay ? ax : ay, smaller = ax > ay ? ay : ax;
+            double ratio = smaller / larger;
+            double u = (larger - 1.0) * (larger + 1.0) + smaller * smaller;
+            int near_one = larger >= LOG_NEAR_ONE_MIN && larger <= LOG_NEAR_ONE_MAX;
+            shifted[i] = near_one ? u : 0.0;
+            big[i] = near_one ? 1.0 + u : larger;
+            spread[i] = near_one ? 1.0 : 1.0 + ratio * ratio;
+            angle[i] = atan2_lane(b[i], a[i]);
+        }
+        kernel_log(big, big, n);
+        kernel_log(spread, spread, n);
+        for (int i = 0; i < n; i++) {
+            double w = 1.0 + shifted[i];
+            double log1p_u = w == 1.0 ? shifted[i] : big[i] * shifted[i] / (w - 1.0);
+            big[i] = shifted[i] != 0.0 ? 0.5 * log1p_u : big[i] + 0.5 * spread[i];
+        }
+        for (int i = 0; i < n; i++) {
+            if (!complex_covered(a[i], b[i]) || (a[i] == 0 && b[i] == 0)) {
+                double complex z = clog(CMPLX(a[i], b[i]));
+                big[i] = creal(z);
+                angle[i] = cimag(z);
+            }
+        }
+        memcpy(re + start, big, n * sizeof(double));
+        memcpy(im + start, angle, n * sizeof(double));
+    }
+}
+
+void complex_kernel_power(const double* a_re, const double* a_im, const double* b_re, const double* b_im,
+                          double* re, double* im, int count) {
+    double result_re[KERNEL_BATCH], result_im[KERNEL_BATCH];
+    for (int start = 0; start < count; start += KERNEL_BATCH) {
+        int n = chunk_length(start, count);
+        const double* a = a_re + start;
+        const double* b = a_im + start;
+        const double* c = b_re + start;
+        const double* d = b_im + start;
+
+        // exp(b ln a) for every lane
+        complex_kernel_log(a, b, result_re, result_im, n);
+        complex_kernel_multiply(c, d, result_re, result_im, result_re, result_im, n);
+        complex_kernel_exp(result_re, result_im, result_re, result_im, n);
+
+        // Integer exponents multiply instead, and 0^b is 0 where ln 0 would give NaN
+        for (int i = 0; i < n; i++) {
+            if (d[i] == 0 && fabs(c[i]) <= COMPLEX_MAX_POWER && c[i] == (int)c[i]) {
+                double base_re = a[i], base_im = b[i], power_re = 1.0, power_im = 0.0;
+                for (int exponent = (int)fabs(c[i]); exponent > 0; exponent >>= 1) {
+                    if (exponent & 1) complex_kernel_multiply(&power_re, &power_im, &base_re, &base_im, &power_re, &power_im, 1);
+                    if (exponent > 1) complex_kernel_multiply(&base_re, &base_im, &base_re, &base_im, &base_re, &base_im, 1);
+                }
+                if (c[i] < 0) {
+                    double one = 1.0, zero = 0.0;
+                    complex_kernel_divide(&one, &zero, &power_re, &power_im, &power_re, &power_im, 1);
+                }
+                result_re[i] = power_re;
+                result_im[i] = power_im;
+            } else if (a[i] == 0 && b[i] == 0) {
+                result_re[i] = d[i] == 0 && c[i] > 0 ? 0.0 : NAN;
+                result_im[i] = result_re[i];
+            }
+        }
+        memcpy(re + start, result_re, n * sizeof(double));
+        memcpy(im + start, result_im, n * sizeof(double));
+    }
+}
+
+// sin, cos or tan of count values: with the real part in the angle mode, the imaginary part converted with it
+static void complex_trig(AngleMode angle, FunctionId func, const double* x_re, const double* x_im, double* re, double* im, int count) {
+    double sine_a[KERNEL_BATCH], cosine_a[KERNEL_BATCH], b[KERNEL_BATCH], e[KERNEL_BATCH];
+    double result_re[KERNEL_BATCH], result_im[KERNEL_BATCH];
+    double scale = angle == ANGLE_DEGREE ? DEGREES_TO_RADIANS : 1.0;
+    double limit = func == FUNC_TAN ? TAN_HYPERBOLIC_MAX : HYPERBOLIC_MAX;
+    for (int start = 0; start < count; start += KERNEL_BATCH) {
+        int n = chunk_length(start, count);
+        const double* a = x_re + start;
+
+        if (angle == ANGLE_DEGREE) {
+            kernel_sin_degrees(a, sine_a, n);
+            kernel_cos_degrees(a, cosine_a, n);
+        } else {
+            kernel_sin(a, sine_a, n);
+            kernel_cos(a, cosine_a, n);
+        }
+        for (int i = 0; i < n; i++) {
+            b[i] = x_im[start + i] * scale;
+            e[i] = fabs(b[i]);
+        }
+        kernel_exp(e, e, n);
+
+        // sin(a + bi) = sin a cosh b + i cos a sinh b, cos(a + bi) = cos a cosh b - i sin a sinh b, and
+        // tan(a + bi) = (sin a cos a + i sinh b cosh b) / (cos^2 a + sinh^2 b), whose denominator keeps
+        // its accuracy next to the poles
+        for (int i = 0; i < n; i++) {
+            double cosh_b = 0.5 * (e[i] + 1.0 / e[i]);
+            double sinh_b = sinh_lane(b[i], e[i]);
+            double denominator = cosine_a[i] * cosine_a[i] + sinh_b * sinh_b;
+            switch (func) {
+                case FUNC_COS:
+                    result_re[i] = cosine_a[i] * cosh_b;
+                    result_im[i] = -sine_a[i] * sinh_b;
+                    break;
+                case FUNC_TAN:
+                    result_re[i] = sine_a[i] * cosine_a[i] / denominator;
+                    result_im[i] = sinh_b * cosh_b / denominator;
+                    break;
+                default:
+                    result_re[i] = sine_a[i] * cosh_b;
+                    result_im[i] = cosine_a[i] * sinh_b;
+                    break;
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            if (!(fabs(b[i]) < limit && isfinite(a[i]))) {
+                double complex z = CMPLX(a[i] * scale, b[i]);
+                z = func == FUNC_COS ? ccos(z) : func == FUNC_TAN ? ctan(z) : csin(z);
+                result_re[i] = creal(z);
+                result_im[i] = cimag(z);
+            }
+        }
+        memcpy(re + start, result_re, n * sizeof(double));
+        memcpy(im + start, result_im, n * sizeof(double));
+    }
+}
+
+void complex_kernel_sin(AngleMode angle, const double* x_re, const double* x_im, double* re, double* im, int count) {
+    complex_trig(angle, FUNC_SIN, x_re, x_im, re, im, count);
+}
+
+void complex_kernel_cos(AngleMode angle, const double* x_re, const double* x_im, double* re, double* im, int count) {
+    complex_trig(angle, FUNC_COS, x_re, x_im, re, im, count);
+}
+
+void complex_kernel_tan(AngleMode angle, const double* x_re, const double* x_im, double* re, double* im, int count) {
+    complex_trig(angle, FUNC_TAN, x_re, x_im, re, im, count);
+}
+
+// ln(0) is a domain error on the calculator rather than -inf
+static void logarithm_domain(double* re, double* im, int count) {
+    for (int i = 0; i < count; i++) {
+        if (re[i] == -INFINITY) re[i] = im[i] = NAN;
+    }
+}
+
+void complex_apply_function(const CalcContext* context, FunctionId func, double* re, double* im, int count) {
+    switch (func) {
+        case FUNC_LOG:
+            complex_kernel_log(re, im, re, im, count);
+            for (int i = 0; i < count; i++) {
+                re[i] *= LOG10_OF_E;
+                im[i] *= LOG10_OF_E;
+            }
+            logarithm_domain(re, im, count);
+            break;
+        case FUNC_LN:
+            complex_kernel_log(re, im, re, im, count);
+            logarithm_domain(re, im, count);
+            break;
+        case FUNC_SIN:  complex_kernel_sin(context->angle, re, im, re, im, count); break;
+        case FUNC_COS:  complex_kernel_cos(context->angle, re, im, re, im, count); break;
+        case FUNC_TAN:  complex_kernel_tan(context->angle, re, im, re, im, count); break;
+        case FUNC_SQRT: complex_kernel_sqrt(re, im, re, im, count); break;
+        case FUNC_SEQ_U:
+        case FUNC_SEQ_V:
+        case FUNC_SEQ_W:
+            for (int i = 0; i < count; i++) {
+                re[i] = im[i] == 0 ? sequence_term(context, func - FUNC_SEQ_U, re[i]) : NAN;  // Terms are real
+                im[i] = 0.0;
+            }
+            break;
+        default:
+            for (int i = 0; i < count; i++) re[i] = im[i] = NAN;
+            break;
+    }
+}
+
+// Raise count values to a small integer power by squaring, like power_int
+static void complex_power_int(double* re, double* im, int exponent, int count) {
+    double result_re[PROGRAM_BATCH], result_im[PROGRAM_BATCH];
+    for (int i = 0; i < count; i++) {
+        result_re[i] = 1.0;
+        result_im[i] = 0.0;
+    }
+    while (exponent > 0) {
+        if (exponent & 1) complex_kernel_multiply(result_re, result_im, re, im, result_re, result_im, count);
+        exponent >>= 1;
+        if (exponent > 0) complex_kernel_multiply(re, im, re, im, re, im, count);
+    }
+    memcpy(re, result_re, count * sizeof(double));
+    memcpy(im, result_im, count * sizeof(double));
+}
+
+// Set every lane to the same value
+static void fill_lanes(double* re, double* im, double value_re, double value_im, int count) {
+    for (int i = 0; i < count; i++) {
+        re[i] = value_re;
+        im[i] = value_im;
+    }
+}
+
+void run_program_complex(CalcContext* context, const Program* program, const double* x, double* re, double* im, int count) {
+    double values_re[MAX_PROGRAM_LENGTH][PROGRAM_BATCH], values_im[MAX_PROGRAM_LENGTH][PROGRAM_BATCH];
+    double temps_re[MAX_PROGRAM_TEMPS][PROGRAM_BATCH], temps_im[MAX_PROGRAM_TEMPS][PROGRAM_BATCH];
+
+    for (int start = 0; start < count; start += PROGRAM_BATCH) {
+        int n = count - start < PROGRAM_BATCH ? count - start : PROGRAM_BATCH;
+        int value_top = -1;
+
+        for (int i = 0; i < program->length; i++) {
+            const Token* token = &program->tokens[i];
+            double* top_re = value_top >= 0 ? values_re[value_top] : NULL;
+            double* top_im = value_top >= 0 ? values_im[value_top] : NULL;
+            switch (token->type) {
+                case TOKEN_NUMBER:
+                    value_top++;
+                    fill_lanes(values_re[value_top], values_im[value_top], token->value, 0.0, n);
+                    break;
+                case TOKEN_VARIABLE:
+                    value_top++;
+                    fill_lanes(values_re[value_top], values_im[value_top], context->variables[token->variable],
+                               context->imaginary[token->variable], n);
+                    break;
+                case TOKEN_IMAGINARY:
+                    value_top++;
+                    fill_lanes(values_re[value_top], values_im[value_top], 0.0, 1.0, n);
+                    break;
+                case TOKEN_VARIABLE_X:
+                    value_top++;
+                    memcpy(values_re[value_top], x + start, n * sizeof(double));
+                    memset(values_im[value_top], 0, n * sizeof(double));
+                    break;
+                case TOKEN_OPERATOR: {
+                    value_top--;
+                    double* a_re = values_re[value_top];
+                    double* a_im = values_im[value_top];
+                    switch (token->op) {
+                        case '+':
+                            for (int j = 0; j < n; j++) {
+                                a_re[j] += top_re[j];
+                                a_im[j] += top_im[j];
+                            }
+                            break;
+                        case '-':
+                            for (int j = 0; j < n; j++) {
+                                a_re[j] -= top_re[j];
+                                a_im[j] -= top_im[j];
+                            }
+                            break;
+                        case '*': complex_kernel_multiply(a_re, a_im, top_re, top_im, a_re, a_im, n); break;
+                        case '/': complex_kernel_divide(a_re, a_im, top_re, top_im, a_re, a_im, n); break;
+                        case '^': complex_kernel_power(a_re, a_im, top_re, top_im, a_re, a_im, n); break;
+                    }
+                    break;
+                }
+                case TOKEN_NEGATE:
+                    // 0 - b rather than -b: the calculator has no signed zero, so ~4 is -4+0i and sqrt(~4) is 2i
+                    for (int j = 0; j < n; j++) {
+                        top_re[j] = -top_re[j];
+                        top_im[j] = 0.0 - top_im[j];
+                    }
+                    break;
+                case TOKEN_FUNCTION:
+                    complex_apply_function(context, token->func, top_re, top_im, n);
+                    break;
+                case TOKEN_POWER_INT:
+                    complex_power_int(top_re, top_im, (int)token->value, n);
+                    break;
+                case TOKEN_STORE:
+                    memcpy(temps_re[token->variable], top_re, n * sizeof(double));
+                    memcpy(temps_im[token->variable], top_im, n * sizeof(double));
+                    break;
+                case TOKEN_LOAD:
+                    value_top++;
+                    memcpy(values_re[value_top], temps_re[token->variable], n * sizeof(double));
+                    memcpy(values_im[value_top], temps_im[token->variable], n * sizeof(double));
+                    break;
+            }
+        }
+        memcpy(re + start, values_re[value_top], n * sizeof(double));
+        memcpy(im + start, values_im[value_top], n * sizeof(double));
+    }
+}
+
+double evaluate_complex_expression(CalcContext* context, const char* expression, double* imaginary) {
+    PROFILE_SCOPE("evaluate_expression");
+    Program program;
+
+    printf("Evaluating expression in complex mode: %s\n", expression);
+
+    *imaginary = 0.0;
+    if (!compile_expression(expression, &program) || evaluation_cancelled(context)) {
+        return NAN;
+    }
+
+    // Real inputs take the real fast path; only an undefined result is redone in complex numbers
+    double x = context->variables['X' - 'A'];
+    double result = NAN;
+    if (program_is_real(context, &program)) {
+        result = run_program(context, &program, x);
+    }
+    if (evaluation_cancelled(context)) return NAN;  // Stopped part way: not worth redoing, and Ans keeps its value
+    if (isnan(result)) {
+        run_program_complex(context, &program, &x, &result, imaginary, 1);
+        if (evaluation_cancelled(context)) {
+            *imaginary = 0.0;
+            return NAN;
+        }
+    }
+
+    char real_text[FORMAT_LENGTH], imaginary_text[FORMAT_LENGTH];
+    format_shortest(result, real_text);
+    format_shortest(*imaginary, imaginary_text);
+    printf("Final result: %s + %s i\n", real_text, imaginary_text);
+    if (!isnan(result) && !isnan(*imaginary)) {  // An error leaves Ans as it was
+        context->variables[CALC_ANS] = result;
+        context->imaginary[CALC_ANS] = *imaginary;
+    }
+    return result;
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include "eval_worker.h"
+#include "spsc_queue.h"
+#include "math_engine.h"
+#include "rational.h"
+#include "complex_math.h"
+#include "profiler.h"
+
+typedef struct {
+    unsigned id;
+    char* expression;      // Owned by the request; NULL asks the worker to exit
+    CalcContext* context;  // Lent to the worker until the result is posted
+} EvalRequest;
+
+static SpscQueue requests;  // UI thread -> worker
+static SpscQueue results;   // Worker -> UI thread
+static sem_t requests_available;
+static pthread_t worker;
+static int worker_running = 0;
+static unsigned next_id = 1;
+
+static atomic_uint cancel_up_to;        // Every request with an id up to this one is cancelled
+static unsigned current_request_id = 0; // Worker thread only
+
+static int worker_cancel_check() {
+    return atomic_load_explicit(&cancel_up_to, memory_order_relaxed) >= current_request_id;
+}
+
+static void* eval_worker_thread(void* arg) {
+    (void)arg;
+    profile_thread_name("eval worker");
+
+    for (;;) {
+        EvalRequest request;
+        sem_wait(&requests_available);
+        if (!spsc_pop(&requests, &request)) continue;
+        if (request.expression == NULL) break;
+
+        current_request_id = request.id;
+        CalcContext* context = request.context;
+        context->cancel_check = worker_cancel_check;
+
+        EvalResult result = { request.id, 0.0, 0.0, EVAL_OK, 0, { 0, 1 } };
+        if (!evaluation_cancelled(context)) {
+            if (strip_frac_suffix(request.expression)) {
+                result.has_fraction = evaluate_fraction(context, request.expression, &result.value, &result.fraction);
+            } else if (context->complex_mode != COMPLEX_REAL) {
+                result.value = evaluate_complex_expression(context, request.expression, &result.imaginary);
+            } else {
+                result.value = evaluate_expression(context, request.expression);
+            }
+        }
+        if (evaluation_cancelled(context)) result.status = EVAL_CANCELLED;
+        context->cancel_check = NULL;
+        free(request.expression);
+
+        // The UI drains results every frame, so this only waits if it stalls
+        while (!spsc_push(&results, &result)) {
+            struct timespec pause = { 0, 1000000 };
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+int eval_worker_start() {
+    if (worker_running) return 1;
+
+    atomic_init(&cancel_up_to, 0);
+    if (!spsc_init(&requests, EVAL_QUEUE_SIZE, sizeof(EvalRequest)) ||
+        !spsc_init(&results, EVAL_QUEUE_SIZE, sizeof(EvalResult)) ||
+        sem_init(&requests_available, 0, 0) != 0 ||
+        pthread_create(&worker, NULL, eval_worker_thread, NULL) != 0) {
+        printf("Error: Could not start the evaluation thread\n");
+        return 0;
+    }
+    worker_running = 1;
+    return 1;
+}
+
+void eval_worker_stop() {
+    if (!worker_running) return;
+
+    // Cancel whatever is running, then queue the exit request behind it
+    eval_worker_cancel();
+    EvalRequest stop = { 0, NULL, NULL };
+    while (!spsc_push(&requests, &stop)) {
+        EvalResult discarded;
+        eval_worker_poll(&discarded);
+    }
+    sem_post(&requests_available);
+    pthread_join(worker, NULL);
+
+    // Free any requests the worker never got to
+    EvalRequest request;
+    while (spsc_pop(&requests, &request)) free(request.expression);
+    spsc_destroy(&requests);
+    spsc_destroy(&results);
+    sem_destroy(&requests_available);
+    worker_running = 0;
+}
+
+unsigned eval_worker_submit(CalcContext* context, const char* expression) {
+    EvalRequest request = { next_id, strdup(expression), context };
+    if (!worker_running || request.expression == NULL || !spsc_push(&requests, &request)) {
+        free(request.expression);
+        return 0;
+    }
+    sem_post(&requests_available);
+    return next_id++;
+}
+
+int eval_worker_poll(EvalResult* result) {
+    return worker_running && spsc_pop(&results, result);
+}
+
+// Cancel everything submitted so far, like the BREAK on the real calculator
+void eval_worker_cancel() {
+    atomic_store_explicit(&cancel_up_to, next_id - 1, memory_order_relaxed);
+}
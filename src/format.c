@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "format.h"
+
+#define SHORTEST_DIGITS 17  // A double never needs more significant digits than this
+#define DOUBLE_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFull
+#define DOUBLE_EXPONENT_MASK 0x7FF0000000000000ull
+#define DOUBLE_HIDDEN_BIT 0x0010000000000000ull
+#define DOUBLE_EXPONENT_BIAS (0x3FF + 52)
+
+// A decimal number 0.digits x 10^point; zero is "0" with point 1
+typedef struct {
+    char digits[SHORTEST_DIGITS + 1];
+    int length;
+    int point;
+    int negative;
+} Decimal;
+
+// A floating point number f x 2^e with a full 64-bit significand
+typedef struct {
+    uint64_t f;
+    int e;
+} DiyFp;
+
+// Normalized 10^k for k = -348, -340, ..., 340, as significand and binary exponent
+static const uint64_t cached_significands[] = {
+    0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull,
+    0xcf42894a5dce35eaull, 0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull,
+    0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full, 0xbe5691ef416bd60cull,
+    0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+    0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull,
+    0xc21094364dfb5637ull, 0x9096ea6f3848984full, 0xd77485cb25823ac7ull,
+    0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull, 0xb23867fb2a35b28eull,
+    0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+    0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull,
+    0xb5b5ada8aaff80b8ull, 0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull,
+    0x964e858c91ba2655ull, 0xdff9772470297ebdull, 0xa6dfbd9fb8e5b88full,
+    0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+    0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull,
+    0xaa242499697392d3ull, 0xfd87b5f28300ca0eull, 0xbce5086492111aebull,
+    0x8cbccc096f5088ccull, 0xd1b71758e219652cull, 0x9c40000000000000ull,
+    0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+    0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull,
+    0x9f4f2726179a2245ull, 0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull,
+    0x83c7088e1aab65dbull, 0xc45d1df942711d9aull, 0x924d692ca61be758ull,
+    0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+    0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull,
+    0x952ab45cfa97a0b3ull, 0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull,
+    0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull, 0x88fcf317f22241e2ull,
+    0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+    0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull,
+    0x8bab8eefb6409c1aull, 0xd01fef10a657842cull, 0x9b10a4e5e9913129ull,
+    0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull, 0x80444b5e7aa7cf85ull,
+    0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+    0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull
+};
+
+static const short cached_exponents[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066
+};
+
+static const uint64_t powers_of_ten[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+    1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+    100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+    1000000000000000000ull, 10000000000000000000ull
+};
+
+// Upper 64 bits of the 128-bit product, rounded
+static DiyFp diy_multiply(DiyFp x, DiyFp y) {
+    uint64_t a = x.f >> 32, b = x.f & 0xFFFFFFFF;
+    uint64_t c = y.f >> 32, d = y.f & 0xFFFFFFFF;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t middle = (bd >> 32) + (ad & 0xFFFFFFFF) + (bc & 0xFFFFFFFF) + (1u << 31);
+    DiyFp product = {ac + (ad >> 32) + (bc >> 32) + (middle >> 32), x.e + y.e + 64};
+    return product;
+}
+
+static DiyFp diy_normalize(DiyFp x) {
+    while (!(x.f & (1ull << 63))) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+static DiyFp diy_from_double(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int biased = (int)((bits & DOUBLE_EXPONENT_MASK) >> 52);
+    DiyFp x = {bits & DOUBLE_SIGNIFICAND_MASK, 1 - DOUBLE_EXPONENT_BIAS};  // Subnormal
+    if (biased != 0) {
+        x.f += DOUBLE_HIDDEN_BIT;
+        x.e = biased - DOUBLE_EXPONENT_BIAS;
+    }
+    return x;
+}
+
+// Halfway points to the neighbouring doubles, at the same normalized exponent
+static void diy_boundaries(DiyFp v, DiyFp* minus, DiyFp* plus) {
+    DiyFp upper = {(v.f << 1) + 1, v.e - 1};
+    DiyFp lower = {(v.f << 1) - 1, v.e - 1};
+    if (v.f == DOUBLE_HIDDEN_BIT) {  // Powers of two have a closer neighbour below
+        lower.f = (v.f << 2) - 1;
+        lower.e = v.e - 2;
+    }
+    upper = diy_normalize(upper);
+    lower.f <<= lower.e - upper.e;
+    lower.e = upper.e;
+    *minus = lower;
+    *plus = upper;
+}
+
+// The cached power 10^-k that brings a number with binary exponent e into [2^-60, 2^-32) x 2^64
+static DiyFp cached_power(int e, int* k) {
+    double estimate = (-61 - e) * 0.30102999566398114 + 347;  // log10(2)
+    int rounded = (int)estimate;
+    if (estimate - rounded > 0.0) rounded++;
+    int index = (rounded >> 3) + 1;
+    *k = 348 - index * 8;
+    DiyFp power = {cached_significands[index], cached_exponents[index]};
+    return power;
+}
+
+static int count_digits(uint32_t n) {
+    int digits = 1;
+    while (digits < 10 && n >= powers_of_ten[digits]) digits++;
+    return digits;
+}
+
+// Nudge the last digit down while that moves the result closer to w, then check that the digits are
+// certainly the closest shortest ones despite the error of up to unit in the scaled products. Returns
+// 0 when they may not be.
+static int round_weed(char* buffer, int length, uint64_t distance_too_high_w, uint64_t unsafe_interval,
+                      uint64_t rest, uint64_t ten_kappa, uint64_t unit) {
+    uint64_t small_distance = distance_too_high_w - unit;  // To w's upper bound and to its lower bound
+    uint64_t big_distance = distance_too_high_w + unit;
+    while (rest < small_distance && unsafe_interval - rest >= ten_kappa &&
+           (rest + ten_kappa < small_distance || small_distance - rest >= rest + ten_kappa - small_distance)) {
+        buffer[length - 1]--;
+        rest += ten_kappa;
+    }
+    if (rest < big_distance && unsafe_interval - rest >= ten_kappa &&
+        (rest + ten_kappa < big_distance || big_distance - rest > rest + ten_kappa - big_distance)) {
+        return 0;  // The next lower digit may be closer
+    }
+    return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;  // Inside the rounding interval for sure
+}
+
+// Generate the fewest digits of the interval (low, high) around w, widened by the products' error.
+// Returns 0 if they cannot be shown to be the shortest and closest, or to lie inside the interval.
+static int generate_digits(DiyFp low, DiyFp w, DiyFp high, char* buffer, int* length, int* k) {
+    uint64_t unit = 1;
+    DiyFp too_low = {low.f - unit, low.e};
+    DiyFp too_high = {high.f + unit, high.e};
+    uint64_t unsafe_interval = too_high.f - too_low.f;
+    DiyFp one = {1ull << -w.e, w.e};
+    uint32_t integral = (uint32_t)(too_high.f >> -one.e);
+    uint64_t fraction = too_high.f & (one.f - 1);
+    int kappa = count_digits(integral);
+    *length = 0;
+
+    while (kappa > 0) {
+        uint32_t digit = (uint32_t)(integral / powers_of_ten[kappa - 1]);
+        integral %= (uint32_t)powers_of_ten[kappa - 1];
+        if (digit || *length) buffer[(*length)++] = (char)('0' + digit);
+        kappa--;
+        uint64_t rest = ((uint64_t)integral << -one.e) + fraction;
+        if (rest < unsafe_interval) {
+            *k += kappa;
+            return *length > 0 && round_weed(buffer, *length, too_high.f - w.f, unsafe_interval, rest,
+                                              powers_of_ten[kappa] << -one.e, unit);
+        }
+    }
+    for (;;) {
+        fraction *= 10;
+        unit *= 10;
+        unsafe_interval *= 10;
+        char digit = (char)(fraction >> -one.e);
+        if (*length == SHORTEST_DIGITS) return 0;
+        if (digit || *length) buffer[(*length)++] = (char)('0' + digit);
+        fraction &= one.f - 1;
+        kappa--;
+        if (fraction < unsafe_interval) {
+            *k += kappa;
+            return *length > 0 && round_weed(buffer, *length, (too_high.f - w.f) * unit, unsafe_interval, fraction,
+                                              one.f, unit);
+        }
+    }
+}
+
+// The rare values Grisu3 cannot decide: the fewest digits that printf, which rounds exactly, gives
+// back as the value. A digit more never hurts, so search for the count.
+static void decimal_shortest_exact(double value, Decimal* decimal) {
+    char text[32];
+    int lo = 1, hi = SHORTEST_DIGITS;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        snprintf(text, sizeof(text), "%.*e", mid - 1, value);
+        if (strtod(text, NULL) == value) hi = mid; else lo = mid + 1;
+    }
+    snprintf(text, sizeof(text), "%.*e", lo - 1, fabs(value));  // d.ddde+XX
+    decimal->length = 0;
+    char* c = text;
+    for (; *c != 'e'; c++) {
+        if (*c != '.') decimal->digits[decimal->length++] = *c;
+    }
+    decimal->point = atoi(c + 1) + 1;
+    while (decimal->length > 1 && decimal->digits[decimal->length - 1] == '0') decimal->length--;
+}
+
+// Grisu3 (Loitsch, "Printing floating-point numbers quickly and accurately with integers"): Grisu2's
+// digit generation with a check that the digits are the shortest, which fails for about 0.5% of
+// doubles; those are done exactly
+static void decimal_shortest(double value, Decimal* decimal) {
+    decimal->negative = value < 0;
+    if (value == 0) {
+        decimal->digits[0] = '0';
+        decimal->length = 1;
+        decimal->point = 1;
+        return;
+    }
+
+    DiyFp v = diy_from_double(fabs(value));
+    DiyFp minus, plus;
+    diy_boundaries(v, &minus, &plus);
+    int k;
+    DiyFp power = cached_power(plus.e, &k);
+    DiyFp w = diy_multiply(diy_normalize(v), power);
+    DiyFp high = diy_multiply(plus, power);
+    DiyFp low = diy_multiply(minus, power);
+    if (generate_digits(low, w, high, decimal->digits, &decimal->length, &k)) {
+        decimal->point = decimal->length + k;
+    } else {
+        decimal_shortest_exact(value, decimal);
+    }
+}
+
+static void decimal_zero(Decimal* decimal) {
+    decimal->digits[0] = '0';
+    decimal->length = 1;
+    decimal->point = 1;
+    decimal->negative = 0;
+}
+
+// Round half up to keep significant digits, dropping trailing zeros
+static void decimal_round(Decimal* decimal, int keep) {
+    if (keep < 0) {
+        decimal_zero(decimal);
+        return;
+    }
+    if (keep < decimal->length) {
+        int up = decimal->digits[keep] >= '5';
+        decimal->length = keep;
+        if (up) {
+            int i = keep - 1;
+            while (i >= 0 && decimal->digits[i] == '9') i--;
+            if (i < 0) {  // 999.6 -> 1000
+                decimal->digits[0] = '1';
+                decimal->length = 1;
+                decimal->point++;
+            } else {
+                decimal->digits[i]++;
+                decimal->length = i + 1;
+            }
+        }
+    }
+    while (decimal->length > 0 && decimal->digits[decimal->length - 1] == '0') decimal->length--;
+    if (decimal->length == 0) decimal_zero(decimal);
+}
+
+// Write the digits with the decimal point in place; decimals < 0 writes every remaining digit
+static char* write_positional(const Decimal* decimal, int decimals, int leading_zero, char* out) {
+    if (decimal->negative) *out++ = '-';
+    if (decimal->point > 0) {
+        for (int i = 0; i < decimal->point; i++) {
+            *out++ = i < decimal->length ? decimal->digits[i] : '0';
+        }
+    } else if (leading_zero) {
+        *out++ = '0';
+    }
+
+    int fraction = decimals >= 0 ? decimals : decimal->length - decimal->point;
+    if (fraction > 0) {
+        *out++ = '.';
+        for (int j = 0; j < fraction; j++) {
+            int i = decimal->point + j;
+            *out++ = i >= 0 && i < decimal->length ? decimal->digits[i] : '0';
+        }
+    }
+    *out = '\0';
+    return out;
+}
+
+static int floor_to_multiple_of_3(int exponent) {
+    return exponent >= 0 ? exponent - exponent % 3 : -((2 - exponent) / 3) * 3;
+}
+
+// d.dddEn, or with 1 to 3 integer digits and an exponent that is a multiple of 3 for ENG
+static void write_exponential(const Decimal* decimal, int fix, int digits, int engineering, char* out) {
+    Decimal rounded = *decimal;
+    int exponent = decimal->point - 1;
+    int integer_digits = engineering ? exponent - floor_to_multiple_of_3(exponent) + 1 : 1;
+
+    decimal_round(&rounded, fix == CALC_FLOAT || integer_digits + fix > digits ? digits : integer_digits + fix);
+    if (rounded.point != decimal->point) {  // Rounded up to the next power of ten
+        exponent = rounded.point - 1;
+        integer_digits = engineering ? exponent - floor_to_multiple_of_3(exponent) + 1 : 1;
+    }
+
+    int decimals = fix == CALC_FLOAT ? -1 : (fix < digits - integer_digits ? fix : digits - integer_digits);
+    rounded.point = integer_digits;
+    char* end = write_positional(&rounded, decimals < -1 ? 0 : decimals, 0, out);
+    sprintf(end, "E%d", exponent - integer_digits + 1);
+}
+
+int format_shortest(double value, char* out) {
+    if (isnan(value)) return sprintf(out, "nan");
+    if (isinf(value)) return sprintf(out, value < 0 ? "-inf" : "inf");
+
+    Decimal decimal;
+    decimal_shortest(value, &decimal);
+    int exponent = decimal.point - 1;
+    if (exponent > -7 && exponent < 21) {
+        return (int)(write_positional(&decimal, -1, 1, out) - out);
+    }
+
+    char* end = out;
+    if (decimal.negative) *end++ = '-';
+    *end++ = decimal.digits[0];
+    if (decimal.length > 1) {
+        *end++ = '.';
+        memcpy(end, decimal.digits + 1, decimal.length - 1);
+        end += decimal.length - 1;
+    }
+    return (int)(end - out) + sprintf(end, "E%d", exponent);
+}
+
+int format_number(const CalcContext* context, double value, int digits, char* out) {
+    if (isnan(value)) {
+        strcpy(out, "ERROR");
+        return 0;
+    }
+    if (isinf(value)) {
+        strcpy(out, "ERR:OVERFLOW");
+        return 0;
+    }
+
+    Decimal decimal;
+    int fix = context->fix_digits;
+    decimal_shortest(value, &decimal);
+    if (context->notation != NOTATION_NORMAL) {
+        write_exponential(&decimal, fix, digits, context->notation == NOTATION_ENG, out);
+        return 1;
+    }
+
+    // NORMAL: positional unless that needs more digits than fit, more than 3 leading zeros,
+    // or more decimals than FIX shows (.001 in FIX 2 is 1.00E-3, not .00)
+    Decimal rounded = decimal;
+    decimal_round(&rounded, fix == CALC_FLOAT || decimal.point + fix > digits ? digits : decimal.point + fix);
+    int exponent = rounded.point - 1;
+    int vanished = value != 0 && rounded.length == 1 && rounded.digits[0] == '0';
+    if (vanished || exponent >= digits || exponent < -3) {
+        write_exponential(&decimal, fix, digits, 0, out);
+        return 1;
+    }
+    int decimals = fix == CALC_FLOAT ? -1 : (fix < digits - rounded.point ? fix : digits - rounded.point);
+    write_positional(&rounded, decimals < -1 ? 0 : decimals, 0, out);
+    return 1;
+}
+
+int format_fraction(Rational value, char* out) {
+    char text[48];
+    int length = value.den == 1 ? sprintf(text, "%lld", (long long)value.num)
+                                : sprintf(text, "%lld/%lld", (long long)value.num, (long long)value.den);
+    if (length >= FORMAT_LENGTH) return 0;
+    memcpy(out, text, length + 1);
+    return length;
+}
+
+int format_complex(const CalcContext* context, double re, double im, int digits, char* out) {
+    if (isnan(re) || isnan(im)) return format_number(context, NAN, digits, out);
+    if (isinf(re) || isinf(im)) return format_number(context, INFINITY, digits, out);
+
+    char first[FORMAT_LENGTH], second[FORMAT_LENGTH];
+    if (context->complex_mode == COMPLEX_POLAR) {
+        double magnitude = hypot(re, im), angle = atan2(im, re);
+        if (magnitude == 0 || angle == 0) return format_number(context, magnitude, digits, out);
+        format_number(context, magnitude, digits, first);
+        format_number(context, angle, digits, second);
+        sprintf(out, "%se^(%si)", strcmp(first, "1") == 0 ? "" : first, second);
+        return 1;
+    }
+
+    if (im == 0) return format_number(context, re, digits, out);
+    format_number(context, fabs(im), digits, second);
+    const char* coefficient = strcmp(second, "1") == 0 ? "" : second;  // 1i is written i
+    if (re == 0) {
+        sprintf(out, "%s%si", im < 0 ? "-" : "", coefficient);
+    } else {
+        format_number(context, re, digits, first);
+        sprintf(out, "%s%c%si", first, im < 0 ? '-' : '+', coefficient);
+    }
+    return 1;
+}
@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "graph.h"
+#include "interval.h"
+#include "graph_cache.h"
+#include "profiler.h"
+#include "optimizer.h"
+
+char graph_functions[GRAPH_MAX_FUNCTIONS][GRAPH_EXPRESSION_LENGTH] = {""};
+GraphView graph_view = { 0, -140, -65, 20.0 / 280, 20.0 / 130 };  // ZStandard on a 280x130 area
+Sequences graph_sequences = SEQUENCES_INITIALIZER;
+
+static Program graph_programs[GRAPH_MAX_FUNCTIONS];
+static int graph_program_state[GRAPH_MAX_FUNCTIONS] = {0};  // 0 = not compiled yet, 1 = valid, -1 = syntax error
+static unsigned long graph_program_reads[GRAPH_MAX_FUNCTIONS];  // Variables each compiled program reads
+static int graph_program_terms[GRAPH_MAX_FUNCTIONS];  // The compiled program calls u, v or w
+static unsigned graph_sequences_version;  // Version of the sequences the cached tiles were sampled with
+static CalcContext graph_context = { ANGLE_DEGREE, NOTATION_NORMAL, CALC_FLOAT, COMPLEX_REAL, &graph_sequences };  // Same as calc_context_init
+
+// Store an expression into a Y= slot; it is compiled the next time it is graphed
+void graph_set_function(int slot, const char* expression) {
+    if (slot < 0 || slot >= GRAPH_MAX_FUNCTIONS) return;
+
+    strncpy(graph_functions[slot], expression, GRAPH_EXPRESSION_LENGTH - 1);
+    graph_functions[slot][GRAPH_EXPRESSION_LENGTH - 1] = '\0';
+    graph_program_state[slot] = 0;
+    graph_cache_drop_slot(slot);
+}
+
+const Program* graph_get_program(int slot) {
+    if (slot < 0 || slot >= GRAPH_MAX_FUNCTIONS || graph_functions[slot][0] == '\0') return NULL;
+
+    if (graph_program_state[slot] == 0) {
+        graph_program_state[slot] = compile_expression(graph_functions[slot], &graph_programs[slot]) ? 1 : -1;
+        if (graph_program_state[slot] < 0) {
+            printf("Y%d has a syntax error and will not be graphed\n", (slot + 1) % 10);
+        } else {
+            optimize_program(&graph_context, &graph_programs[slot]);  // Evaluated thousands of times
+            graph_program_reads[slot] = program_variables_read(&graph_programs[slot]);
+            graph_program_terms[slot] = 0;
+            for (int i = 0; i < graph_programs[slot].length; i++) {
+                const Token* token = &graph_programs[slot].tokens[i];
+                if (token->type == TOKEN_FUNCTION && is_sequence_function(token->func)) graph_program_terms[slot] = 1;
+            }
+        }
+    }
+    return graph_program_state[slot] > 0 ? &graph_programs[slot] : NULL;
+}
+
+// Cached tiles hold values computed in the old modes, so drop them when the angle changes, and a
+// function's tiles when a variable it reads changes: Ans changes on nearly every ENTER, and most
+// functions never read it. Programs are optimized for an angle mode (constants like sin(30) are
+// folded), so recompile those too.
+void graph_set_context(const CalcContext* context) {
+    if (context->angle != graph_context.angle) {
+        memset(graph_program_state, 0, sizeof(graph_program_state));
+        graph_cache_clear();
+    } else {
+        unsigned long changed = 0;
+        for (int v = 0; v < CALC_TERMS; v++) {
+            if (memcmp(&context->variables[v], &graph_context.variables[v], sizeof(double)) != 0 ||
+                memcmp(&context->imaginary[v], &graph_context.imaginary[v], sizeof(double)) != 0) {
+                changed |= 1ul << v;
+            }
+        }
+        for (int slot = 0; changed != 0 && slot < GRAPH_MAX_FUNCTIONS; slot++) {
+            // Slots not compiled since they last changed have no tiles
+            if (graph_program_state[slot] > 0 && (graph_program_reads[slot] & changed) != 0) {
+                graph_cache_drop_slot(slot);
+            }
+        }
+    }
+    calc_context_copy_modes(&graph_context, context);
+}
+
+const CalcContext* graph_get_context() {
+    return &graph_context;
+}
+
+// ZStandard: -10..10 on both axes
+void graph_reset_view(int width, int height) {
+    graph_view.zoom = 0;
+    graph_view.base_dx = 20.0 / width;
+    graph_view.base_dy = 20.0 / height;
+    graph_view.column = -width / 2;
+    graph_view.row = -height / 2;
+}
+
+double graph_pixel_width(const GraphView* view) {
+    return ldexp(view->base_dx, -view->zoom);
+}
+
+double graph_pixel_height(const GraphView* view) {
+    return ldexp(view->base_dy, -view->zoom);
+}
+
+GraphWindow graph_view_window(const GraphView* view, int width, int height) {
+    double dx = graph_pixel_width(view), dy = graph_pixel_height(view);
+    GraphWindow window = { view->column * dx, (view->column + width) * dx,
+                           -(view->row + height) * dy, -view->row * dy };
+    return window;
+}
+
+void graph_pan(long columns, long rows) {
+    graph_view.column += columns;
+    graph_view.row += rows;
+}
+
+// Zoom around a pixel of the graph area, keeping that pixel's global position under it
+void graph_zoom(int steps, int center_x, int center_y) {
+    for (; steps > 0 && graph_view.zoom < GRAPH_MAX_ZOOM; steps--) {
+        graph_view.column = (graph_view.column + center_x) * 2 - center_x;
+        graph_view.row = (graph_view.row + center_y) * 2 - center_y;
+        graph_view.zoom++;
+    }
+    for (; steps < 0 && graph_view.zoom > GRAPH_MIN_ZOOM; steps++) {
+        graph_view.column = floor((graph_view.column + center_x) / 2.0) - center_x;
+        graph_view.row = floor((graph_view.row + center_y) / 2.0) - center_y;
+        graph_view.zoom--;
+    }
+}
+
+static long floor_div(long a, long b) {
+    long q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+// Record a continuous piece over tile columns [col_lo, col_hi)
+static void add_piece(GraphTile* tile, double col_lo, double col_hi, Interval y) {
+    int first = (int)floor(col_lo);
+    int last = (int)ceil(col_hi) - 1;
+    for (int column = first; column <= last; column++) {
+        int full = col_lo <= column && col_hi >= column + 1;
+        graph_tile_add_range(tile, column, y.lo, y.hi, full);
+    }
+}
+
+// Sample tile columns [col_lo, col_hi), subdividing only where the range is uncertain.
+// The result does not depend on the vertical position of the view, only on the pixel size.
+static void sample_range(const Program* program, double dx, double dy, long first_column,
+                         double col_lo, double col_hi, GraphTile* tile, GraphPlot* plot) {
+    Interval x = make_interval((first_column + col_lo) * dx, (first_column + col_hi) * dx);
+    Interval y = run_program_interval(&graph_context, program, x);
+    plot->interval_evaluations++;
+
+    if (y.empty) return;  // Undefined everywhere here
+
+    double rows = (y.hi - y.lo) / dy;
+    double columns = col_hi - col_lo;
+
+    // A continuous piece is recorded as soon as it is one pixel tall, or one pixel wide:
+    // within a single column a continuous function covers its whole range anyway.
+    if (y.continuous && (rows <= 1.0 || columns <= 1.0)) {
+        add_piece(tile, col_lo, col_hi, y);
+        return;
+    }
+
+    // A possible discontinuity narrowed down below the sub-pixel limit is left as a gap,
+    // so asymptotes don't turn into false vertical lines
+    if (!y.continuous && columns <= 1.0 / (1 << GRAPH_SUBPIXEL_DEPTH)) return;
+
+    if (!y.continuous || columns <= 1.0) {
+        // Bisect to home in on the discontinuity
+        double mid = columns > 1.0 ? floor(col_lo + columns / 2) : col_lo + columns / 2;
+        sample_range(program, dx, dy, first_column, col_lo, mid, tile, plot);
+        sample_range(program, dx, dy, first_column, mid, col_hi, tile, plot);
+        return;
+    }
+
+    // A tall continuous piece: split it into roughly one piece per pixel of height,
+    // on column boundaries, instead of bisecting level by level
+    int pieces = (int)fmin(ceil(rows), columns);
+    if (pieces < 2) pieces = 2;
+    double start = col_lo;
+    for (int i = 1; i <= pieces; i++) {
+        double end = i == pieces ? col_hi : col_lo + floor(columns * i / pieces);
+        if (end > start) {
+            sample_range(program, dx, dy, first_column, start, end, tile, plot);
+            start = end;
+        }
+    }
+}
+
+// Sample tile columns [col_lo, col_hi) of a program that calls u, v or w one column at a time. Terms
+// exist only at whole numbers, so sample_range would narrow them down to gaps; here a column shows
+// the terms its range holds, and the continuous parts of the program as usual.
+static void sample_columns(const Program* program, double dx, long first_column, int col_lo, int col_hi,
+                           GraphTile* tile, GraphPlot* plot) {
+    for (int column = col_lo; column < col_hi; column++) {
+        // Half open, so a term on the boundary of two columns shows in one
+        Interval x = make_interval((first_column + column) * dx, nextafter((first_column + column + 1) * dx, -INFINITY));
+        Interval y = run_program_interval(&graph_context, program, x);
+        plot->interval_evaluations++;
+        if (y.empty || !isfinite(y.lo) || !isfinite(y.hi)) continue;  // No term here, or too many to tell
+        graph_tile_add_range(tile, column, y.lo, y.hi, y.continuous);
+    }
+}
+
+// The parent tile's range for a global column at the next zoom level, if it can stand in
+// for a fresh sample: it must cover the whole parent column and be within a pixel at the new size
+static const GraphRange* reusable_range(const GraphTile* parent, long column, double dy) {
+    if (parent == NULL) return NULL;
+    int local = (int)(floor_div(column, 2) - parent->tile_x * GRAPH_TILE_COLUMNS);
+    if (parent->column_start[local + 1] - parent->column_start[local] != 1) return NULL;
+
+    const GraphRange* range = &parent->ranges[parent->column_start[local]];
+    return range->full_column && range->hi - range->lo <= dy ? range : NULL;
+}
+
+// Sample one tile, reusing the parent tile (one zoom level out) where it is precise enough
+static GraphTile* compute_tile(int slot, const Program* program, long tile_x, GraphPlot* plot) {
+    double dx = graph_pixel_width(&graph_view), dy = graph_pixel_height(&graph_view);
+    long first_column = tile_x * GRAPH_TILE_COLUMNS;
+
+    GraphTile* tile = graph_tile_create(slot, graph_view.zoom, tile_x);
+    if (tile == NULL) return NULL;
+    GraphTile* parent = graph_cache_lookup(slot, graph_view.zoom - 1, floor_div(tile_x, 2));
+
+    int column = 0;
+    while (column < GRAPH_TILE_COLUMNS) {
+        const GraphRange* range = reusable_range(parent, first_column + column, dy);
+        if (range != NULL) {
+            graph_tile_add_range(tile, column, range->lo, range->hi, 1);
+            plot->columns_reused++;
+            column++;
+            continue;
+        }
+
+        // Sample the run of columns the parent can't answer in one go
+        int end = column + 1;
+        while (end < GRAPH_TILE_COLUMNS && reusable_range(parent, first_column + end, dy) == NULL) end++;
+        if (graph_program_terms[slot]) {
+            sample_columns(program, dx, first_column, column, end, tile, plot);
+        } else {
+            sample_range(program, dx, dy, first_column, column, end, tile, plot);
+        }
+        column = end;
+    }
+
+    graph_tile_finish(tile);
+    graph_cache_insert(tile);
+    plot->tiles_computed++;
+    return tile;
+}
+
+static GraphTile* get_tile(int slot, const Program* program, long tile_x, GraphPlot* plot) {
+    GraphTile* tile = graph_cache_lookup(slot, graph_view.zoom, tile_x);
+    if (tile != NULL) {
+        plot->tiles_cached++;
+        return tile;
+    }
+    return compute_tile(slot, program, tile_x, plot);
+}
+
+static void add_span(GraphPlot* plot, int x0, int x1, int y0, int y1) {
+    if (plot->count == plot->capacity) {
+        int capacity = plot->capacity ? plot->capacity * 2 : 256;
+        GraphSpan* spans = realloc(plot->spans, capacity * sizeof(GraphSpan));
+        if (spans == NULL) return;  // Out of memory: drop the span rather than crash
+        plot->spans = spans;
+        plot->capacity = capacity;
+    }
+    GraphSpan* span = &plot->spans[plot->count++];
+    span->x0 = x0;
+    span->x1 = x1;
+    span->y0 = y0;
+    span->y1 = y1;
+}
+
+// Turn the cached ranges of a tile into pixel spans for the visible columns
+static void draw_tile(const GraphTile* tile, int width, int height, GraphPlot* plot) {
+    double dy = graph_pixel_height(&graph_view);
+    long first_column = tile->tile_x * GRAPH_TILE_COLUMNS;
+
+    for (int column = 0; column < GRAPH_TILE_COLUMNS; column++) {
+        long x = first_column + column - graph_view.column;
+        if (x < 0 || x >= width) continue;
+
+        for (int r = tile->column_start[column]; r < tile->column_start[column + 1]; r++) {
+            double row_top = -tile->ranges[r].hi / dy - graph_view.row;
+            double row_bottom = -tile->ranges[r].lo / dy - graph_view.row;
+            if (row_bottom < 0 || row_top >= height) continue;  // Above or below the window
+
+            int y0 = row_top < 0 ? 0 : (int)row_top;
+            int y1 = row_bottom >= height ? height - 1 : (int)row_bottom;
+            add_span(plot, x, x, y0, y1);
+        }
+    }
+}
+
+// Plot every defined Y= function for the current view
+void graph_render(int width, int height, GraphPlot* plot) {
+    PROFILE_SCOPE("graph_render");
+    graph_clear_plot(plot);
+
+    long first_tile = floor_div(graph_view.column, GRAPH_TILE_COLUMNS);
+    long last_tile = floor_div(graph_view.column + width - 1, GRAPH_TILE_COLUMNS);
+
+    // Tiles of functions that call u, v or w are stale once the sequences change
+    unsigned version = graph_context.sequences != NULL ? atomic_load(&graph_context.sequences->version) : 0;
+    if (version != graph_sequences_version) {
+        for (int slot = 0; slot < GRAPH_MAX_FUNCTIONS; slot++) {
+            if (graph_program_state[slot] > 0 && graph_program_terms[slot]) graph_cache_drop_slot(slot);
+        }
+        graph_sequences_version = version;
+    }
+
+    for (int i = 0; i < GRAPH_MAX_FUNCTIONS; i++) {
+        const Program* program = graph_get_program(i);
+        if (program == NULL) continue;
+
+        for (long tile_x = first_tile; tile_x <= last_tile; tile_x++) {
+            GraphTile* tile = get_tile(i, program, tile_x, plot);
+            if (tile != NULL) draw_tile(tile, width, height, plot);
+        }
+        plot->uniform_evaluations += width;
+    }
+
+    if (plot->tiles_computed > 0) {
+        printf("Graph: %d tiles sampled with %ld interval evaluations (uniform sampling: %ld), "
+               "%d tiles cached, %d columns reused from the previous zoom level\n",
+               plot->tiles_computed, plot->interval_evaluations, plot->uniform_evaluations,
+               plot->tiles_cached, plot->columns_reused);
+    }
+}
+
+// Fill in a tile's TRACE values, taking the even columns from the parent tile when it has them
+static void compute_trace_values(GraphTile* tile, const Program* program) {
+    double dx = graph_pixel_width(&graph_view);
+    long first_column = tile->tile_x * GRAPH_TILE_COLUMNS;
+    GraphTile* parent = graph_cache_lookup(tile->slot, tile->zoom - 1, floor_div(tile->tile_x, 2));
+
+    for (int column = 0; column < GRAPH_TILE_COLUMNS; column++) {
+        long global = first_column + column;
+        if (parent != NULL && parent->trace_ready && global % 2 == 0) {
+            tile->trace_values[column] = parent->trace_values[global / 2 - parent->tile_x * GRAPH_TILE_COLUMNS];
+        } else {
+            tile->trace_values[column] = run_program(&graph_context, program, global * dx);
+        }
+    }
+    tile->trace_ready = 1;
+}
+
+// Value of a function at the left edge of a graph-area column, read from the tile cache
+int graph_trace(int slot, int column, double* x, double* y) {
+    const Program* program = graph_get_program(slot);
+    if (program == NULL) return 0;
+
+    GraphPlot scratch = {0};
+    long global = graph_view.column + column;
+    GraphTile* tile = get_tile(slot, program, floor_div(global, GRAPH_TILE_COLUMNS), &scratch);
+    if (tile == NULL) return 0;
+    if (!tile->trace_ready) compute_trace_values(tile, program);
+
+    *x = global * graph_pixel_width(&graph_view);
+    *y = tile->trace_values[global - tile->tile_x * GRAPH_TILE_COLUMNS];
+    return 1;
+}
+
+void graph_clear_plot(GraphPlot* plot) {
+    plot->count = 0;
+    plot->interval_evaluations = 0;
+    plot->uniform_evaluations = 0;
+    plot->tiles_computed = 0;
+    plot->tiles_cached = 0;
+    plot->columns_reused = 0;
+}
+
+void graph_free_plot(GraphPlot* plot) {
+    free(plot->spans);
+    plot->spans = NULL;
+    plot->count = 0;
+    plot->capacity = 0;
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "graph_cache.h"
+
+#define GRAPH_CACHE_BUCKETS 1024
+
+static GraphTile* buckets[GRAPH_CACHE_BUCKETS] = {NULL};
+static GraphTile* order_head = NULL;  // Kept longest
+static GraphTile* order_tail = NULL;  // Evicted first
+static size_t cache_bytes = 0;
+static size_t cache_max_bytes = GRAPH_CACHE_DEFAULT_BYTES;
+static GraphCachePolicy cache_policy = GRAPH_CACHE_LRU;
+static int cache_tiles = 0;
+
+static unsigned bucket_of(int slot, int zoom, long tile_x) {
+    unsigned long h = (unsigned long)tile_x * 2654435761u;
+    h ^= (unsigned long)(zoom + 64) * 40503u;
+    h ^= (unsigned long)slot * 97u;
+    return (unsigned)(h % GRAPH_CACHE_BUCKETS);
+}
+
+static void order_unlink(GraphTile* tile) {
+    if (tile->prev) tile->prev->next = tile->next; else order_head = tile->next;
+    if (tile->next) tile->next->prev = tile->prev; else order_tail = tile->prev;
+    tile->prev = tile->next = NULL;
+}
+
+static void order_push_head(GraphTile* tile) {
+    tile->prev = NULL;
+    tile->next = order_head;
+    if (order_head) order_head->prev = tile; else order_tail = tile;
+    order_head = tile;
+}
+
+// Unlink a tile from the hash table and eviction order, and free it
+static void remove_tile(GraphTile* tile) {
+    GraphTile** link = &buckets[bucket_of(tile->slot, tile->zoom, tile->tile_x)];
+    while (*link != tile) link = &(*link)->hash_next;
+    *link = tile->hash_next;
+
+    order_unlink(tile);
+    cache_bytes -= tile->bytes;
+    cache_tiles--;
+    graph_tile_free(tile);
+}
+
+// Evict from the tail until within budget, sparing one tile
+static void evict(const GraphTile* keep) {
+    while (cache_bytes > cache_max_bytes && order_tail != NULL) {
+        GraphTile* victim = order_tail;
+        if (victim == keep) {
+            if (victim->prev == NULL) break;  // Only the kept tile is left
+            victim = victim->prev;
+        }
+        remove_tile(victim);
+    }
+}
+
+void graph_cache_configure(size_t max_bytes, GraphCachePolicy policy) {
+    cache_max_bytes = max_bytes;
+    cache_policy = policy;
+    evict(NULL);
+    printf("Graph cache: %zu KB budget, %s eviction\n", max_bytes / 1024, policy == GRAPH_CACHE_LRU ? "LRU" : "FIFO");
+}
+
+GraphTile* graph_cache_lookup(int slot, int zoom, long tile_x) {
+    for (GraphTile* tile = buckets[bucket_of(slot, zoom, tile_x)]; tile != NULL; tile = tile->hash_next) {
+        if (tile->slot == slot && tile->zoom == zoom && tile->tile_x == tile_x) {
+            if (cache_policy == GRAPH_CACHE_LRU && tile != order_head) {
+                order_unlink(tile);
+                order_push_head(tile);
+            }
+            return tile;
+        }
+    }
+    return NULL;
+}
+
+void graph_cache_insert(GraphTile* tile) {
+    unsigned bucket = bucket_of(tile->slot, tile->zoom, tile->tile_x);
+    tile->hash_next = buckets[bucket];
+    buckets[bucket] = tile;
+    order_push_head(tile);
+    cache_bytes += tile->bytes;
+    cache_tiles++;
+    evict(tile);
+}
+
+GraphTile* graph_tile_create(int slot, int zoom, long tile_x) {
+    GraphTile* tile = calloc(1, sizeof(GraphTile));
+    if (tile == NULL) return NULL;
+    tile->slot = slot;
+    tile->zoom = zoom;
+    tile->tile_x = tile_x;
+    tile->bytes = sizeof(GraphTile);
+    return tile;
+}
+
+void graph_tile_add_range(GraphTile* tile, int column, double lo, double hi, int full_column) {
+    if (tile->range_count == tile->range_capacity) {
+        int capacity = tile->range_capacity ? tile->range_capacity * 2 : GRAPH_TILE_COLUMNS;
+        GraphRange* ranges = realloc(tile->ranges, capacity * sizeof(GraphRange));
+        if (ranges == NULL) return;  // Out of memory: the column is drawn with a gap
+        tile->ranges = ranges;
+        tile->range_capacity = capacity;
+    }
+    GraphRange* range = &tile->ranges[tile->range_count++];
+    range->lo = lo;
+    range->hi = hi;
+    range->column = column;
+    range->full_column = full_column;
+}
+
+// Index the ranges by column and settle the tile's size
+void graph_tile_finish(GraphTile* tile) {
+    int r = 0;
+    for (int column = 0; column <= GRAPH_TILE_COLUMNS; column++) {
+        while (r < tile->range_count && tile->ranges[r].column < column) r++;
+        tile->column_start[column] = r;
+    }
+    tile->bytes = sizeof(GraphTile) + tile->range_capacity * sizeof(GraphRange);
+}
+
+void graph_tile_free(GraphTile* tile) {
+    if (tile == NULL) return;
+    free(tile->ranges);
+    free(tile);
+}
+
+void graph_cache_drop_slot(int slot) {
+    GraphTile* tile = order_head;
+    while (tile != NULL) {
+        GraphTile* next = tile->next;
+        if (tile->slot == slot) remove_tile(tile);
+        tile = next;
+    }
+}
+
+void graph_cache_clear() {
+    while (order_head != NULL) remove_tile(order_head);
+}
+
+size_t graph_cache_bytes() {
+    return cache_bytes;
+}
+
+int graph_cache_tile_count() {
+    return cache_tiles;
+}
@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "input_log.h"
+#include "profiler.h"
+
+#define INPUT_LOG_HEADER "# ti84 input log v"
+#define INPUT_LOG_VERSION 2  // v2 marks where each evaluation result was shown
+
+// One recorded event, stamped with the frame that polled it and the time since recording began
+typedef struct {
+    long frame;
+    Uint32 time;
+    SDL_Event event;
+    int result;  // Not an event: the result of the running evaluation was shown here
+} LoggedEvent;
+
+static FILE* record_file = NULL;
+static Uint32 record_start = 0;
+
+static LoggedEvent* replay_events = NULL;
+static int replay_count = 0;
+static int replay_next = 0;
+static int replay_active = 0;
+static int replay_fast = 0;
+static int replay_markers = 0;     // The log marks results; a v1 log holds all input during an evaluation instead
+static long replay_frame = -1;     // Recorded frame whose events are being replayed (full speed)
+static uint64_t replay_started = 0;
+static Uint32 replay_start_ticks = 0;
+
+static double* latencies = NULL;   // Milliseconds from delivering each event to the end of its frame
+static uint64_t* delivered = NULL; // When each event of the current frame was delivered
+static int latency_count = 0;
+static int frame_first = 0;        // First event delivered during the current frame
+
+static long current_frame = 0;
+
+int input_log_record(const char* path) {
+    record_file = fopen(path, "w");
+    if (record_file == NULL) {
+        printf("Could not open %s\n", path);
+        return 0;
+    }
+    fprintf(record_file, "%s%d\n", INPUT_LOG_HEADER, INPUT_LOG_VERSION);
+    record_start = SDL_GetTicks();
+    return 1;
+}
+
+static void log_event(const SDL_Event* event) {
+    Uint32 time = SDL_GetTicks() - record_start;
+    if (event->type == SDL_KEYDOWN) {
+        fprintf(record_file, "%ld %u key %d\n", current_frame, time, (int)event->key.keysym.sym);
+    } else if (event->type == SDL_MOUSEBUTTONDOWN) {
+        fprintf(record_file, "%ld %u click %d %d\n", current_frame, time, event->button.x, event->button.y);
+    } else if (event->type == SDL_QUIT) {
+        fprintf(record_file, "%ld %u quit\n", current_frame, time);
+    }
+}
+
+int input_log_replay(const char* path, int full_speed) {
+    FILE* file = fopen(path, "r");
+    char line[128];
+    int capacity = 0, version = 0;
+
+    if (file == NULL) {
+        printf("Could not open %s\n", path);
+        return 0;
+    }
+    if (fgets(line, sizeof(line), file) == NULL || sscanf(line, INPUT_LOG_HEADER "%d", &version) != 1 ||
+        version < 1 || version > INPUT_LOG_VERSION) {
+        printf("Error: %s is not an input log\n", path);
+        fclose(file);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        LoggedEvent logged;
+        char type[16];
+        int a = 0, b = 0;
+        memset(&logged, 0, sizeof(logged));
+        if (sscanf(line, "%ld %u %15s %d %d", &logged.frame, &logged.time, type, &a, &b) < 3) continue;
+
+        if (strcmp(type, "key") == 0) {
+            logged.event.type = SDL_KEYDOWN;
+            logged.event.key.keysym.sym = a;
+        } else if (strcmp(type, "click") == 0) {
+            logged.event.type = SDL_MOUSEBUTTONDOWN;
+            logged.event.button.x = a;
+            logged.event.button.y = b;
+        } else if (strcmp(type, "quit") == 0) {
+            logged.event.type = SDL_QUIT;
+        } else if (strcmp(type, "result") == 0) {
+            logged.result = 1;
+        } else {
+            continue;
+        }
+
+        if (replay_count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            LoggedEvent* grown = realloc(replay_events, capacity * sizeof(LoggedEvent));
+            if (grown == NULL) {
+                printf("Error: Out of memory reading %s\n", path);
+                fclose(file);
+                return 0;
+            }
+            replay_events = grown;
+        }
+        replay_events[replay_count++] = logged;
+    }
+    fclose(file);
+
+    latencies = malloc((replay_count + 1) * sizeof(double));
+    delivered = malloc((replay_count + 1) * sizeof(uint64_t));
+    if (latencies == NULL || delivered == NULL) return 0;
+
+    replay_active = 1;
+    replay_fast = full_speed;
+    replay_markers = version >= 2;
+    replay_started = profile_now();
+    replay_start_ticks = SDL_GetTicks();
+    printf("Replaying %d events from %s at %s speed\n", replay_count, path, full_speed ? "full" : "recorded");
+    return 1;
+}
+
+int input_log_replaying() {
+    return replay_active;
+}
+
+int input_log_full_speed() {
+    return replay_active && replay_fast;
+}
+
+// Whether the next entry of the replay is a result marker
+static int result_next() {
+    return replay_next < replay_count && replay_events[replay_next].result;
+}
+
+static int replay_event(SDL_Event* event, int evaluating) {
+    if (evaluating && !replay_markers) return 0;
+    if (result_next()) {
+        if (evaluating) return 0;  // Input after the result waits for it, however long the evaluation takes
+        replay_next++;             // A result this run does not have: the recording differs from it
+        return replay_event(event, evaluating);
+    }
+
+    if (replay_next >= replay_count) {
+        // The recording ended without closing the window: quit once
+        int quit_logged = replay_count > 0 && replay_events[replay_count - 1].event.type == SDL_QUIT;
+        if (replay_next > replay_count || quit_logged) return 0;
+        memset(event, 0, sizeof(*event));
+        event->type = SDL_QUIT;
+        replay_next++;
+    } else {
+        const LoggedEvent* logged = &replay_events[replay_next];
+        if (replay_fast) {
+            // One recorded frame per loop iteration, skipping the frames that had no input
+            if (replay_frame < 0) replay_frame = logged->frame;
+            if (logged->frame != replay_frame) {
+                replay_frame = logged->frame;
+                return 0;
+            }
+        } else if (SDL_GetTicks() - replay_start_ticks < logged->time) {
+            return 0;
+        }
+        *event = logged->event;
+        event->common.timestamp = SDL_GetTicks();  // Queued now: the recorded time belongs to another run
+        replay_next++;
+    }
+    delivered[latency_count++] = profile_now();
+    return 1;
+}
+
+int input_poll_event(SDL_Event* event, int evaluating) {
+    if (replay_active) return replay_event(event, evaluating);
+
+    int polled = SDL_PollEvent(event);
+    if (polled && record_file != NULL) log_event(event);
+    if (!polled) current_frame++;  // handle_input drains the queue once per frame
+    return polled;
+}
+
+int input_log_result_due() {
+    return !replay_active || !replay_markers || replay_next >= replay_count || result_next();
+}
+
+void input_log_result_shown() {
+    if (record_file != NULL) {
+        fprintf(record_file, "%ld %u result\n", current_frame, SDL_GetTicks() - record_start);
+    } else if (replay_active && result_next()) {
+        replay_frame = replay_events[replay_next].frame;  // Input the recording polled right after it comes next frame
+        replay_next++;
+    }
+}
+
+void input_log_frame_done() {
+    if (!replay_active) return;
+    uint64_t now = profile_now();
+    for (int i = frame_first; i < latency_count; i++) {
+        latencies[i] = (now - delivered[i]) * 1e-6;
+    }
+    frame_first = latency_count;
+}
+
+static int compare_latencies(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void input_log_finish(unsigned long checksum) {
+    if (record_file != NULL) {
+        fclose(record_file);
+        record_file = NULL;
+    }
+    if (!replay_active) return;
+
+    double total = (profile_now() - replay_started) * 1e-6;
+    int count = frame_first;  // Events whose frame completed
+    double sum = 0.0;
+    for (int i = 0; i < count; i++) sum += latencies[i];
+    qsort(latencies, count, sizeof(double), compare_latencies);
+
+    printf("Replay: %d events in %.1f ms\n", count, total);
+    if (count > 0) {
+        printf("Event latency: mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+               sum / count, latencies[(count - 1) / 2], latencies[(int)(0.99 * (count - 1))], latencies[count - 1]);
+    }
+    printf("Screen checksum: %016lx\n", checksum);
+
+    free(replay_events);
+    free(latencies);
+    free(delivered);
+    replay_events = NULL;
+    latencies = NULL;
+    delivered = NULL;
+    replay_active = 0;
+}
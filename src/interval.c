@@ -0,0 +1,274 @@
+#include <math.h>
+#include "interval.h"
+#include "sequence.h"
+
+#define INTERVAL_MAX_TERMS SEQUENCE_WINDOW  // Terms of u, v or w looked at for one range; wider ranges are unbounded
+
+// Build a defined, continuous interval
+Interval make_interval(double lo, double hi) {
+    Interval result = { lo, hi, 1, 0 };
+    return result;
+}
+
+static Interval empty_interval() {
+    Interval result = { NAN, NAN, 0, 1 };
+    return result;
+}
+
+// The whole real line, used whenever a pole or undefined point may be inside the range
+static Interval unbounded_interval() {
+    Interval result = { -INFINITY, INFINITY, 0, 0 };
+    return result;
+}
+
+// Round the bounds outward by one ulp so the result still contains the exact range
+static Interval widen(Interval a) {
+    if (a.empty) return a;
+    a.lo = nextafter(a.lo, -INFINITY);
+    a.hi = nextafter(a.hi, INFINITY);
+    return a;
+}
+
+// Carry the continuity of both operands over to a result
+static Interval inherit(Interval result, Interval a, Interval b) {
+    result.continuous = result.continuous && a.continuous && b.continuous;
+    return result;
+}
+
+static double min4(double a, double b, double c, double d) {
+    return fmin(fmin(a, b), fmin(c, d));
+}
+
+static double max4(double a, double b, double c, double d) {
+    return fmax(fmax(a, b), fmax(c, d));
+}
+
+// Product of two bounds where 0 * inf counts as 0
+static double bound_product(double a, double b) {
+    if (a == 0.0 || b == 0.0) return 0.0;
+    return a * b;
+}
+
+static Interval interval_multiply(Interval a, Interval b) {
+    double p1 = bound_product(a.lo, b.lo);
+    double p2 = bound_product(a.lo, b.hi);
+    double p3 = bound_product(a.hi, b.lo);
+    double p4 = bound_product(a.hi, b.hi);
+    return make_interval(min4(p1, p2, p3, p4), max4(p1, p2, p3, p4));
+}
+
+static Interval interval_divide(Interval a, Interval b) {
+    if (b.lo == 0.0 && b.hi == 0.0) return empty_interval();
+    if (b.lo <= 0.0 && b.hi >= 0.0) return unbounded_interval();  // Pole inside the range
+    return interval_multiply(a, make_interval(1.0 / b.hi, 1.0 / b.lo));
+}
+
+// a^n for a whole number n
+static Interval interval_integer_power(Interval a, double n) {
+    if (n == 0.0) return make_interval(1.0, 1.0);
+    if (n < 0.0) {
+        return interval_divide(make_interval(1.0, 1.0), interval_integer_power(a, -n));
+    }
+
+    double lo = pow(a.lo, n);
+    double hi = pow(a.hi, n);
+    if (fmod(n, 2.0) != 0.0 || a.lo >= 0.0) return make_interval(lo, hi);  // Monotonic
+    if (a.hi <= 0.0) return make_interval(hi, lo);
+    return make_interval(0.0, fmax(lo, hi));  // Even power with a minimum at 0
+}
+
+static Interval interval_power(Interval a, Interval b) {
+    if (b.lo == b.hi && b.lo == floor(b.lo)) {
+        return interval_integer_power(a, b.lo);
+    }
+
+    if (b.lo == b.hi) {
+        // Fractional exponent: only defined for a >= 0
+        if (a.hi < 0.0) return empty_interval();
+        int partial = a.lo < 0.0;
+        double lo = fmax(a.lo, 0.0);
+        Interval result = b.lo > 0.0 ? make_interval(pow(lo, b.lo), pow(a.hi, b.lo))
+                                     : make_interval(pow(a.hi, b.lo), pow(lo, b.lo));
+        if (partial || (b.lo < 0.0 && lo == 0.0)) result.continuous = 0;
+        return result;
+    }
+
+    if (a.lo > 0.0) {
+        // x^y = exp(y ln x) is monotonic in each argument, so the extremes are at the corners
+        double p1 = pow(a.lo, b.lo);
+        double p2 = pow(a.lo, b.hi);
+        double p3 = pow(a.hi, b.lo);
+        double p4 = pow(a.hi, b.hi);
+        return make_interval(min4(p1, p2, p3, p4), max4(p1, p2, p3, p4));
+    }
+    return unbounded_interval();
+}
+
+// Interval counterpart of apply_operation
+Interval interval_apply_operation(Interval a, Interval b, char op) {
+    if (a.empty || b.empty) return empty_interval();
+
+    Interval result;
+    switch (op) {
+        case '+': result = make_interval(a.lo + b.lo, a.hi + b.hi); break;
+        case '-': result = make_interval(a.lo - b.hi, a.hi - b.lo); break;
+        case '*': result = interval_multiply(a, b); break;
+        case '/': result = interval_divide(a, b); break;
+        case '^': result = interval_power(a, b); break;
+        default: return empty_interval();
+    }
+    if (result.empty) return result;
+    return widen(inherit(result, a, b));
+}
+
+// Interval counterpart of negate
+Interval interval_negate(Interval a) {
+    if (a.empty) return a;
+    double lo = a.lo;
+    a.lo = -a.hi;
+    a.hi = -lo;
+    return a;
+}
+
+// Smallest k with offset + k * period >= lo, checked against hi
+static int contains_periodic_point(double lo, double hi, double offset, double period) {
+    double k = ceil((lo - offset) / period);
+    return offset + k * period <= hi;
+}
+
+static Interval interval_sine(double lo, double hi) {
+    if (hi - lo >= 2 * M_PI) return make_interval(-1.0, 1.0);
+    double s_lo = sin(lo), s_hi = sin(hi);
+    double min = fmin(s_lo, s_hi), max = fmax(s_lo, s_hi);
+    if (contains_periodic_point(lo, hi, M_PI / 2, 2 * M_PI)) max = 1.0;
+    if (contains_periodic_point(lo, hi, -M_PI / 2, 2 * M_PI)) min = -1.0;
+    return make_interval(min, max);
+}
+
+static Interval interval_cosine(double lo, double hi) {
+    if (hi - lo >= 2 * M_PI) return make_interval(-1.0, 1.0);
+    double c_lo = cos(lo), c_hi = cos(hi);
+    double min = fmin(c_lo, c_hi), max = fmax(c_lo, c_hi);
+    if (contains_periodic_point(lo, hi, 0.0, 2 * M_PI)) max = 1.0;
+    if (contains_periodic_point(lo, hi, M_PI, 2 * M_PI)) min = -1.0;
+    return make_interval(min, max);
+}
+
+static Interval interval_tangent(double lo, double hi) {
+    if (hi - lo >= M_PI || contains_periodic_point(lo, hi, M_PI / 2, M_PI)) {
+        return unbounded_interval();  // Asymptote inside the range
+    }
+    return make_interval(tan(lo), tan(hi));
+}
+
+static Interval interval_logarithm(Interval a, double (*f)(double)) {
+    if (a.hi <= 0.0) return empty_interval();
+    if (a.lo <= 0.0) {
+        Interval result = make_interval(-INFINITY, f(a.hi));
+        result.continuous = 0;  // Only partly defined
+        return result;
+    }
+    return make_interval(f(a.lo), f(a.hi));
+}
+
+static Interval interval_square_root(Interval a) {
+    if (a.hi < 0.0) return empty_interval();
+    if (a.lo < 0.0) {
+        Interval result = make_interval(0.0, sqrt(a.hi));
+        result.continuous = 0;  // Only partly defined
+        return result;
+    }
+    return make_interval(sqrt(a.lo), sqrt(a.hi));
+}
+
+// u, v or w over a: the terms at the whole numbers in it, as they exist nowhere else. Only a single point
+// gives a continuous result.
+static Interval interval_sequence(const CalcContext* context, int which, Interval a) {
+    if (a.lo == a.hi) {
+        double term = sequence_term(context, which, a.lo);
+        return isnan(term) ? empty_interval() : make_interval(term, term);
+    }
+    double first = ceil(a.lo), last = floor(a.hi);
+    if (first > last) return empty_interval();
+    if (!(last - first < INTERVAL_MAX_TERMS)) return unbounded_interval();
+
+    Interval result = empty_interval();
+    for (double n = first; n <= last; n++) {
+        double term = sequence_term(context, which, n);
+        if (isnan(term)) continue;
+        if (result.empty) result = make_interval(term, term);
+        result.lo = fmin(result.lo, term);
+        result.hi = fmax(result.hi, term);
+    }
+    result.continuous = 0;
+    return result;
+}
+
+// Interval counterpart of apply_function
+Interval interval_apply_function(const CalcContext* context, FunctionId func, Interval a) {
+    if (a.empty) return a;
+
+    Interval result;
+    switch (func) {
+        case FUNC_LOG: result = interval_logarithm(a, log10); break;
+        case FUNC_LN:  result = interval_logarithm(a, log); break;
+        case FUNC_SIN: result = interval_sine(convert_to_radians(context, a.lo), convert_to_radians(context, a.hi)); break;
+        case FUNC_COS: result = interval_cosine(convert_to_radians(context, a.lo), convert_to_radians(context, a.hi)); break;
+        case FUNC_TAN: result = interval_tangent(convert_to_radians(context, a.lo), convert_to_radians(context, a.hi)); break;
+        case FUNC_SQRT: result = interval_square_root(a); break;
+        case FUNC_SEQ_U:
+        case FUNC_SEQ_V:
+        case FUNC_SEQ_W: result = interval_sequence(context, func - FUNC_SEQ_U, a); break;
+        default: return empty_interval();
+    }
+    if (result.empty) return result;
+    return widen(inherit(result, a, a));
+}
+
+// Evaluate a compiled expression with X ranging over x
+Interval run_program_interval(const CalcContext* context, const Program* program, Interval x) {
+    Interval values[MAX_PROGRAM_LENGTH];  // Stack for ranges
+    Interval temps[MAX_PROGRAM_TEMPS];
+    int value_top = -1;
+
+    for (int i = 0; i < program->length; i++) {
+        const Token* token = &program->tokens[i];
+        switch (token->type) {
+            case TOKEN_NUMBER:
+                values[++value_top] = make_interval(token->value, token->value);
+                break;
+            case TOKEN_VARIABLE_X:
+                values[++value_top] = x;
+                break;
+            case TOKEN_VARIABLE: {
+                double value = context->variables[token->variable];
+                values[++value_top] = make_interval(value, value);
+                break;
+            }
+            case TOKEN_OPERATOR: {
+                Interval val2 = values[value_top--];
+                values[value_top] = interval_apply_operation(values[value_top], val2, token->op);
+                break;
+            }
+            case TOKEN_NEGATE:
+                values[value_top] = interval_negate(values[value_top]);
+                break;
+            case TOKEN_FUNCTION:
+                values[value_top] = interval_apply_function(context, token->func, values[value_top]);
+                break;
+            case TOKEN_POWER_INT:
+                values[value_top] = interval_apply_operation(values[value_top], make_interval(token->value, token->value), '^');
+                break;
+            case TOKEN_STORE:
+                temps[token->variable] = values[value_top];
+                break;
+            case TOKEN_LOAD:
+                values[++value_top] = temps[token->variable];
+                break;
+            case TOKEN_IMAGINARY:
+                values[++value_top] = empty_interval();  // Not a real number: nothing to plot
+                break;
+        }
+    }
+    return values[value_top];
+}
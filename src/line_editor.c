@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <string.h>
+#include "line_editor.h"
+
+// The gap moves to the cursor only when the text changes there, so moving the cursor never copies
+// text; the next edit moves the gap as far as the cursor went.
+
+static size_t gap_size(const LineEditor* editor) {
+    return editor->gap_end - editor->gap_start;
+}
+
+int line_editor_advance(const LineEditor* editor, char c) {
+    return editor->advances != NULL ? editor->advances[(unsigned char)c] : 1;
+}
+
+int line_editor_init(LineEditor* editor, const int* advances) {
+    memset(editor, 0, sizeof(*editor));
+    editor->buffer = malloc(LINE_EDITOR_INITIAL_CAPACITY);
+    if (editor->buffer == NULL) return 0;
+    editor->capacity = LINE_EDITOR_INITIAL_CAPACITY;
+    editor->gap_end = editor->capacity;
+    editor->overwrite = 1;
+    editor->advances = advances;
+    return 1;
+}
+
+void line_editor_free(LineEditor* editor) {
+    free(editor->buffer);
+    editor->buffer = NULL;
+    editor->capacity = editor->gap_start = editor->gap_end = editor->cursor = 0;
+}
+
+void line_editor_clear(LineEditor* editor) {
+    editor->gap_start = editor->cursor = 0;
+    editor->gap_end = editor->capacity;
+    editor->cursor_x = editor->width = 0;
+}
+
+size_t line_editor_length(const LineEditor* editor) {
+    return editor->capacity - gap_size(editor);
+}
+
+size_t line_editor_cursor(const LineEditor* editor) {
+    return editor->cursor;
+}
+
+char line_editor_char_at(const LineEditor* editor, size_t position) {
+    if (position >= line_editor_length(editor)) return '\0';
+    return editor->buffer[position < editor->gap_start ? position : position + gap_size(editor)];
+}
+
+// Move the gap to the cursor, copying the text in between across it
+static void move_gap(LineEditor* editor) {
+    size_t cursor = editor->cursor;
+    if (cursor < editor->gap_start) {
+        size_t count = editor->gap_start - cursor;
+        memmove(editor->buffer + editor->gap_end - count, editor->buffer + cursor, count);
+        editor->gap_start -= count;
+        editor->gap_end -= count;
+    } else if (cursor > editor->gap_start) {
+        size_t count = cursor - editor->gap_start;
+        memmove(editor->buffer + editor->gap_start, editor->buffer + editor->gap_end, count);
+        editor->gap_start += count;
+        editor->gap_end += count;
+    }
+}
+
+// Make room for at least needed more characters plus a terminator, doubling the buffer
+static int reserve(LineEditor* editor, size_t needed) {
+    if (gap_size(editor) > needed) return 1;
+
+    size_t length = line_editor_length(editor);
+    size_t capacity = editor->capacity * 2;
+    while (capacity < length + needed + 1) capacity *= 2;
+    char* buffer = realloc(editor->buffer, capacity);
+    if (buffer == NULL) return 0;
+
+    // The text after the gap moves to the new end
+    size_t after = editor->capacity - editor->gap_end;
+    memmove(buffer + capacity - after, buffer + editor->gap_end, after);
+    editor->buffer = buffer;
+    editor->gap_end = capacity - after;
+    editor->capacity = capacity;
+    return 1;
+}
+
+int line_editor_insert(LineEditor* editor, const char* text) {
+    size_t count = strlen(text);
+    if (!reserve(editor, count)) return 0;
+    move_gap(editor);
+
+    if (editor->overwrite) {
+        size_t after = editor->capacity - editor->gap_end;
+        for (size_t i = 0; i < count && i < after; i++) {
+            editor->width -= line_editor_advance(editor, editor->buffer[editor->gap_end++]);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        int advance = line_editor_advance(editor, text[i]);
+        editor->buffer[editor->gap_start++] = text[i];
+        editor->cursor_x += advance;
+        editor->width += advance;
+    }
+    editor->cursor = editor->gap_start;
+    return 1;
+}
+
+int line_editor_delete(LineEditor* editor) {
+    if (editor->cursor >= line_editor_length(editor)) return 0;
+    move_gap(editor);
+    editor->width -= line_editor_advance(editor, editor->buffer[editor->gap_end++]);
+    return 1;
+}
+
+int line_editor_backspace(LineEditor* editor) {
+    if (editor->cursor == 0) return 0;
+    move_gap(editor);
+    int advance = line_editor_advance(editor, editor->buffer[--editor->gap_start]);
+    editor->cursor = editor->gap_start;
+    editor->cursor_x -= advance;
+    editor->width -= advance;
+    return 1;
+}
+
+int line_editor_left(LineEditor* editor) {
+    if (editor->cursor == 0) return 0;
+    editor->cursor--;
+    editor->cursor_x -= line_editor_advance(editor, line_editor_char_at(editor, editor->cursor));
+    return 1;
+}
+
+int line_editor_right(LineEditor* editor) {
+    if (editor->cursor >= line_editor_length(editor)) return 0;
+    editor->cursor_x += line_editor_advance(editor, line_editor_char_at(editor, editor->cursor));
+    editor->cursor++;
+    return 1;
+}
+
+void line_editor_home(LineEditor* editor) {
+    editor->cursor = 0;
+    editor->cursor_x = 0;
+}
+
+void line_editor_end(LineEditor* editor) {
+    editor->cursor = line_editor_length(editor);
+    editor->cursor_x = editor->width;
+}
+
+void line_editor_toggle_insert(LineEditor* editor) {
+    editor->overwrite = !editor->overwrite;
+}
+
+size_t line_editor_copy(const LineEditor* editor, size_t start, char* out, size_t size) {
+    size_t length = line_editor_length(editor), count = 0;
+    if (size == 0) return 0;
+    while (start + count < length && count < size - 1) {
+        out[count] = line_editor_char_at(editor, start + count);
+        count++;
+    }
+    out[count] = '\0';
+    return count;
+}
+
+const char* line_editor_text(LineEditor* editor) {
+    // With the gap at the end the text is contiguous, and the gap always has room for the terminator
+    size_t cursor = editor->cursor;
+    editor->cursor = line_editor_length(editor);
+    move_gap(editor);
+    editor->cursor = cursor;
+    editor->buffer[editor->gap_start] = '\0';
+    return editor->buffer;
+}
@@ -1,17 +1,251 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "sdl_engine.h"
 #include "math_engine.h"
+#include "graph_cache.h"
+#include "table.h"
+#include "bench.h"
+#include "profiler.h"
+#include "input_log.h"
+#include "regression.h"
+#include "sequence.h"
+#include "server.h"
+
+static const char* profile_path = NULL;  // Chrome trace written at exit
+
+// Runs after close_sdl has stopped the other threads, however the program exits
+static void write_profile() {
+    profile_write_trace(profile_path);
+}
+
+// Evaluate a numeric option without the evaluator's logging, so CSV on stdout stays clean
+static double option_value(const char* text) {
+    static CalcContext context;
+    Program program;
+    calc_context_init(&context);
+    return compile_expression(text, &program) ? run_program(&context, &program, 0.0) : 0.0;
+}
 
 int main(int argc, char* args[]) {
-    if (!init_sdl()) {
+    size_t graph_cache_bytes = GRAPH_CACHE_DEFAULT_BYTES;
+    GraphCachePolicy graph_cache_policy = GRAPH_CACHE_LRU;
+    int configure_graph_cache = 0;
+    const char* table_csv = NULL;  // Headless TABLE export
+    long table_rows = 1000;
+    const char* stat_data = NULL;  // x,y file for a regression
+    const char* regression = NULL; // LinReg, QuadReg, ...
+    int regression_slot = -1;      // Y= slot to store the fitted equation in
+    int bench_threads = 0;      // Headless context scaling benchmark
+    int bench_optimize = 0;     // Headless optimizer benchmark
+    int bench_scan = 0;         // Headless number scanner benchmark
+    int bench_print = 0;        // Headless number formatter benchmark
+    int bench_math = 0;         // Headless math kernel benchmark
+    int bench_frac = 0;         // Headless rational arithmetic benchmark
+    int bench_cplx = 0;         // Headless complex kernel benchmark
+    int bench_fit = 0;          // Headless regression benchmark
+    int bench_line = 0;         // Headless line editor benchmark
+    int bench_seq = 0;          // Headless sequence benchmark
+    const char* bench_serve = NULL;  // Socket of a running --serve to load
+    const char* serve_path = NULL;   // Run as the evaluation service on this socket
+    int serve_workers = SERVER_DEFAULT_WORKERS;
+    const char* record_path = NULL;
+    const char* replay_path = NULL;
+    int replay_full_speed = 1;
+    long headless_frames = 0;          // Frames to render offscreen, as fast as possible
+    const char* screenshot_path = NULL;
+    const char* frame_prefix = NULL;   // Dump every frame as PREFIX00000.ppm, ...
+    int slot;
+    char name, rest;
+
+    // Command line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(args[i], "--graph-cache-kb") == 0 && i + 1 < argc) {
+            graph_cache_bytes = (size_t)atol(args[++i]) * 1024;
+            configure_graph_cache = 1;
+        } else if (strcmp(args[i], "--graph-cache-policy") == 0 && i + 1 < argc) {
+            i++;
+            graph_cache_policy = strcmp(args[i], "fifo") == 0 ? GRAPH_CACHE_FIFO : GRAPH_CACHE_LRU;
+            configure_graph_cache = 1;
+        } else if (strcmp(args[i], "--table-csv") == 0 && i + 1 < argc) {
+            table_csv = args[++i];
+        } else if (strcmp(args[i], "--rows") == 0 && i + 1 < argc) {
+            table_rows = atol(args[++i]);
+        } else if (strcmp(args[i], "--tbl-start") == 0 && i + 1 < argc) {
+            table_start = option_value(args[++i]);
+        } else if (strcmp(args[i], "--tbl-step") == 0 && i + 1 < argc) {
+            table_step = option_value(args[++i]);
+        } else if (strcmp(args[i], "--stat-data") == 0 && i + 1 < argc) {
+            stat_data = args[++i];
+        } else if (strcmp(args[i], "--regression") == 0 && i + 1 < argc) {
+            regression = args[++i];
+        } else if (sscanf(args[i], "--store-y%d", &slot) == 1 && slot >= 0 && slot <= 9) {
+            regression_slot = (slot + 9) % 10;
+        } else if (strcmp(args[i], "--profile") == 0 && i + 1 < argc) {
+            profile_path = args[++i];
+        } else if (strcmp(args[i], "--record") == 0 && i + 1 < argc) {
+            record_path = args[++i];
+        } else if (strcmp(args[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = args[++i];
+        } else if (strcmp(args[i], "--replay-speed") == 0 && i + 1 < argc) {
+            replay_full_speed = strcmp(args[++i], "recorded") != 0;
+        } else if (strcmp(args[i], "--headless") == 0 && i + 1 < argc) {
+            headless_frames = atol(args[++i]);
+        } else if (strcmp(args[i], "--screenshot") == 0 && i + 1 < argc) {
+            screenshot_path = args[++i];
+        } else if (strcmp(args[i], "--dump-frames") == 0 && i + 1 < argc) {
+            frame_prefix = args[++i];
+        } else if (strcmp(args[i], "--bench-numbers") == 0) {
+            bench_scan = 1;
+        } else if (strcmp(args[i], "--bench-format") == 0) {
+            bench_print = 1;
+        } else if (strcmp(args[i], "--bench-kernels") == 0) {
+            bench_math = 1;
+        } else if (strcmp(args[i], "--bench-fractions") == 0) {
+            bench_frac = 1;
+        } else if (strcmp(args[i], "--bench-complex") == 0) {
+            bench_cplx = 1;
+        } else if (strcmp(args[i], "--bench-regression") == 0) {
+            bench_fit = 1;
+        } else if (strcmp(args[i], "--bench-editor") == 0) {
+            bench_line = 1;
+        } else if (strcmp(args[i], "--bench-sequences") == 0) {
+            bench_seq = 1;
+        } else if (strcmp(args[i], "--bench-serve") == 0 && i + 1 < argc) {
+            bench_serve = args[++i];
+        } else if (strcmp(args[i], "--serve") == 0 && i + 1 < argc) {
+            serve_path = args[++i];
+        } else if (strcmp(args[i], "--workers") == 0 && i + 1 < argc) {
+            serve_workers = atoi(args[++i]);
+        } else if (strcmp(args[i], "--bench-optimizer") == 0) {
+            bench_optimize = 1;
+        } else if (strcmp(args[i], "--bench-contexts") == 0 && i + 1 < argc) {
+            bench_threads = atoi(args[++i]);
+        } else if (strcmp(args[i], "--nmin") == 0 && i + 1 < argc) {
+            if (!sequence_set_nmin(&graph_sequences, option_value(args[++i]))) {
+                printf("nMin must be a whole number, 0 or more\n");
+                return -1;
+            }
+        } else if (sscanf(args[i], "--%c%c", &name, &rest) == 1 && strchr("uvw", name) != NULL && i + 1 < argc) {
+            sequence_set(&graph_sequences, strchr("uvw", name) - "uvw", args[i + 1]);  // --u, --v, --w select SEQ mode
+            sequence_mode = 1;
+            i++;
+        } else if (sscanf(args[i], "--%c-initial%c", &name, &rest) == 1 && strchr("uvw", name) != NULL && i + 1 < argc) {
+            sequence_set_initial(&graph_sequences, strchr("uvw", name) - "uvw", args[i + 1]);
+            i++;
+        } else if (sscanf(args[i], "--y%d", &slot) == 1 && slot >= 0 && slot <= 9 && i + 1 < argc) {
+            graph_set_function((slot + 9) % 10, args[++i]);  // Y1..Y9 are slots 0..8, Y0 is slot 9
+        } else {
+            printf("Unknown option: %s\n", args[i]);
+            return -1;
+        }
+    }
+    profile_thread_name("main");
+    if (profile_path != NULL) {
+        atexit(write_profile);
+    }
+    if (configure_graph_cache) {
+        graph_cache_configure(graph_cache_bytes, graph_cache_policy);
+    }
+
+    if (bench_scan) {
+        return bench_numbers(1000000) ? 0 : -1;
+    }
+    if (bench_print) {
+        return bench_format(1000000) ? 0 : -1;
+    }
+    if (bench_math) {
+        return bench_kernels(10000000) ? 0 : -1;
+    }
+    if (bench_frac) {
+        return bench_fractions(10000000) ? 0 : -1;
+    }
+    if (bench_cplx) {
+        return bench_complex(10000000) ? 0 : -1;
+    }
+    if (bench_fit) {
+        return bench_regression(10000000) ? 0 : -1;
+    }
+    if (bench_line) {
+        return bench_editor(1000000) ? 0 : -1;
+    }
+    if (bench_seq) {
+        return bench_sequences(10000000) ? 0 : -1;
+    }
+    if (bench_serve != NULL) {
+        return bench_server(bench_serve, 8, 400000) ? 0 : -1;
+    }
+    if (serve_path != NULL) {
+        if (serve_workers < 1) {
+            printf("--workers must be 1 or more\n");
+            return -1;
+        }
+        return server_run(serve_path, serve_workers);
+    }
+    if (bench_optimize) {
+        return bench_optimizer(1000000) ? 0 : -1;
+    }
+    if (bench_threads > 0) {
+        return bench_contexts(bench_threads, 2000000) ? 0 : -1;
+    }
+
+    // Fit the data and show the result; with --store-yN the equation goes to Y= and the program carries
+    // on to the TABLE export or the window, otherwise it stops here
+    if (regression != NULL) {
+        RegressionModel model;
+        RegressionData data;
+        RegressionFit fit;
+        CalcContext context;
+        if (!regression_lookup(regression, &model)) {
+            printf("Unknown regression: %s\n", regression);
+            return -1;
+        }
+        if (stat_data == NULL) {
+            printf("%s needs --stat-data\n", regression);
+            return -1;
+        }
+        if (!regression_load(stat_data, &data)) return -1;
+        int ok = regression_fit(model, data.x, data.y, data.count, &fit);
+        regression_free(&data);
+        if (!ok) return -1;
+        calc_context_init(&context);
+        regression_print(&context, &fit);
+        if (regression_slot < 0) return 0;
+        if (!regression_store(&fit, regression_slot)) return -1;
+    }
+
+    if (table_csv != NULL) {
+        FILE* file = strcmp(table_csv, "-") == 0 ? stdout : fopen(table_csv, "w");
+        if (file == NULL) {
+            printf("Could not open %s\n", table_csv);
+            return -1;
+        }
+        int ok = table_export_csv(file, table_rows);
+        if (file != stdout) fclose(file);
+        return ok ? 0 : -1;
+    }
+
+    if (replay_path != NULL || headless_frames > 0) {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);  // No window: runs the same on a build server
+    }
+    if (replay_path != NULL) {
+        if (!input_log_replay(replay_path, replay_full_speed)) return -1;
+    } else if (record_path != NULL && !input_log_record(record_path)) {
+        return -1;
+    }
+
+    if (!(headless_frames > 0 ? init_sdl_headless() : init_sdl())) {
         printf("Failed to initialize SDL!\n");
         return -1;
     }
 
     int quit = 0;
     int calculate = 0;  // Flag for when to calculate
+    long frame = 0;
+    uint64_t start = profile_now();
 
     while (!quit) {
+        profile_frame_begin();
         handle_input(&quit);
 
         // Only calculate when a button is pressed (for example)
@@ -21,8 +255,33 @@ int main(int argc, char* args[]) {
             calculate = 0;  // Reset the flag
         }
 
-        render_calculator();
-        SDL_Delay(100);
+        // The last frame is known before it is drawn: handle_input has seen the quit, or it is the last headless one
+        int last_frame = quit || (headless_frames > 0 && frame + 1 >= headless_frames);
+        render_frame(frame_prefix != NULL || (screenshot_path != NULL && last_frame));
+        profile_frame_end();
+        input_log_frame_done();
+
+        if (frame_prefix != NULL) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s%05ld.ppm", frame_prefix, frame);
+            save_screenshot(path);
+        }
+        frame++;
+        if (headless_frames > 0) {
+            if (frame >= headless_frames) quit = 1;
+        } else if (!input_log_full_speed()) {
+            SDL_Delay(100);
+        }
+    }
+
+    if (headless_frames > 0) {
+        double elapsed = (profile_now() - start) * 1e-6;
+        ProfileSummary summary = profile_summary();
+        printf("Headless: %ld frames in %.1f ms (%.0f frames/s), frame p50 %.3f ms, p99 %.3f ms\n",
+               frame, elapsed, frame / (elapsed * 1e-3), summary.frame_p50, summary.frame_p99);
+    }
+    if (screenshot_path != NULL && save_screenshot(screenshot_path)) {
+        printf("Screenshot written to %s\n", screenshot_path);
     }
 
     close_sdl();
@@ -4,18 +4,45 @@
 #include <string.h>
 #include <ctype.h>
 #include "math_engine.h"
+#include "profiler.h"
+#include "number_scan.h"
+#include "format.h"
+#include "math_kernels.h"
+#include "sequence.h"
 
-int use_degrees = 1;
+void calc_context_init(CalcContext* context) {
+    memset(context, 0, sizeof(*context));
+    context->angle = ANGLE_DEGREE;
+    context->notation = NOTATION_NORMAL;
+    context->fix_digits = CALC_FLOAT;
+}
 
+void calc_context_copy_modes(CalcContext* context, const CalcContext* source) {
+    context->angle = source->angle;
+    context->notation = source->notation;
+    context->fix_digits = source->fix_digits;
+    context->complex_mode = source->complex_mode;
+    context->sequences = source->sequences;
+    memcpy(context->variables, source->variables, sizeof(context->variables));
+    memcpy(context->imaginary, source->imaginary, sizeof(context->imaginary));
+}
 
 // Helper function to determine operator precedence
 int precedence(char op) {
     if (op == '+' || op == '-') return 1;
     if (op == '*' || op == '/') return 2;
-    if (op == '^') return 3;
+    if (op == '~') return 3;  // Negation binds looser than ^, so neg2^2 = -4
+    if (op == '^') return 4;
     return 0;
 }
 
+// a^b through the same kernel as batched evaluation, so both give identical results
+static double power(double a, double b) {
+    double result;
+    kernel_pow(&a, &b, &result, 1);
+    return result;
+}
+
 // Helper function to apply an operation
 double apply_operation(double a, double b, char op) {
     switch (op) {
@@ -23,172 +50,455 @@ double apply_operation(double a, double b, char op) {
         case '-': return subtract(a, b);
         case '*': return multiply(a, b);
         case '/': return divide(a, b);
-        case '^': return pow(a, b);
+        case '^': return power(a, b);
         default: return 0.0;
     }
 }
 
+// base^exponent for exponent >= 0 by repeated squaring. Each multiplication rounds, so the result
+// is within exponent - 1 ulps of pow(base, exponent) (exact for exponent 2).
+double power_int(double base, int exponent) {
+    double result = 1.0;
+    while (exponent > 0) {
+        if (exponent & 1) result *= base;
+        exponent >>= 1;
+        if (exponent > 0) base *= base;
+    }
+    return result;
+}
+
 // Handle the negation case
 double negate(double value) {
     return -value;
 }
 
 // Convert degrees to radians if necessary
-double convert_to_radians(double value) {
-    if (use_degrees) {
+double convert_to_radians(const CalcContext* context, double value) {
+    if (context->angle == ANGLE_DEGREE) {
         return value * M_PI / 180.0;  // Convert degrees to radians
     }
     return value;  // If radians, return as is
 }
 
+// Map a function name to its id
+FunctionId lookup_function(const char* name) {
+    if (strcmp(name, "log") == 0) return FUNC_LOG;
+    if (strcmp(name, "ln") == 0) return FUNC_LN;
+    if (strcmp(name, "sin") == 0) return FUNC_SIN;
+    if (strcmp(name, "cos") == 0) return FUNC_COS;
+    if (strcmp(name, "tan") == 0) return FUNC_TAN;
+    if (strcmp(name, "sqrt") == 0) return FUNC_SQRT;
+    if (strcmp(name, "u") == 0) return FUNC_SEQ_U;
+    if (strcmp(name, "v") == 0) return FUNC_SEQ_V;
+    if (strcmp(name, "w") == 0) return FUNC_SEQ_W;
+    return FUNC_UNKNOWN;
+}
+
+int is_sequence_function(FunctionId func) {
+    return func == FUNC_SEQ_U || func == FUNC_SEQ_V || func == FUNC_SEQ_W;
+}
+
+// Apply a math function by id. The kernels reduce degrees exactly, so sin(180) is 0 rather than 1.2E-16.
+double apply_function(const CalcContext* context, FunctionId func, double value) {
+    if (is_sequence_function(func)) return sequence_term(context, func - FUNC_SEQ_U, value);
+    double result;
+    kernel_apply_function(context, func, &value, &result, 1);
+    return result;
+}
+
 // Helper function to handle math functions
-double evaluate_function(const char* func, double value) {
-    if (strcmp(func, "log") == 0) {
-        return log10(value);  // Logarithm base 10
-    } else if (strcmp(func, "ln") == 0) {
-        return log(value);    // Natural logarithm
-    } else if (strcmp(func, "sin") == 0) {
-        value = convert_to_radians(value);  // Convert to radians if necessary
-        return sin(value);    // Sine
-    } else if (strcmp(func, "cos") == 0) {
-        value = convert_to_radians(value);  // Convert to radians if necessary
-        return cos(value);    // Cosine
-    } else if (strcmp(func, "tan") == 0) {
-        value = convert_to_radians(value);  // Convert to radians if necessary
-        return tan(value);    // Tangent
-    }
-    return 0.0;
-}
-
-double evaluate_expression(const char* expression) {
-    double values[100];  // Stack for numbers
-    char ops[100];       // Stack for operators
-    char func_stack[100][10]; // Stack for function names (like "sin", "log")
-    int value_top = -1, op_top = -1, func_top = -1;
+double evaluate_function(const CalcContext* context, const char* func, double value) {
+    return apply_function(context, lookup_function(func), value);
+}
+
+// Append a token to a program, failing if the program is full
+static int emit_token(Program* program, TokenType type, double value, char op, FunctionId func) {
+    if (program->length >= MAX_PROGRAM_LENGTH) {
+        printf("Error: Expression too long\n");
+        return 0;
+    }
+    Token* token = &program->tokens[program->length++];
+    token->type = type;
+    token->value = value;
+    token->op = op;
+    token->func = func;
+    token->variable = 0;
+    return 1;
+}
+
+// Index of a variable name in CalcContext.variables, or -1 (X has its own token)
+static int lookup_variable(const char* name) {
+    if (strcmp(name, "Ans") == 0) return CALC_ANS;
+    if (name[0] >= 'A' && name[0] <= 'Z' && name[1] == '\0' && name[0] != 'X') return name[0] - 'A';
+    return -1;
+}
+
+// Emit a stacked operator (binary operator, negation or function call)
+static int emit_stacked(Program* program, char op, FunctionId func) {
+    if (op == '~') return emit_token(program, TOKEN_NEGATE, 0.0, op, FUNC_UNKNOWN);
+    if (op == '(') return func == FUNC_UNKNOWN ? 1 : emit_token(program, TOKEN_FUNCTION, 0.0, op, func);
+    return emit_token(program, TOKEN_OPERATOR, 0.0, op, FUNC_UNKNOWN);
+}
+
+// Check that every operator has its operands and exactly one value remains
+static int validate_program(const Program* program) {
+    int depth = 0;
+    for (int i = 0; i < program->length; i++) {
+        switch (program->tokens[i].type) {
+            case TOKEN_NUMBER:
+            case TOKEN_VARIABLE_X:
+            case TOKEN_VARIABLE:
+                depth++;
+                break;
+            case TOKEN_OPERATOR:
+                if (depth < 2) return 0;
+                depth--;
+                break;
+            case TOKEN_NEGATE:
+            case TOKEN_FUNCTION:
+            case TOKEN_POWER_INT:
+            case TOKEN_STORE:
+                if (depth < 1) return 0;
+                break;
+            case TOKEN_LOAD:
+            case TOKEN_IMAGINARY:
+                depth++;
+                break;
+        }
+    }
+    return depth == 1;
+}
+
+// Compile an expression into postfix order using the shunting-yard algorithm
+int compile_expression(const char* expression, Program* program) {
+    char ops[MAX_PROGRAM_LENGTH];          // Stack for operators and open parentheses
+    FunctionId op_funcs[MAX_PROGRAM_LENGTH]; // Function owning each open parenthesis
+    int op_top = -1;
     int len = strlen(expression);
-    int negation_flag = 0; // Flag to track negation
+    int implicit_multiply = 0;  // Set after an operand, so "2X" or "2sin(" multiply
 
-    printf("Evaluating expression: %s\n", expression);  // Log the full expression
+    program->length = 0;
 
     for (int i = 0; i < len; i++) {
         // Skip spaces
         if (expression[i] == ' ') continue;
 
-        // Current character is a number, parse the full number
-        if (isdigit(expression[i])) {
-            double val = 0;
-            while (i < len && (isdigit(expression[i]) || expression[i] == '.')) {
-                if (expression[i] == '.') {
-                    i++;
-                    double decimal_place = 0.1;
-                    while (i < len && isdigit(expression[i])) {
-                        val += (expression[i] - '0') * decimal_place;
-                        decimal_place *= 0.1;
-                        i++;
-                    }
-                    break;
-                } else {
-                    val = (val * 10) + (expression[i] - '0');
-                    i++;
-                }
+        int starts_operand = isdigit(expression[i]) || expression[i] == '.' || expression[i] == '(' ||
+                             (isalpha(expression[i]) && strncmp(&expression[i], "neg", 3) != 0);
+        if (implicit_multiply && starts_operand) {
+            // Resolve previous operators with higher or equal precedence, then multiply
+            while (op_top >= 0 && precedence(ops[op_top]) >= precedence('*')) {
+                if (!emit_stacked(program, ops[op_top], op_funcs[op_top])) return 0;
+                op_top--;
             }
-            // Apply negation if the flag is set
-            if (negation_flag) {
-                val = -val;
-                negation_flag = 0; // Reset flag
-            }
-            values[++value_top] = val;
-            printf("Pushed number to stack: %.2f\n", val);  // Log the number
-            i--;
-
-            // Check for implicit multiplication if followed by a function (but not negation)
-            if (i + 1 < len && isalpha(expression[i + 1])) {
-                ops[++op_top] = '*';  // Insert implicit multiplication
-                printf("Inserted implicit multiplication before function\n");
+            ops[++op_top] = '*';
+            op_funcs[op_top] = FUNC_UNKNOWN;
+        }
+        int after_operand = implicit_multiply;  // Whether a binary operator may follow here
+        implicit_multiply = 0;
+
+        if (op_top >= MAX_PROGRAM_LENGTH - 2) {
+            printf("Error: Expression too long\n");
+            return 0;
+        }
+
+        // Current character is a number, parse the full number
+        if (isdigit(expression[i]) || expression[i] == '.') {
+            double val;
+            int scanned = scan_number(&expression[i], &val);
+            if (scanned == 0) {
+                printf("Error: Unexpected character '%c'\n", expression[i]);
+                return 0;
             }
+            i += scanned - 1;
+            if (!emit_token(program, TOKEN_NUMBER, val, 0, FUNC_UNKNOWN)) return 0;
+            implicit_multiply = 1;
         }
         // Handle negation "neg" represented as "~"
         else if (strncmp(&expression[i], "neg", 3) == 0 || expression[i] == '~') {
-            // Handle negation (neg)
             i += (expression[i] == '~') ? 0 : 2;  // Skip past "neg" if found
-            negation_flag = 1;  // Set negation flag
-            printf("Negation flag set\n");
+            ops[++op_top] = '~';  // Prefix operator: nothing to resolve yet
+            op_funcs[op_top] = FUNC_UNKNOWN;
         }
-        // Handle functions like "sin", "log", etc.
+        // Handle functions like "sin", "log", etc. and the variable X
         else if (isalpha(expression[i])) {
-            char func[10] = {0};
+            char name[10] = {0};
             int j = 0;
             while (i < len && isalpha(expression[i])) {
-                func[j++] = expression[i++];
+                if (j < (int)sizeof(name) - 1) name[j++] = expression[i];
+                i++;
+            }
+            name[j] = '\0';
+
+            if (i < len && expression[i] == '(') {
+                FunctionId func = lookup_function(name);
+                if (func == FUNC_UNKNOWN) {
+                    printf("Error: Unknown function %s\n", name);
+                    return 0;
+                }
+                ops[++op_top] = '(';  // The function is applied when this parenthesis closes
+                op_funcs[op_top] = func;
+            } else if (strcmp(name, "X") == 0 || strcmp(name, "n") == 0) {  // n is X of the sequences
+                i--;
+                if (!emit_token(program, TOKEN_VARIABLE_X, 0.0, 0, FUNC_UNKNOWN)) return 0;
+                implicit_multiply = 1;
+            } else if (strcmp(name, "i") == 0) {
+                i--;
+                if (!emit_token(program, TOKEN_IMAGINARY, 0.0, 0, FUNC_UNKNOWN)) return 0;
+                implicit_multiply = 1;
+            } else if (lookup_variable(name) >= 0) {
+                i--;
+                if (!emit_token(program, TOKEN_VARIABLE, 0.0, 0, FUNC_UNKNOWN)) return 0;
+                program->tokens[program->length - 1].variable = lookup_variable(name);
+                implicit_multiply = 1;
+            } else {
+                printf("Error: Unknown variable %s\n", name);
+                return 0;
             }
-            func[j] = '\0';
-            strcpy(func_stack[++func_top], func);  // Push function to stack
-            printf("Pushed function to stack: %s\n", func);  // Log the function
-            i--;  // Reevaluate the parenthesis after the function
         }
         // Current character is an opening parenthesis
         else if (expression[i] == '(') {
-            ops[++op_top] = expression[i];
-            printf("Pushed open parenthesis to stack\n");  // Log the parenthesis
+            ops[++op_top] = '(';
+            op_funcs[op_top] = FUNC_UNKNOWN;
         }
         // Current character is a closing parenthesis, resolve parenthesis content
         else if (expression[i] == ')') {
             while (op_top >= 0 && ops[op_top] != '(') {
-                double val2 = values[value_top--];
-                double val1 = values[value_top--];
-                char op = ops[op_top--];
-                double result = apply_operation(val1, val2, op);
-                values[++value_top] = result;
-                printf("Applied operation %c: %.2f %c %.2f = %.2f\n", op, val1, op, val2, result);
+                if (!emit_stacked(program, ops[op_top], op_funcs[op_top])) return 0;
+                op_top--;
             }
-            op_top--;  // Pop the opening parenthesis from ops stack
-            printf("Popped open parenthesis\n");
-
-            // Apply the function now if there's a function waiting on the stack
-            if (func_top >= 0) {
-                double result = evaluate_function(func_stack[func_top--], values[value_top--]);
-                values[++value_top] = result;
-                printf("Applied function result: %.2f\n", result);  // Log the result
+            if (op_top < 0) {
+                printf("Error: Unmatched closing parenthesis\n");
+                return 0;
             }
+            // Pop the opening parenthesis, applying its function if it has one
+            if (!emit_stacked(program, ops[op_top], op_funcs[op_top])) return 0;
+            op_top--;
+            implicit_multiply = 1;
+        }
+        // A minus sign with no operand before it is a negation, as in "-1" or "2*(-X)"
+        else if (expression[i] == '-' && !after_operand) {
+            ops[++op_top] = '~';
+            op_funcs[op_top] = FUNC_UNKNOWN;
         }
         // Current character is an operator
         else if (expression[i] == '+' || expression[i] == '-' || expression[i] == '*' || expression[i] == '/' || expression[i] == '^') {
             // Resolve previous operators with higher or equal precedence
             while (op_top >= 0 && precedence(ops[op_top]) >= precedence(expression[i])) {
-                double val2 = values[value_top--];
-                double val1 = values[value_top--];
-                char op = ops[op_top--];
-                double result = apply_operation(val1, val2, op);
-                values[++value_top] = result;
-                printf("Applied operation %c: %.2f %c %.2f = %.2f\n", op, val1, op, val2, result);
+                if (!emit_stacked(program, ops[op_top], op_funcs[op_top])) return 0;
+                op_top--;
             }
             ops[++op_top] = expression[i];  // Push current operator
-            printf("Pushed operator to stack: %c\n", expression[i]);  // Log the operator
+            op_funcs[op_top] = FUNC_UNKNOWN;
+        } else {
+            printf("Error: Unexpected character '%c'\n", expression[i]);
+            return 0;
         }
     }
 
-    // Apply remaining operators in the stack
+    // Apply remaining operators; unclosed parentheses are closed implicitly like on the TI-84
     while (op_top >= 0) {
-        double val2 = values[value_top--];
-        double val1 = values[value_top--];
-        char op = ops[op_top--];
-        double result = apply_operation(val1, val2, op);
-        values[++value_top] = result;
-        printf("Applied operation %c: %.2f %c %.2f = %.2f\n", op, val1, op, val2, result);
+        if (!emit_stacked(program, ops[op_top], op_funcs[op_top])) return 0;
+        op_top--;
     }
 
-    // Apply any remaining function on the stack
-    while (func_top >= 0) {
-        double result = evaluate_function(func_stack[func_top--], values[value_top--]);
-        values[++value_top] = result;
-        printf("Applied remaining function: %.2f\n", result);
+    if (!validate_program(program)) {
+        printf("Error: Syntax error in expression\n");
+        return 0;
     }
+    return 1;
+}
+
+// Evaluate a compiled expression with the variable X set to x
+double run_program(CalcContext* context, const Program* program, double x) {
+    double* values = context->scratch;  // Stack for numbers
+    int value_top = -1;
 
-    // The result is the last value in the values stack
-    printf("Final result: %.2f\n", values[value_top]);  // Log the final result
+    for (int i = 0; i < program->length; i++) {
+        const Token* token = &program->tokens[i];
+        switch (token->type) {
+            case TOKEN_NUMBER:
+                values[++value_top] = token->value;
+                break;
+            case TOKEN_VARIABLE_X:
+                values[++value_top] = x;
+                break;
+            case TOKEN_VARIABLE:
+                values[++value_top] = context->variables[token->variable];
+                break;
+            case TOKEN_OPERATOR: {
+                double val2 = values[value_top--];
+                values[value_top] = apply_operation(values[value_top], val2, token->op);
+                break;
+            }
+            case TOKEN_NEGATE:
+                values[value_top] = negate(values[value_top]);
+                break;
+            case TOKEN_FUNCTION:
+                values[value_top] = apply_function(context, token->func, values[value_top]);
+                // Functions are the only tokens that can run long (u(n) steps through every term), and a
+                // program has a bounded number of them, so polling here lets ON stop any evaluation
+                if (evaluation_cancelled(context)) return NAN;
+                break;
+            case TOKEN_POWER_INT:
+                values[value_top] = power_int(values[value_top], (int)token->value);
+                break;
+            case TOKEN_STORE:
+                context->temps[token->variable] = values[value_top];
+                break;
+            case TOKEN_LOAD:
+                values[++value_top] = context->temps[token->variable];
+                break;
+            case TOKEN_IMAGINARY:
+                values[++value_top] = NAN;
+                break;
+        }
+    }
     return values[value_top];
 }
 
+int program_is_real(const CalcContext* context, const Program* program) {
+    for (int i = 0; i < program->length; i++) {
+        const Token* token = &program->tokens[i];
+        if (token->type == TOKEN_IMAGINARY) return 0;
+        if (token->type == TOKEN_VARIABLE && context->imaginary[token->variable] != 0) return 0;
+    }
+    return 1;
+}
+
+unsigned long program_variables_read(const Program* program) {
+    unsigned long reads = 0;
+    for (int i = 0; i < program->length; i++) {
+        const Token* token = &program->tokens[i];
+        if (token->type == TOKEN_VARIABLE && token->variable < CALC_TERMS) {
+            reads |= 1ul << token->variable;
+        } else if (token->type == TOKEN_FUNCTION && is_sequence_function(token->func)) {
+            reads = ~0ul;  // The definitions of u, v and w may read any of them
+        }
+    }
+    return reads;
+}
+
+// apply_operation over a batch of lanes: a = a op b
+static void apply_operation_lanes(double* a, const double* b, char op, int count) {
+    switch (op) {
+        case '+': for (int i = 0; i < count; i++) a[i] = a[i] + b[i]; break;
+        case '-': for (int i = 0; i < count; i++) a[i] = a[i] - b[i]; break;
+        case '*': for (int i = 0; i < count; i++) a[i] = a[i] * b[i]; break;
+        case '/': for (int i = 0; i < count; i++) a[i] = b[i] == 0 ? NAN : a[i] / b[i]; break;
+        case '^': kernel_pow(a, b, a, count); break;
+        default:  for (int i = 0; i < count; i++) a[i] = 0.0; break;
+    }
+}
+
+// power_int over a batch of lanes, with the same sequence of multiplications
+static void power_int_lanes(double* base, int exponent, int count) {
+    double result[PROGRAM_BATCH];
+    for (int i = 0; i < count; i++) result[i] = 1.0;
+    while (exponent > 0) {
+        if (exponent & 1) {
+            for (int i = 0; i < count; i++) result[i] *= base[i];
+        }
+        exponent >>= 1;
+        if (exponent > 0) {
+            for (int i = 0; i < count; i++) base[i] *= base[i];
+        }
+    }
+    memcpy(base, result, count * sizeof(double));
+}
+
+void run_program_batch(CalcContext* context, const Program* program, const double* x, double* out, int count) {
+    double values[MAX_PROGRAM_LENGTH][PROGRAM_BATCH];  // Stack of batches
+    double temps[MAX_PROGRAM_TEMPS][PROGRAM_BATCH];
+
+    for (int start = 0; start < count; start += PROGRAM_BATCH) {
+        int n = count - start < PROGRAM_BATCH ? count - start : PROGRAM_BATCH;
+        int value_top = -1;
+
+        if (evaluation_cancelled(context)) {  // Between batches: the rest is not computed
+            for (int j = start; j < count; j++) out[j] = NAN;
+            return;
+        }
+
+        for (int i = 0; i < program->length; i++) {
+            const Token* token = &program->tokens[i];
+            double* top = value_top >= 0 ? values[value_top] : NULL;
+            switch (token->type) {
+                case TOKEN_NUMBER:
+                    top = values[++value_top];
+                    for (int j = 0; j < n; j++) top[j] = token->value;
+                    break;
+                case TOKEN_VARIABLE_X:
+                    memcpy(values[++value_top], x + start, n * sizeof(double));
+                    break;
+                case TOKEN_VARIABLE:
+                    top = values[++value_top];
+                    for (int j = 0; j < n; j++) top[j] = context->variables[token->variable];
+                    break;
+                case TOKEN_OPERATOR:
+                    value_top--;
+                    apply_operation_lanes(values[value_top], top, token->op, n);
+                    break;
+                case TOKEN_NEGATE:
+                    for (int j = 0; j < n; j++) top[j] = -top[j];
+                    break;
+                case TOKEN_FUNCTION:
+                    if (is_sequence_function(token->func)) {
+                        // Terms are stepped one after another, not vectorized
+                        for (int j = 0; j < n; j++) top[j] = sequence_term(context, token->func - FUNC_SEQ_U, top[j]);
+                    } else {
+                        kernel_apply_function(context, token->func, top, top, n);
+                    }
+                    break;
+                case TOKEN_POWER_INT:
+                    power_int_lanes(top, (int)token->value, n);
+                    break;
+                case TOKEN_STORE:
+                    memcpy(temps[token->variable], top, n * sizeof(double));
+                    break;
+                case TOKEN_LOAD:
+                    memcpy(values[++value_top], temps[token->variable], n * sizeof(double));
+                    break;
+                case TOKEN_IMAGINARY:
+                    top = values[++value_top];
+                    for (int j = 0; j < n; j++) top[j] = NAN;
+                    break;
+            }
+        }
+        memcpy(out + start, values[value_top], n * sizeof(double));
+    }
+}
+
+int evaluation_cancelled(const CalcContext* context) {
+    return context->cancel_check != NULL && context->cancel_check();
+}
+
+double evaluate_expression(CalcContext* context, const char* expression) {
+    PROFILE_SCOPE("evaluate_expression");
+    Program program;
+
+    printf("Evaluating expression: %s\n", expression);  // Log the full expression
+
+    if (!compile_expression(expression, &program) || evaluation_cancelled(context)) {
+        return NAN;
+    }
+
+    // A complex input has no real result (ERR:NONREAL ANS on the TI-84)
+    double result = NAN;
+    if (program_is_real(context, &program)) {
+        result = run_program(context, &program, context->variables['X' - 'A']);
+    }
+    if (evaluation_cancelled(context)) return NAN;  // Stopped part way: Ans keeps its value
+    char text[FORMAT_LENGTH];
+    format_shortest(result, text);
+    printf("Final result: %s\n", text);  // Log the final result
+    if (!isnan(result)) {  // An error leaves Ans as it was, like on the TI-84
+        context->variables[CALC_ANS] = result;
+        context->imaginary[CALC_ANS] = 0.0;
+    }
+    return result;
+}
+
 // Basic arithmetic functions
 double add(double a, double b) {
     return a + b;
@@ -204,8 +514,7 @@ double multiply(double a, double b) {
 
 double divide(double a, double b) {
     if (b == 0) {
-        printf("Error: Division by zero\n");
-        return 0;
+        return NAN;  // Undefined; graphs break here instead of plotting a false zero
     }
     return a / b;
 }
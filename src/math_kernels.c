@@ -0,0 +1,386 @@
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include <math.h>
+#include "math_kernels.h"
+
+#define ROUND_MAGIC 6755399441055744.0   // 1.5 * 2^52: adding and subtracting it rounds to an integer
+#define TRIG_MAX_RADIANS 1e5             // Cody-Waite reduction stays accurate below this
+#define DEGREE_MAX 35184372088832.0      // 2^45: 360 * round(x / 360) is exact below this
+#define EXP_MAX 708.0                    // exp stays a normal double without scaling tricks
+#define POW_MAX_EXPONENT 2251799813685248.0  // 2^51: the rounding trick can tell integers apart below this
+#define TWO_TO_52 4503599627370496.0
+#define TWO_TO_52_BITS 0x4330000000000000ull
+#define SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFull
+#define EXPONENT_OF_ONE 0x3FF0000000000000ull
+
+// pi/2 in three parts; the first two have 33 significant bits, so k * part is exact for small k
+static const double PIO2_1 = 1.57079632673412561417e+00;
+static const double PIO2_2 = 6.07710050630396597660e-11;
+static const double PIO2_3 = 2.02226624879595063154e-21;
+static const double TWO_OVER_PI = 6.36619772367581382433e-01;
+static const double DEGREES_TO_RADIANS = 1.74532925199432954744e-02;
+
+// fdlibm minimax polynomials for sin and cos on [-pi/4, pi/4]
+static const double S1 = -1.66666666666666324348e-01, S2 = 8.33333333332248946124e-03,
+                    S3 = -1.98412698298579493134e-04, S4 = 2.75573137070700676789e-06,
+                    S5 = -2.50507602534068634195e-08, S6 = 1.58969099521155010221e-10;
+static const double C1 = 4.16666666666666019037e-02, C2 = -1.38888888888741095749e-03,
+                    C3 = 2.48015872894767294178e-05, C4 = -2.75573143513906633035e-07,
+                    C5 = 2.08757232129817482790e-09, C6 = -1.13596475577881948265e-11;
+
+// fdlibm exp: ln 2 in two parts (k * LN2_HI is exact) and the remez polynomial for exp(r) on |r| <= ln2 / 2
+static const double LN2_HI = 6.93147180369123816490e-01, LN2_LO = 1.90821492927058770002e-10;
+static const double INV_LN2 = 1.44269504088896338700e+00;
+static const double P1 = 1.66666666666666019037e-01, P2 = -2.77777777770155933842e-03,
+                    P3 = 6.61375632143793436117e-05, P4 = -1.65339022054652515390e-06,
+                    P5 = 4.13813679705723846039e-08;
+
+// fdlibm log: polynomial for log(1 + f) on sqrt(2)/2 <= 1 + f <= sqrt(2), and log10 constants
+static const double LG1 = 6.666666666666735130e-01, LG2 = 3.999999999940941908e-01,
+                    LG3 = 2.857142874366239149e-01, LG4 = 2.222219843214978396e-01,
+                    LG5 = 1.818357216161805012e-01, LG6 = 1.531383769920937332e-01,
+                    LG7 = 1.479819860511658591e-01;
+static const double SQRT2 = 1.41421356237309504880e+00;
+static const double IVLN10_HI = 4.34294481878168880939e-01, IVLN10_LO = 2.50829467116452752298e-11;
+static const double LOG10_2_HI = 3.01029995663611771306e-01, LOG10_2_LO = 3.69423907715893078616e-13;
+
+static inline double round_to_integer(double x) {
+    return (x + ROUND_MAGIC) - ROUND_MAGIC;
+}
+
+static inline double sin_polynomial(double x) {
+    double z = x * x, w = z * z;
+    double r = S2 + z * (S3 + z * S4) + z * w * (S5 + z * S6);
+    return x + z * x * (S1 + z * r);
+}
+
+static inline double cos_polynomial(double x) {
+    double z = x * x, w = z * z;
+    double r = z * (C1 + z * (C2 + z * C3)) + w * w * (C4 + z * (C5 + z * C6));
+    double hz = 0.5 * z;
+    double one_minus = 1.0 - hz;
+    return one_minus + (((1.0 - one_minus) - hz) + z * r);
+}
+
+// x = k * pi/2 + r with |r| <= pi/4; returns k modulo 4 as 0..3
+static inline double reduce_radians(double x, double* r) {
+    double k = fabs(x) < TRIG_MAX_RADIANS ? round_to_integer(x * TWO_OVER_PI) : 0.0;
+    *r = ((x - k * PIO2_1) - k * PIO2_2) - k * PIO2_3;
+    return k - 4.0 * round_to_integer(k * 0.25 - 0.375);
+}
+
+// x = q * 90 + d with |d| <= 45, without rounding: first modulo 360 (|x| < DEGREE_MAX), then by 90.
+// Returns q modulo 4 as 0..3.
+static inline double reduce_degrees(double x, double* d) {
+    double n = fabs(x) < DEGREE_MAX ? round_to_integer(x * (1.0 / 360.0)) : 0.0;
+    double r = x - n * 360.0;  // Within [-180, 180]
+    double q = round_to_integer(r * (1.0 / 90.0));
+    *d = r - q * 90.0;
+    return q < 0 ? q + 4.0 : q;
+}
+
+// 1 for the odd quadrants q = 1 and 3, else 0. The quadrant tests are written arithmetically
+// because GCC does not vectorize compound conditions like q == 1 || q == 3 in every kernel.
+static inline double quadrant_parity(double q) {
+    return q - 2.0 * round_to_integer(q * 0.5 - 0.25);
+}
+
+// sin(x) from s = sin(r) and c = cos(r), where x = r + q * pi/2
+static inline double sin_of_quadrant(double q, double s, double c) {
+    double v = quadrant_parity(q) == 1.0 ? c : s;
+    return q >= 2.0 ? -v : v;
+}
+
+static inline double cos_of_quadrant(double q, double s, double c) {
+    double v = quadrant_parity(q) == 1.0 ? s : c;
+    return fabs(q - 1.5) < 1.0 ? -v : v;  // q is 1 or 2
+}
+
+static inline double sin_lane(double x) {
+    double r;
+    double q = reduce_radians(x, &r);
+    return sin_of_quadrant(q, sin_polynomial(r), cos_polynomial(r));
+}
+
+static inline double cos_lane(double x) {
+    double r;
+    double q = reduce_radians(x, &r);
+    return cos_of_quadrant(q, sin_polynomial(r), cos_polynomial(r));
+}
+
+static inline double tan_lane(double x) {
+    double r;
+    double q = reduce_radians(x, &r);
+    double s = sin_polynomial(r), c = cos_polynomial(r);
+    return quadrant_parity(q) == 1.0 ? -c / s : s / c;
+}
+
+// sin of d degrees for |d| <= 45, exact at 0 and +-30
+static inline double sin_small_degrees(double d) {
+    double s = sin_polynomial(d * DEGREES_TO_RADIANS);
+    return fabs(d) == 30.0 ? (d > 0 ? 0.5 : -0.5) : s;
+}
+
+static inline double sin_degrees_lane(double x) {
+    double d;
+    double q = reduce_degrees(x, &d);
+    return sin_of_quadrant(q, sin_small_degrees(d), cos_polynomial(d * DEGREES_TO_RADIANS));
+}
+
+static inline double cos_degrees_lane(double x) {
+    double d;
+    double q = reduce_degrees(x, &d);
+    return cos_of_quadrant(q, sin_small_degrees(d), cos_polynomial(d * DEGREES_TO_RADIANS));
+}
+
+static inline double tan_degrees_lane(double x) {
+    double d;
+    double q = reduce_degrees(x, &d);
+    double odd = quadrant_parity(q);
+    int diagonal = fabs(d) == 45.0;  // tan is exactly +-1 there
+    double s = diagonal ? (d > 0 ? 1.0 : -1.0) : sin_small_degrees(d);
+    double c = diagonal ? 1.0 : cos_polynomial(d * DEGREES_TO_RADIANS);
+    double t = odd == 1.0 ? -c / s : s / c;
+    return odd - fabs(d) == 1.0 ? NAN : t;  // 90 + 180n: odd quadrant and d = 0, where tan is undefined
+}
+
+// 2^k for an integer -1022 <= k <= 1023, without integer conversions (SSE2 has none for 64 bits):
+// adding 2^52 leaves k + 1023 in the low bits, and the shift moves it into the exponent field
+static inline double power_of_two(double k) {
+    double shifted = k + (1023.0 + TWO_TO_52);
+    uint64_t bits;
+    memcpy(&bits, &shifted, sizeof(bits));
+    bits <<= 52;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// exp(hi + lo) for |hi| < EXP_MAX, where lo is a small correction to hi
+static inline double exp_lane2(double hi_in, double lo_in) {
+    double k = fabs(hi_in) < EXP_MAX ? round_to_integer(hi_in * INV_LN2) : 0.0;
+    double hi = hi_in - k * LN2_HI;
+    double lo = k * LN2_LO - lo_in;
+    double r = hi - lo;
+    double t = r * r;
+    double c = r - t * (P1 + t * (P2 + t * (P3 + t * (P4 + t * P5))));
+    double y = 1.0 - ((lo - (r * c) / (2.0 - c)) - hi);
+    return y * power_of_two(k);
+}
+
+static inline double exp_lane(double x) {
+    return exp_lane2(x, 0.0);
+}
+
+// x = 2^k * (1 + f) with sqrt(2)/2 <= 1 + f <= sqrt(2), for normal positive x
+static inline double reduce_logarithm(double x, double* f) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    uint64_t exponent_bits = (bits >> 52) | TWO_TO_52_BITS;  // 2^52 + the biased exponent
+    double biased;
+    memcpy(&biased, &exponent_bits, sizeof(biased));
+    double k = biased - (TWO_TO_52 + 1023.0);
+    uint64_t significand_bits = (bits & SIGNIFICAND_MASK) | EXPONENT_OF_ONE;
+    double m;
+    memcpy(&m, &significand_bits, sizeof(m));
+    int above = m > SQRT2;
+    *f = (above ? m * 0.5 : m) - 1.0;
+    return above ? k + 1.0 : k;
+}
+
+// log(1 + f) - f + f^2/2 as s * (f^2/2 + R), the part the polynomial supplies
+static inline double log_polynomial(double s) {
+    double z = s * s, w = z * z;
+    return z * (LG1 + w * (LG3 + w * (LG5 + w * LG7))) + w * (LG2 + w * (LG4 + w * LG6));
+}
+
+static inline double log_lane(double x) {
+    double f;
+    double k = reduce_logarithm(x, &f);
+    double s = f / (2.0 + f);
+    double hfsq = 0.5 * f * f;
+    return k * LN2_HI - ((hfsq - (s * (hfsq + log_polynomial(s)) + k * LN2_LO)) - f);
+}
+
+static inline double log10_lane(double x) {
+    double f;
+    double k = reduce_logarithm(x, &f);
+    double s = f / (2.0 + f);
+    double hfsq = 0.5 * f * f;
+    double r = s * (hfsq + log_polynomial(s));
+
+    // f - hfsq split so that hi * IVLN10_HI is exact, keeping log10(10^n) = n exact
+    double hi = f - hfsq;
+    uint64_t bits;
+    memcpy(&bits, &hi, sizeof(bits));
+    bits &= 0xFFFFFFFF00000000ull;
+    memcpy(&hi, &bits, sizeof(hi));
+    double lo = (f - hi) - hfsq + r;
+
+    double value_hi = hi * IVLN10_HI;
+    double y2 = k * LOG10_2_HI;
+    double value_lo = k * LOG10_2_LO + (lo + hi) * IVLN10_LO + lo * IVLN10_HI;
+    double w = y2 + value_hi;
+    value_lo += (y2 - w) + value_hi;
+    return value_lo + w;
+}
+
+// Error-free transformations: a + b = s + e and a * b = p + e exactly (Knuth, Dekker)
+static inline void two_sum(double a, double b, double* s, double* e) {
+    double sum = a + b;
+    double b_part = sum - a;
+    *e = (a - (sum - b_part)) + (b - b_part);
+    *s = sum;
+}
+
+static inline void two_product(double a, double b, double* p, double* e) {
+    double product = a * b;
+    double a_split = 134217729.0 * a, b_split = 134217729.0 * b;  // 2^27 + 1
+    double a_hi = a_split - (a_split - a), a_lo = a - a_hi;
+    double b_hi = b_split - (b_split - b), b_lo = b - b_hi;
+    *e = ((a_hi * b_hi - product) + a_hi * b_lo + a_lo * b_hi) + a_lo * b_lo;
+    *p = product;
+}
+
+// log(x) as hi + lo with about 2^-57 relative error, for pow
+static inline double log_lane2(double x, double* lo_out) {
+    double f;
+    double k = reduce_logarithm(x, &f);
+
+    // s = f / (2 + f) to double-double precision
+    double d = 2.0 + f;
+    double d_lo = f - (d - 2.0);
+    double s = f / d;
+    double p, p_lo;
+    two_product(s, d, &p, &p_lo);
+    double s_lo = ((f - p) - p_lo - s * d_lo) / d;
+
+    // f^2 / 2 exactly, and the tail s * (f^2/2 + R)
+    double h, h_lo;
+    two_product(f, f, &h, &h_lo);
+    h *= 0.5;
+    h_lo *= 0.5;
+    double u, u_lo;
+    two_sum(h, log_polynomial(s), &u, &u_lo);
+    u_lo += h_lo;
+    double tail, tail_lo;
+    two_product(s, u, &tail, &tail_lo);
+    tail_lo += s * u_lo + s_lo * u;
+
+    // k ln2 + f - f^2/2 + tail
+    double v1, e1, v2, e2, v3, e3;
+    two_sum(k * LN2_HI, f, &v1, &e1);
+    two_sum(v1, -h, &v2, &e2);
+    two_sum(v2, tail, &v3, &e3);
+    double lo = e1 + e2 + e3 + tail_lo - h_lo + k * LN2_LO;
+    double hi = v3 + lo;
+    *lo_out = lo - (hi - v3);
+    return hi;
+}
+
+// Which arguments the vector loops handle; libm takes the rest
+static inline int radians_covered(double x) {
+    return fabs(x) < TRIG_MAX_RADIANS;
+}
+
+static inline int degrees_covered(double x) {
+    return fabs(x) < DEGREE_MAX;
+}
+
+static inline int exp_covered(double x) {
+    return fabs(x) < EXP_MAX;
+}
+
+static inline int logarithm_covered(double x) {
+    return x >= DBL_MIN && x <= DBL_MAX;
+}
+
+// Huge angles: fmod is exact, and brings them into range of the exact reduction
+static double sin_degrees_fallback(double x) {
+    return sin_degrees_lane(fmod(x, 360.0));
+}
+
+static double cos_degrees_fallback(double x) {
+    return cos_degrees_lane(fmod(x, 360.0));
+}
+
+static double tan_degrees_fallback(double x) {
+    return tan_degrees_lane(fmod(x, 360.0));
+}
+
+// One chunk at a time: the branch-free loop over every element, then the fallback for the few it
+// does not cover. Results go through a local buffer, so out may alias x.
+#define UNARY_KERNEL(name, lane, covered, fallback)                               \
+    void name(const double* x, double* out, int count) {                          \
+        double result[KERNEL_BATCH];                                              \
+        for (int start = 0; start < count; start += KERNEL_BATCH) {               \
+            int n = count - start < KERNEL_BATCH ? count - start : KERNEL_BATCH;  \
+            const double* in = x + start;                                         \
+            for (int i = 0; i < n; i++) result[i] = lane(in[i]);                  \
+            for (int i = 0; i < n; i++) {                                         \
+                if (!covered(in[i])) result[i] = fallback(in[i]);                 \
+            }                                                                     \
+            memcpy(out + start, result, n * sizeof(double));                      \
+        }                                                                         \
+    }
+
+UNARY_KERNEL(kernel_sin, sin_lane, radians_covered, sin)
+UNARY_KERNEL(kernel_cos, cos_lane, radians_covered, cos)
+UNARY_KERNEL(kernel_tan, tan_lane, radians_covered, tan)
+UNARY_KERNEL(kernel_sin_degrees, sin_degrees_lane, degrees_covered, sin_degrees_fallback)
+UNARY_KERNEL(kernel_cos_degrees, cos_degrees_lane, degrees_covered, cos_degrees_fallback)
+UNARY_KERNEL(kernel_tan_degrees, tan_degrees_lane, degrees_covered, tan_degrees_fallback)
+UNARY_KERNEL(kernel_exp, exp_lane, exp_covered, exp)
+UNARY_KERNEL(kernel_log, log_lane, logarithm_covered, log)
+UNARY_KERNEL(kernel_log10, log10_lane, logarithm_covered, log10)
+
+// The square root instruction is correctly rounded and vectorizes as it is; negative arguments give NaN
+void kernel_sqrt(const double* x, double* out, int count) {
+    for (int i = 0; i < count; i++) out[i] = sqrt(x[i]);
+}
+
+void kernel_pow(const double* base, const double* exponent, double* out, int count) {
+    double result[KERNEL_BATCH], product[KERNEL_BATCH];
+    for (int start = 0; start < count; start += KERNEL_BATCH) {
+        int n = count - start < KERNEL_BATCH ? count - start : KERNEL_BATCH;
+        const double* x = base + start;
+        const double* y = exponent + start;
+
+        // exp(y * log(x)), carrying the low parts of the logarithm and the product
+        for (int i = 0; i < n; i++) {
+            double log_lo, t, t_lo;
+            double log_hi = log_lane2(x[i], &log_lo);
+            two_product(y[i], log_hi, &t, &t_lo);
+            t_lo += y[i] * log_lo;
+            product[i] = t;
+            result[i] = exp_lane2(t, t_lo);
+        }
+        for (int i = 0; i < n; i++) {
+            int covered = logarithm_covered(x[i]) && fabs(y[i]) < POW_MAX_EXPONENT &&
+                          round_to_integer(y[i]) != y[i] && exp_covered(product[i]);
+            if (!covered) result[i] = pow(x[i], y[i]);
+        }
+        memcpy(out + start, result, n * sizeof(double));
+    }
+}
+
+// The logarithm of 0 is ERR:DOMAIN on the TI-84, not an overflow: turn the -inf only it gives into NaN
+static void logarithm_domain(double* out, int count) {
+    for (int i = 0; i < count; i++) out[i] = out[i] == -INFINITY ? NAN : out[i];
+}
+
+void kernel_apply_function(const CalcContext* context, FunctionId func, const double* x, double* out, int count) {
+    int degrees = context->angle == ANGLE_DEGREE;
+    switch (func) {
+        case FUNC_LOG: kernel_log10(x, out, count); logarithm_domain(out, count); break;
+        case FUNC_LN:  kernel_log(x, out, count); logarithm_domain(out, count); break;
+        case FUNC_SIN: (degrees ? kernel_sin_degrees : kernel_sin)(x, out, count); break;
+        case FUNC_COS: (degrees ? kernel_cos_degrees : kernel_cos)(x, out, count); break;
+        case FUNC_TAN: (degrees ? kernel_tan_degrees : kernel_tan)(x, out, count); break;
+        case FUNC_SQRT: kernel_sqrt(x, out, count); break;
+        default:
+            for (int i = 0; i < count; i++) out[i] = 0.0;
+            break;
+    }
+}
@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "number_scan.h"
+
+#define FAST_PATH_DIGITS 19        // Decimal digits that always fit in 64 bits
+#define FAST_PATH_MAX_POWER 22     // 10^22 is the largest power of ten a double holds exactly
+#define FAST_PATH_MAX_MANTISSA (1ull << 53)
+
+static const double powers_of_ten[FAST_PATH_MAX_POWER + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Correctly rounded fallback for the cases the fast path cannot do exactly
+static double slow_path(const char* text, int length) {
+    char buffer[128];
+    char* copy = length < (int)sizeof(buffer) ? buffer : malloc(length + 1);
+    if (copy == NULL) return 0.0;
+
+    // strtod reads 'e' and '-' and assumes a '.' decimal point, which holds in the C locale the emulator
+    // runs in; the TI negative sign ~ or neg of the exponent becomes '-'
+    int used = 0;
+    for (int i = 0; i < length; i++) {
+        if (text[i] == 'E') {
+            copy[used++] = 'e';
+        } else if (text[i] == '~') {
+            copy[used++] = '-';
+        } else if (strncmp(text + i, "neg", 3) == 0) {
+            copy[used++] = '-';
+            i += 2;
+        } else {
+            copy[used++] = text[i];
+        }
+    }
+    copy[used] = '\0';
+    double value = strtod(copy, NULL);
+    if (copy != buffer) free(copy);
+    return value;
+}
+
+int scan_number(const char* text, double* value) {
+    const char* p = text;
+    uint64_t mantissa = 0;
+    int digits = 0;          // Significant digits accumulated in mantissa
+    int dropped = 0;         // Significant digits beyond what mantissa holds
+    int exponent = 0;        // Power of ten applied to mantissa
+    int any_digits = 0;
+
+    // Integer part; leading zeros are not significant
+    for (; is_digit(*p); p++) {
+        any_digits = 1;
+        if (digits == 0 && *p == '0') continue;
+        if (digits < FAST_PATH_DIGITS) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits++;
+        } else {
+            dropped++;
+            exponent++;
+        }
+    }
+    // Fraction
+    if (*p == '.') {
+        p++;
+        for (; is_digit(*p); p++) {
+            any_digits = 1;
+            if (digits == 0 && *p == '0') {
+                exponent--;
+                continue;
+            }
+            if (digits < FAST_PATH_DIGITS) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits++;
+                exponent--;
+            } else {
+                dropped++;
+            }
+        }
+    }
+    if (!any_digits) return 0;
+
+    // Exponent: only when digits follow, so "2E" stays 2 times the variable E
+    if (*p == 'E') {
+        const char* q = p + 1;
+        int negative = 0;
+        if (*q == '-' || *q == '+' || *q == '~') {
+            negative = *q++ != '+';
+        } else if (strncmp(q, "neg", 3) == 0) {  // The (-) key
+            negative = 1;
+            q += 3;
+        }
+        if (is_digit(*q)) {
+            int power = 0;
+            for (; is_digit(*q); q++) {
+                if (power < 100000) power = power * 10 + (*q - '0');  // Far past any double's range
+            }
+            exponent += negative ? -power : power;
+            p = q;
+        }
+    }
+    int length = (int)(p - text);
+
+    // Clinger's fast path: an exact mantissa and an exact power of ten give a correctly rounded result
+    if (dropped == 0 && mantissa <= FAST_PATH_MAX_MANTISSA) {
+        if (mantissa == 0) {
+            *value = 0.0;
+            return length;
+        }
+        if (exponent >= 0 && exponent <= FAST_PATH_MAX_POWER) {
+            *value = (double)mantissa * powers_of_ten[exponent];
+            return length;
+        }
+        if (exponent > FAST_PATH_MAX_POWER && exponent <= FAST_PATH_MAX_POWER + FAST_PATH_DIGITS - 4) {
+            // 12E30: move the excess power into the mantissa while it stays exact
+            uint64_t scaled = mantissa;
+            int shift = exponent - FAST_PATH_MAX_POWER;
+            while (shift > 0 && scaled <= FAST_PATH_MAX_MANTISSA / 10) {
+                scaled *= 10;
+                shift--;
+            }
+            if (shift == 0) {
+                *value = (double)scaled * powers_of_ten[FAST_PATH_MAX_POWER];
+                return length;
+            }
+        }
+        if (exponent < 0 && exponent >= -FAST_PATH_MAX_POWER) {
+            *value = (double)mantissa / powers_of_ten[-exponent];
+            return length;
+        }
+    }
+
+    *value = slow_path(text, length);
+    return length;
+}
@@ -0,0 +1,155 @@
+#include <string.h>
+#include "optimizer.h"
+
+// An expression tree node. Identical subtrees share one node, which is how repeats are found.
+typedef struct {
+    Token token;    // Operation at this node; operands are in left and right
+    int left;       // Operand node, or -1
+    int right;      // Second operand of a binary operator, or -1
+    int uses;       // References from other nodes
+    int temp;       // Temporary holding the value once emitted, or -1
+} OptNode;
+
+typedef struct {
+    OptNode nodes[MAX_PROGRAM_LENGTH];
+    int count;
+    int temps;
+} Optimizer;
+
+static int is_leaf(const OptNode* node) {
+    return node->left < 0;
+}
+
+static int same_token(const Token* a, const Token* b) {
+    if (a->type != b->type) return 0;
+    switch (a->type) {
+        case TOKEN_NUMBER:
+        case TOKEN_POWER_INT:
+            return memcmp(&a->value, &b->value, sizeof(double)) == 0;  // Bitwise, so -0 and NaN behave
+        case TOKEN_VARIABLE:
+            return a->variable == b->variable;
+        case TOKEN_OPERATOR:
+            return a->op == b->op;
+        case TOKEN_FUNCTION:
+            return a->func == b->func;
+        default:
+            return 1;
+    }
+}
+
+// Find or add the node for token applied to left and right
+static int make_node(Optimizer* opt, const Token* token, int left, int right) {
+    for (int i = 0; i < opt->count; i++) {
+        OptNode* node = &opt->nodes[i];
+        if (node->left == left && node->right == right && same_token(&node->token, token)) return i;
+    }
+
+    OptNode* node = &opt->nodes[opt->count];
+    node->token = *token;
+    node->left = left;
+    node->right = right;
+    node->uses = 0;
+    node->temp = -1;
+    if (left >= 0) opt->nodes[left].uses++;
+    if (right >= 0) opt->nodes[right].uses++;
+    return opt->count++;
+}
+
+static int make_constant(Optimizer* opt, double value) {
+    Token token = { TOKEN_NUMBER, value, 0, FUNC_UNKNOWN, 0 };
+    return make_node(opt, &token, -1, -1);
+}
+
+static int constant_of(const Optimizer* opt, int index, double* value) {
+    const OptNode* node = &opt->nodes[index];
+    if (node->token.type != TOKEN_NUMBER) return 0;
+    *value = node->token.value;
+    return 1;
+}
+
+// Build the tree bottom-up from the postfix program, folding and rewriting as nodes are made
+static int build_tree(Optimizer* opt, const CalcContext* context, const Program* program) {
+    int stack[MAX_PROGRAM_LENGTH];
+    int top = -1;
+
+    for (int i = 0; i < program->length; i++) {
+        const Token* token = &program->tokens[i];
+        double a, b;
+        switch (token->type) {
+            case TOKEN_NUMBER:
+            case TOKEN_VARIABLE_X:
+            case TOKEN_VARIABLE:
+            case TOKEN_IMAGINARY:
+                stack[++top] = make_node(opt, token, -1, -1);
+                break;
+            case TOKEN_NEGATE:
+                if (constant_of(opt, stack[top], &a)) {
+                    stack[top] = make_constant(opt, negate(a));
+                } else {
+                    stack[top] = make_node(opt, token, stack[top], -1);
+                }
+                break;
+            case TOKEN_FUNCTION:
+                if (constant_of(opt, stack[top], &a) && !is_sequence_function(token->func)) {  // u(5) changes with u
+                    stack[top] = make_constant(opt, apply_function(context, token->func, a));
+                } else {
+                    stack[top] = make_node(opt, token, stack[top], -1);
+                }
+                break;
+            case TOKEN_OPERATOR: {
+                int right = stack[top--];
+                int left = stack[top];
+                if (constant_of(opt, left, &a) && constant_of(opt, right, &b)) {
+                    stack[top] = make_constant(opt, apply_operation(a, b, token->op));
+                } else if (token->op == '^' && constant_of(opt, right, &b) &&
+                           b == (int)b && b >= 0 && b <= OPTIMIZER_MAX_POWER) {
+                    Token power = { TOKEN_POWER_INT, b, 0, FUNC_UNKNOWN, 0 };
+                    stack[top] = make_node(opt, &power, left, -1);
+                } else {
+                    stack[top] = make_node(opt, token, left, right);
+                }
+                break;
+            }
+            default:
+                return -1;  // Already optimized
+        }
+    }
+    return top == 0 ? stack[0] : -1;
+}
+
+static void emit(Program* program, const Token* token) {
+    program->tokens[program->length++] = *token;
+}
+
+// Emit a subtree in postfix order; a shared subtree is stored the first time and loaded after that
+static void emit_tree(Optimizer* opt, int index, Program* program) {
+    OptNode* node = &opt->nodes[index];
+    if (node->temp >= 0) {
+        Token load = { TOKEN_LOAD, 0.0, 0, FUNC_UNKNOWN, node->temp };
+        emit(program, &load);
+        return;
+    }
+
+    if (node->left >= 0) emit_tree(opt, node->left, program);
+    if (node->right >= 0) emit_tree(opt, node->right, program);
+    emit(program, &node->token);
+
+    if (node->uses > 1 && !is_leaf(node) && opt->temps < MAX_PROGRAM_TEMPS) {
+        node->temp = opt->temps++;
+        Token store = { TOKEN_STORE, 0.0, 0, FUNC_UNKNOWN, node->temp };
+        emit(program, &store);
+    }
+}
+
+void optimize_program(const CalcContext* context, Program* program) {
+    static _Thread_local Optimizer opt;
+
+    opt.count = 0;
+    opt.temps = 0;
+    int root = build_tree(&opt, context, program);
+    if (root < 0) return;
+
+    // Sharing never makes the program longer: each temporary replaces a subtree of two or more tokens
+    program->length = 0;
+    emit_tree(&opt, root, program);
+}
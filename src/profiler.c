@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "profiler.h"
+
+typedef struct {
+    const char* name;
+    uint64_t start, end;
+} ProfileEvent;
+
+// One thread's events; the ring outlives its thread so the trace still shows it
+typedef struct {
+    ProfileEvent events[PROFILE_RING_EVENTS];
+    uint64_t count;           // Events ever recorded; the ring holds the last PROFILE_RING_EVENTS
+    char thread_name[32];
+    int tid;
+    int active;               // Owned by a running thread
+} ProfileRing;
+
+static ProfileRing* rings[PROFILE_MAX_THREADS];
+static int ring_count = 0;
+static int next_tid = 1;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;
+static _Thread_local ProfileRing* thread_ring = NULL;
+static _Thread_local int thread_unprofiled = 0;  // No ring was free for this thread
+static uint64_t origin = 0;  // Trace timestamps count from the first clock reading
+
+// UI thread statistics
+static double frame_times[PROFILE_FRAME_SAMPLES];
+static double input_latencies[PROFILE_FRAME_SAMPLES];
+static int frame_count = 0, latency_count = 0;
+static uint64_t frame_start = 0;
+static uint64_t pending_inputs[PROFILE_PENDING_INPUTS];
+static int pending_count = 0;
+
+uint64_t profile_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Thread exit: hand the ring back, keeping its events for the trace
+static void release_ring(void* ring) {
+    pthread_mutex_lock(&registry_lock);
+    ((ProfileRing*)ring)->active = 0;
+    pthread_mutex_unlock(&registry_lock);
+}
+
+static void create_key() {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+// Give the calling thread a ring: a fresh one, or the one an exited thread left behind
+static ProfileRing* acquire_ring() {
+    ProfileRing* ring = NULL;
+
+    pthread_once(&key_once, create_key);
+    pthread_mutex_lock(&registry_lock);
+    if (origin == 0) origin = profile_now();
+    if (ring_count < PROFILE_MAX_THREADS) {
+        ring = calloc(1, sizeof(ProfileRing));
+        if (ring != NULL) rings[ring_count++] = ring;
+    } else {
+        for (int i = 0; i < ring_count && ring == NULL; i++) {
+            if (!rings[i]->active) ring = rings[i];
+        }
+    }
+    if (ring != NULL) {
+        ring->count = 0;
+        ring->tid = next_tid++;
+        ring->active = 1;
+        snprintf(ring->thread_name, sizeof(ring->thread_name), "thread %d", ring->tid);
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    if (ring == NULL) {
+        thread_unprofiled = 1;
+        return NULL;
+    }
+    pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+void profile_record(const char* name, uint64_t start, uint64_t end) {
+    ProfileRing* ring = thread_ring;
+    if (ring == NULL) {
+        if (thread_unprofiled) return;
+        ring = thread_ring = acquire_ring();
+        if (ring == NULL) return;
+    }
+    ProfileEvent* event = &ring->events[ring->count % PROFILE_RING_EVENTS];
+    event->name = name;
+    event->start = start;
+    event->end = end;
+    ring->count++;
+}
+
+void profile_thread_name(const char* name) {
+    if (thread_ring == NULL && !thread_unprofiled) thread_ring = acquire_ring();
+    if (thread_ring == NULL) return;
+    snprintf(thread_ring->thread_name, sizeof(thread_ring->thread_name), "%s", name);
+}
+
+void profile_scope_end(ProfileScope* scope) {
+    profile_record(scope->name, scope->start, profile_now());
+}
+
+void profile_frame_begin() {
+    frame_start = profile_now();
+}
+
+void profile_frame_end() {
+    uint64_t end = profile_now();
+    profile_record("frame", frame_start, end);
+    frame_times[frame_count++ % PROFILE_FRAME_SAMPLES] = (end - frame_start) * 1e-6;
+}
+
+void profile_input_event(uint64_t queued_ns) {
+    if (pending_count < PROFILE_PENDING_INPUTS) pending_inputs[pending_count++] = profile_now() - queued_ns;
+}
+
+// Every key press since the last present is now visible
+void profile_present_done() {
+    uint64_t now = profile_now();
+    for (int i = 0; i < pending_count; i++) {
+        profile_record("input latency", pending_inputs[i], now);
+        input_latencies[latency_count++ % PROFILE_FRAME_SAMPLES] = (now - pending_inputs[i]) * 1e-6;
+    }
+    pending_count = 0;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of the first count samples
+static double percentile(const double* samples, int count, double p) {
+    double sorted[PROFILE_FRAME_SAMPLES];
+    if (count == 0) return 0.0;
+    memcpy(sorted, samples, count * sizeof(double));
+    qsort(sorted, count, sizeof(double), compare_doubles);
+    int rank = (int)(p * count + 0.999999) - 1;
+    return sorted[rank < 0 ? 0 : rank];
+}
+
+ProfileSummary profile_summary() {
+    ProfileSummary summary;
+    int frames = frame_count < PROFILE_FRAME_SAMPLES ? frame_count : PROFILE_FRAME_SAMPLES;
+    int inputs = latency_count < PROFILE_FRAME_SAMPLES ? latency_count : PROFILE_FRAME_SAMPLES;
+    summary.frame_p50 = percentile(frame_times, frames, 0.50);
+    summary.frame_p99 = percentile(frame_times, frames, 0.99);
+    summary.latency_p50 = percentile(input_latencies, inputs, 0.50);
+    summary.latency_p99 = percentile(input_latencies, inputs, 0.99);
+    summary.frames = frame_count;
+    summary.inputs = latency_count;
+    return summary;
+}
+
+int profile_write_trace(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        printf("Could not open %s\n", path);
+        return 0;
+    }
+
+    ProfileSummary summary = profile_summary();
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"frames\":%d,\"frame_p50_ms\":%.3f,"
+                  "\"frame_p99_ms\":%.3f,\"inputs\":%d,\"latency_p50_ms\":%.3f,\"latency_p99_ms\":%.3f},\n"
+                  "\"traceEvents\":[\n",
+            summary.frames, summary.frame_p50, summary.frame_p99,
+            summary.inputs, summary.latency_p50, summary.latency_p99);
+
+    int first = 1;
+    pthread_mutex_lock(&registry_lock);
+    for (int i = 0; i < ring_count; i++) {
+        ProfileRing* ring = rings[i];
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", ring->tid, ring->thread_name);
+        first = 0;
+
+        uint64_t oldest = ring->count > PROFILE_RING_EVENTS ? ring->count - PROFILE_RING_EVENTS : 0;
+        for (uint64_t e = oldest; e < ring->count; e++) {
+            const ProfileEvent* event = &ring->events[e % PROFILE_RING_EVENTS];
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    event->name, ring->tid, (int64_t)(event->start - origin) * 1e-3, (event->end - event->start) * 1e-3);
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    fprintf(file, "\n]}\n");
+
+    int ok = fclose(file) == 0;
+    if (ok) printf("Profile written to %s\n", path);
+    return ok;
+}
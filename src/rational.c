@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "rational.h"
+#include "format.h"
+
+#define CONTINUED_FRACTION_TERMS 64  // More than any double needs: convergent denominators grow like Fibonacci numbers
+
+uint64_t rational_gcd(uint64_t a, uint64_t b) {
+    if (a == 0) return b;
+    if (b == 0) return a;
+
+    // Common factors of two, then replace the larger odd number by the difference until they meet.
+    // Written with min and abs instead of a swap, so the loop has no branch to mispredict.
+    int a_zeros = __builtin_ctzll(a), b_zeros = __builtin_ctzll(b);
+    int shift = a_zeros < b_zeros ? a_zeros : b_zeros;
+    a >>= a_zeros;
+    do {
+        b >>= b_zeros;
+        uint64_t difference = b - a, negated = a - b;
+        b_zeros = __builtin_ctzll(difference | (1ull << 63));  // Same as for |a - b|; defined for 0
+        uint64_t smaller = a < b ? a : b;
+        b = a > b ? negated : difference;
+        a = smaller;
+    } while (b != 0);
+    return a << shift;
+}
+
+static uint64_t magnitude(int64_t value) {
+    return value < 0 ? -(uint64_t)value : (uint64_t)value;
+}
+
+Rational rational_reduce(Rational value) {
+    int64_t g = (int64_t)rational_gcd(magnitude(value.num), value.den);
+    if (g > 1) {
+        value.num /= g;
+        value.den /= g;
+    }
+    return value;
+}
+
+// Store a 128-bit result if it fits
+static int store(__int128 num, __int128 den, Rational* out) {
+    if (num <= INT64_MIN || num > INT64_MAX || den > INT64_MAX) return 0;
+    out->num = (int64_t)num;
+    out->den = (int64_t)den;
+    return 1;
+}
+
+// a + b in lowest terms, for a and b in lowest terms. With g = gcd(a.den, b.den), the numerator can
+// only share a factor with the denominator through g (Knuth, TAOCP 4.5.1), so the second GCD is small.
+static int add_reduced(Rational a, Rational b, Rational* out) {
+    uint64_t g = rational_gcd(a.den, b.den);
+    __int128 num = (__int128)a.num * (int64_t)(b.den / g) + (__int128)b.num * (int64_t)(a.den / g);
+    if (num == 0) {
+        out->num = 0;
+        out->den = 1;
+        return 1;
+    }
+    uint64_t g2 = 1;
+    if (g != 1) {
+        unsigned __int128 n = num < 0 ? -(unsigned __int128)num : (unsigned __int128)num;
+        g2 = rational_gcd(n >> 64 ? (uint64_t)(n % g) : (uint64_t)n % g, g);
+    }
+    return store(num / (__int128)g2, (__int128)(a.den / g) * (int64_t)(b.den / g2), out);
+}
+
+// a * b in lowest terms, for a and b in lowest terms: cancel across before multiplying
+static int multiply_reduced(Rational a, Rational b, Rational* out) {
+    int64_t g1 = (int64_t)rational_gcd(magnitude(a.num), b.den);
+    int64_t g2 = (int64_t)rational_gcd(magnitude(b.num), a.den);
+    return store((__int128)(a.num / g1) * (b.num / g2), (__int128)(a.den / g2) * (b.den / g1), out);
+}
+
+// The plain formulas need a few multiplications and no GCD. Only when their result does not fit
+// are the operands reduced and the result computed in lowest terms, which fits if anything does.
+int rational_add(Rational a, Rational b, Rational* out) {
+    if (a.den == b.den && store((__int128)a.num + b.num, a.den, out)) return 1;
+    if (store((__int128)a.num * b.den + (__int128)b.num * a.den, (__int128)a.den * b.den, out)) return 1;
+    return add_reduced(rational_reduce(a), rational_reduce(b), out);
+}
+
+int rational_subtract(Rational a, Rational b, Rational* out) {
+    b.num = -b.num;
+    return rational_add(a, b, out);
+}
+
+int rational_multiply(Rational a, Rational b, Rational* out) {
+    if (store((__int128)a.num * b.num, (__int128)a.den * b.den, out)) return 1;
+    return multiply_reduced(rational_reduce(a), rational_reduce(b), out);
+}
+
+int rational_divide(Rational a, Rational b, Rational* out) {
+    if (b.num == 0) return 0;
+    Rational reciprocal = { b.num < 0 ? -b.den : b.den, b.num < 0 ? -b.num : b.num };
+    return rational_multiply(a, reciprocal, out);
+}
+
+int rational_power(Rational base, int64_t exponent, Rational* out) {
+    if (exponent < 0) {
+        Rational one = { 1, 1 };
+        if (exponent == INT64_MIN || !rational_divide(one, base, &base)) return 0;
+        exponent = -exponent;
+    }
+
+    // Repeated squaring, like power_int; 0^0 is 1 as with pow
+    Rational result = { 1, 1 };
+    while (exponent > 0) {
+        if ((exponent & 1) && !rational_multiply(result, base, &result)) return 0;
+        exponent >>= 1;
+        if (exponent > 0 && !rational_multiply(base, base, &base)) return 0;
+    }
+    *out = result;
+    return 1;
+}
+
+double rational_to_double(Rational value) {
+    // Both parts are exact in a double below 2^53, and then the division rounds once
+    if (magnitude(value.num) <= (1ull << 53) && (uint64_t)value.den <= (1ull << 53)) {
+        return (double)value.num / (double)value.den;
+    }
+    return (double)((long double)value.num / (long double)value.den);
+}
+
+int rational_from_double(double x, int64_t max_denominator, double tolerance, Rational* out) {
+    if (!isfinite(x) || fabs(x) >= 9223372036854775807.0) return 0;
+
+    // Convergents h/k of the continued fraction [a0; a1, a2, ...] of |x|
+    double target = fabs(x);
+    double remainder = target;
+    int64_t h_previous = 0, h = 1, k_previous = 1, k = 0;
+    for (int i = 0; i < CONTINUED_FRACTION_TERMS; i++) {
+        double term = floor(remainder);
+        if (term >= 9223372036854775807.0) return 0;
+        int64_t a = (int64_t)term, h_next, k_next;
+        if (__builtin_mul_overflow(a, h, &h_next) || __builtin_add_overflow(h_next, h_previous, &h_next) ||
+            __builtin_mul_overflow(a, k, &k_next) || __builtin_add_overflow(k_next, k_previous, &k_next) ||
+            k_next > max_denominator) {
+            return 0;
+        }
+        h_previous = h;
+        h = h_next;
+        k_previous = k;
+        k = k_next;
+
+        Rational convergent = { h, k };
+        double approximation = rational_to_double(convergent);
+        if (tolerance == 0 ? approximation == target : fabs(approximation - target) <= tolerance * target) {
+            out->num = x < 0 ? -h : h;
+            out->den = k;
+            return 1;
+        }
+        if (remainder == term) return 0;
+        remainder = 1.0 / (remainder - term);  // The subtraction is exact
+    }
+    return 0;
+}
+
+static int whole_fraction(double value, Rational* out) {
+    if (fabs(value) < 9223372036854775807.0 && value == (double)(int64_t)value) {
+        out->num = (int64_t)value;
+        out->den = 1;
+        return 1;
+    }
+    return 0;
+}
+
+// The fraction a constant was typed as: 0.1 is 1/10, not the binary value of the double
+static int exact_fraction(double value, Rational* out) {
+    return whole_fraction(value, out) || rational_from_double(value, INT64_MAX, 0, out);
+}
+
+// A variable holds the result of some earlier computation, which may be inexact: Ans after 0.1+0.2 is
+// 0.30000000000000004, and should still read as 3/10. Like the TI-84, take the small fraction near it.
+static int variable_fraction(double value, Rational* out) {
+    return whole_fraction(value, out) || rational_from_double(value, FRAC_MAX_DENOMINATOR, FRAC_TOLERANCE, out);
+}
+
+int run_program_rational(const CalcContext* context, const Program* program, Rational x, Rational* out) {
+    Rational values[MAX_PROGRAM_LENGTH];
+    Rational temps[MAX_PROGRAM_TEMPS];
+    int value_top = -1;
+
+    for (int i = 0; i < program->length; i++) {
+        const Token* token = &program->tokens[i];
+        switch (token->type) {
+            case TOKEN_NUMBER:
+                if (!exact_fraction(token->value, &values[++value_top])) return 0;
+                break;
+            case TOKEN_VARIABLE_X:
+                values[++value_top] = x;
+                break;
+            case TOKEN_VARIABLE:
+                if (!variable_fraction(context->variables[token->variable], &values[++value_top])) return 0;
+                break;
+            case TOKEN_OPERATOR: {
+                Rational b = values[value_top--];
+                Rational* a = &values[value_top];
+                int ok = 0;
+                switch (token->op) {
+                    case '+': ok = rational_add(*a, b, a); break;
+                    case '-': ok = rational_subtract(*a, b, a); break;
+                    case '*': ok = rational_multiply(*a, b, a); break;
+                    case '/': ok = rational_divide(*a, b, a); break;
+                    case '^':
+                        b = rational_reduce(b);
+                        ok = b.den == 1 && rational_power(*a, b.num, a);
+                        break;
+                }
+                if (!ok) return 0;
+                break;
+            }
+            case TOKEN_NEGATE:
+                values[value_top].num = -values[value_top].num;
+                break;
+            case TOKEN_FUNCTION:
+                return 0;  // log, ln, sqrt and the trig functions are irrational almost everywhere
+            case TOKEN_IMAGINARY:
+                return 0;
+            case TOKEN_POWER_INT:
+                if (!rational_power(values[value_top], (int64_t)token->value, &values[value_top])) return 0;
+                break;
+            case TOKEN_STORE:
+                temps[token->variable] = values[value_top];
+                break;
+            case TOKEN_LOAD:
+                values[++value_top] = temps[token->variable];
+                break;
+        }
+    }
+    if (value_top < 0) return 0;
+    *out = rational_reduce(values[value_top]);
+    return 1;
+}
+
+int strip_frac_suffix(char* expression) {
+    size_t length = strlen(expression), suffix = strlen(FRAC_SUFFIX);
+    if (length < suffix || strcmp(expression + length - suffix, FRAC_SUFFIX) != 0) return 0;
+    expression[length - suffix] = '\0';
+    return 1;
+}
+
+int evaluate_fraction(CalcContext* context, const char* expression, double* value, Rational* fraction) {
+    Program program;
+    *value = NAN;
+
+    printf("Evaluating expression as a fraction: %s\n", expression);
+
+    if (!compile_expression(expression, &program) || !program_is_real(context, &program) ||
+        evaluation_cancelled(context)) {
+        return 0;
+    }
+
+    double x = context->variables['X' - 'A'];
+    Rational exact_x;
+    int exact = variable_fraction(x, &exact_x) && run_program_rational(context, &program, exact_x, fraction);
+    *value = exact ? rational_to_double(*fraction) : run_program(context, &program, x);
+    if (evaluation_cancelled(context)) {
+        *value = NAN;  // Stopped part way: Ans keeps its value
+        return 0;
+    }
+    if (!isnan(*value)) {  // An error leaves Ans as it was
+        context->variables[CALC_ANS] = *value;
+        context->imaginary[CALC_ANS] = 0.0;
+    }
+    if (exact) {
+        printf("Exact result: %lld/%lld\n", (long long)fraction->num, (long long)fraction->den);
+        return 1;
+    }
+
+    // Inexact: the value as a fraction with a small denominator, if one is close enough
+    int found = rational_from_double(*value, FRAC_MAX_DENOMINATOR, FRAC_TOLERANCE, fraction);
+    char text[FORMAT_LENGTH];
+    format_shortest(*value, text);
+    printf("Result %s %s\n", text, found ? "converted to a fraction" : "has no fraction");
+    return found;
+}
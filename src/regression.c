@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "regression.h"
+#include "math_kernels.h"
+#include "number_scan.h"
+#include "format.h"
+#include "graph.h"
+#include "profiler.h"
+
+#define REGRESSION_COLUMNS (REGRESSION_MAX_TERMS + 1)  // The terms, then y
+#define REGRESSION_LINE_LENGTH 256
+
+static const char* model_names[] = { "LinReg", "QuadReg", "CubicReg", "ExpReg", "PwrReg" };
+static const char* model_equations[] = { "y=ax+b", "y=ax^2+bx+c", "y=ax^3+bx^2+cx+d", "y=a*b^x", "y=a*x^b" };
+static const int model_terms[] = { 2, 3, 4, 2, 2 };
+
+// A run of points reduced to the upper-triangular factor of their rows [1 t t^2 .. | y]
+typedef struct {
+    double r[REGRESSION_COLUMNS][REGRESSION_COLUMNS];
+    long count;
+    int outside_domain;  // A point had x <= 0 or y <= 0 where the model takes its logarithm
+} RegressionSummary;
+
+// One worker thread's share: chunks thread, thread + threads, ...
+typedef struct {
+    RegressionModel model;
+    const double* x;
+    const double* y;
+    long count;
+    double shift;  // Subtracted from x (ln x for PwrReg) before taking powers
+    RegressionSummary* summaries;
+    long chunks;
+    int thread;
+    int threads;
+} RegressionWorker;
+
+// Fold m more rows into a summary with one Householder reflection per column. The rows are stored by
+// column, so the loops over them run through contiguous memory; they are overwritten.
+static void fold_rows(RegressionSummary* summary, double rows[][REGRESSION_BLOCK], int m, int columns) {
+    for (int j = 0; j < columns; j++) {
+        double* v = rows[j];
+        double head = summary->r[j][j];
+        double norm2 = head * head;
+        for (int i = 0; i < m; i++) norm2 += v[i] * v[i];
+        if (norm2 == 0) continue;
+
+        // Reflect [head; v] onto alpha e1, with alpha of the opposite sign to head so head - alpha
+        // does not cancel. 2 / (u^T u) for u = [head - alpha; v] is 1 / (norm2 - alpha head).
+        double alpha = head > 0 ? -sqrt(norm2) : sqrt(norm2);
+        double u0 = head - alpha;
+        double scale = 1.0 / (norm2 - alpha * head);
+        summary->r[j][j] = alpha;
+        for (int l = j + 1; l < columns; l++) {
+            double* w = rows[l];
+            double dot = u0 * summary->r[j][l];
+            for (int i = 0; i < m; i++) dot += v[i] * w[i];
+            double f = dot * scale;
+            summary->r[j][l] -= f * u0;
+            for (int i = 0; i < m; i++) w[i] -= f * v[i];
+        }
+    }
+}
+
+// Append the points of another summary: its factor stands for them
+static void merge_summary(RegressionSummary* summary, const RegressionSummary* other, int columns) {
+    double rows[REGRESSION_COLUMNS][REGRESSION_BLOCK];
+    for (int l = 0; l < columns; l++) {
+        for (int i = 0; i < columns; i++) rows[l][i] = other->r[i][l];
+    }
+    fold_rows(summary, rows, columns, columns);
+    summary->count += other->count;
+    summary->outside_domain |= other->outside_domain;
+}
+
+static void summarize_chunk(const RegressionWorker* worker, long start, long end, RegressionSummary* summary) {
+    double rows[REGRESSION_COLUMNS][REGRESSION_BLOCK];
+    int terms = model_terms[worker->model];
+    memset(summary, 0, sizeof(*summary));
+    summary->count = end - start;
+
+    for (long first = start; first < end; first += REGRESSION_BLOCK) {
+        int m = end - first < REGRESSION_BLOCK ? (int)(end - first) : REGRESSION_BLOCK;
+        const double* x = worker->x + first;
+        const double* y = worker->y + first;
+        int outside = 0;
+
+        // Build the rows column by column so each loop vectorizes; the logarithms come from the kernels
+        for (int i = 0; i < m; i++) rows[0][i] = 1.0;
+        switch (worker->model) {
+            case REGRESSION_EXPONENTIAL:
+                for (int i = 0; i < m; i++) rows[1][i] = x[i] - worker->shift;
+                kernel_log(y, rows[2], m);
+                for (int i = 0; i < m; i++) outside |= !(y[i] > 0);
+                break;
+            case REGRESSION_POWER:
+                kernel_log(x, rows[1], m);
+                for (int i = 0; i < m; i++) rows[1][i] -= worker->shift;
+                kernel_log(y, rows[2], m);
+                for (int i = 0; i < m; i++) outside |= !(x[i] > 0) | !(y[i] > 0);
+                break;
+            default:
+                for (int i = 0; i < m; i++) rows[1][i] = x[i] - worker->shift;
+                for (int j = 2; j < terms; j++) {
+                    for (int i = 0; i < m; i++) rows[j][i] = rows[j - 1][i] * rows[1][i];
+                }
+                memcpy(rows[terms], y, m * sizeof(double));
+                break;
+        }
+        summary->outside_domain |= outside;
+        fold_rows(summary, rows, m, terms + 1);
+    }
+}
+
+static void summarize_share(RegressionWorker* worker) {
+    for (long chunk = worker->thread; chunk < worker->chunks; chunk += worker->threads) {
+        long start = chunk * REGRESSION_CHUNK;
+        long end = start + REGRESSION_CHUNK < worker->count ? start + REGRESSION_CHUNK : worker->count;
+        summarize_chunk(worker, start, end, &worker->summaries[chunk]);
+    }
+}
+
+static void* regression_thread(void* arg) {
+    profile_thread_name("regression");
+    summarize_share(arg);
+    return NULL;
+}
+
+int regression_fit(RegressionModel model, const double* x, const double* y, long count, RegressionFit* fit) {
+    PROFILE_SCOPE("regression_fit");
+    int terms = model_terms[model];
+    if (count < terms) {
+        printf("Error: %s needs at least %d points\n", model_names[model], terms);
+        return 0;
+    }
+
+    long chunks = (count + REGRESSION_CHUNK - 1) / REGRESSION_CHUNK;
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = processors < 1 ? 1 : processors < REGRESSION_MAX_THREADS ? (int)processors : REGRESSION_MAX_THREADS;
+    if (threads > chunks) threads = (int)chunks;
+    RegressionSummary* summaries = malloc(chunks * sizeof(RegressionSummary));
+    if (summaries == NULL) {
+        printf("Error: Out of memory\n");
+        return 0;
+    }
+
+    // Shifting by the first point keeps the powers of t small when the data sits far from 0 (years, say)
+    RegressionWorker workers[REGRESSION_MAX_THREADS];
+    pthread_t handles[REGRESSION_MAX_THREADS];
+    int started[REGRESSION_MAX_THREADS] = {0};
+    double shift = model == REGRESSION_POWER ? (x[0] > 0 ? log(x[0]) : 0.0) : x[0];
+    for (int t = 0; t < threads; t++) {
+        RegressionWorker worker = { model, x, y, count, shift, summaries, chunks, t, threads };
+        workers[t] = worker;
+    }
+    for (int t = 1; t < threads; t++) {
+        started[t] = pthread_create(&handles[t], NULL, regression_thread, &workers[t]) == 0;
+    }
+    summarize_share(&workers[0]);
+    for (int t = 1; t < threads; t++) {
+        if (started[t]) {
+            pthread_join(handles[t], NULL);
+        } else {
+            summarize_share(&workers[t]);  // Could not start a thread: do its share here
+        }
+    }
+
+    RegressionSummary total = summaries[0];
+    for (long chunk = 1; chunk < chunks; chunk++) merge_summary(&total, &summaries[chunk], terms + 1);
+    free(summaries);
+    printf("%s of %ld points in %ld chunks on %d threads\n", model_names[model], count, chunks, threads);
+
+    if (total.outside_domain) {
+        printf("Error: %s needs %s\n", model_names[model], model == REGRESSION_POWER ? "x > 0 and y > 0" : "y > 0");
+        return 0;
+    }
+
+    // Back substitution, refusing columns that (nearly) depend on the earlier ones, as when every x is the same
+    double b[REGRESSION_MAX_TERMS];
+    for (int j = terms - 1; j >= 0; j--) {
+        double column = 0.0;
+        for (int i = 0; i <= j; i++) column += total.r[i][j] * total.r[i][j];
+        if (!(fabs(total.r[j][j]) > REGRESSION_SINGULAR * sqrt(column))) {
+            printf("Error: %s is singular for this data\n", model_names[model]);
+            return 0;
+        }
+        double sum = total.r[j][terms];
+        for (int l = j + 1; l < terms; l++) sum -= total.r[j][l] * b[l];
+        b[j] = sum / total.r[j][j];
+    }
+
+    // The last column of the factor splits y: the residual is its last entry, and since the first
+    // column is all ones, the spread of y about its mean is everything below its first entry
+    double residual = total.r[terms][terms] * total.r[terms][terms];
+    double spread = 0.0;
+    for (int i = 1; i <= terms; i++) spread += total.r[i][terms] * total.r[i][terms];
+
+    memset(fit, 0, sizeof(*fit));
+    fit->model = model;
+    fit->terms = terms;
+    fit->count = total.count;
+    fit->r2 = spread > 0 ? 1.0 - residual / spread : 1.0;
+    fit->r = model == REGRESSION_QUADRATIC || model == REGRESSION_CUBIC ? NAN : copysign(sqrt(fit->r2), b[1]);
+    switch (model) {
+        case REGRESSION_EXPONENTIAL:  // ln y = b0 + b1 (x - shift)
+            fit->coefficients[0] = exp(b[0] - b[1] * shift);
+            fit->coefficients[1] = exp(b[1]);
+            break;
+        case REGRESSION_POWER:        // ln y = b0 + b1 (ln x - shift)
+            fit->coefficients[0] = exp(b[0] - b[1] * shift);
+            fit->coefficients[1] = b[1];
+            break;
+        default:
+            // Expand the sum of b_j (x - shift)^j into powers of x, highest first as the TI-84 lists them
+            for (int k = 0; k < terms; k++) {
+                double sum = 0.0, binomial = 1.0, power = 1.0;
+                for (int j = k; j < terms; j++) {
+                    sum += b[j] * binomial * power;
+                    binomial = binomial * (j + 1) / (j + 1 - k);
+                    power *= -shift;
+                }
+                fit->coefficients[terms - 1 - k] = sum;
+            }
+            break;
+    }
+    return 1;
+}
+
+double regression_evaluate(const RegressionFit* fit, double x) {
+    const double* c = fit->coefficients;
+    switch (fit->model) {
+        case REGRESSION_EXPONENTIAL: return c[0] * pow(c[1], x);
+        case REGRESSION_POWER:       return c[0] * pow(x, c[1]);
+        default: {
+            double sum = 0.0;
+            for (int k = 0; k < fit->terms; k++) sum = sum * x + c[k];
+            return sum;
+        }
+    }
+}
+
+int regression_lookup(const char* name, RegressionModel* model) {
+    for (int m = 0; m < (int)(sizeof(model_names) / sizeof(model_names[0])); m++) {
+        if (strcasecmp(name, model_names[m]) == 0) {
+            *model = (RegressionModel)m;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char* regression_name(RegressionModel model) {
+    return model_names[model];
+}
+
+// Append text to an expression being built, keeping track of the length
+static int append(char* out, size_t size, size_t* length, const char* text) {
+    size_t extra = strlen(text);
+    if (*length + extra >= size) return 0;
+    memcpy(out + *length, text, extra + 1);
+    *length += extra;
+    return 1;
+}
+
+int regression_equation(const RegressionFit* fit, char* out, size_t size) {
+    static const char* powers[] = { "", "X", "X^2", "X^3" };
+    const double* c = fit->coefficients;
+    char number[FORMAT_LENGTH];
+    size_t length = 0;
+    if (size == 0) return 0;
+    out[0] = '\0';
+
+    for (int k = 0; k < fit->terms; k++) {
+        if (!isfinite(c[k])) return 0;
+    }
+    switch (fit->model) {
+        case REGRESSION_EXPONENTIAL:  // a*b^X
+            format_shortest(c[0], number);
+            if (!append(out, size, &length, number) || !append(out, size, &length, "*")) return 0;
+            format_shortest(c[1], number);
+            return append(out, size, &length, number) && append(out, size, &length, "^X");
+        case REGRESSION_POWER:        // a*X^b, with a negative exponent in parentheses
+            format_shortest(c[0], number);
+            if (!append(out, size, &length, number) || !append(out, size, &length, "*X^(")) return 0;
+            format_shortest(c[1], number);
+            return append(out, size, &length, number) && append(out, size, &length, ")");
+        default:
+            // aX^3+bX^2+cX+d, the signs written as operators after the first term
+            for (int k = 0; k < fit->terms; k++) {
+                const char* sign = c[k] < 0 ? "-" : k > 0 ? "+" : "";
+                format_shortest(fabs(c[k]), number);
+                if (!append(out, size, &length, sign) || !append(out, size, &length, number) ||
+                    !append(out, size, &length, powers[fit->terms - 1 - k])) {
+                    return 0;
+                }
+            }
+            return 1;
+    }
+}
+
+int regression_store(const RegressionFit* fit, int slot) {
+    char equation[GRAPH_EXPRESSION_LENGTH];
+    if (slot < 0 || slot >= GRAPH_MAX_FUNCTIONS || !regression_equation(fit, equation, sizeof(equation))) {
+        printf("Error: Could not store the %s equation\n", model_names[fit->model]);
+        return 0;
+    }
+    graph_set_function(slot, equation);
+    printf("Stored %s in Y%d: %s\n", model_names[fit->model], (slot + 1) % 10, equation);
+    return 1;
+}
+
+void regression_print(const CalcContext* context, const RegressionFit* fit) {
+    char text[FORMAT_LENGTH];
+    printf("%s\n%s\n", model_names[fit->model], model_equations[fit->model]);
+    for (int k = 0; k < fit->terms; k++) {
+        format_number(context, fit->coefficients[k], 10, text);
+        printf("%c=%s\n", 'a' + k, text);
+    }
+    format_number(context, fit->r2, 10, text);
+    if (isnan(fit->r)) {
+        printf("R^2=%s\n", text);
+    } else {
+        printf("r^2=%s\n", text);
+        format_number(context, fit->r, 10, text);
+        printf("r=%s\n", text);
+    }
+}
+
+// Read a number with an optional sign, which scan_number leaves to the parser
+static int scan_signed(const char* text, double* value) {
+    int sign = *text == '-' || *text == '+';
+    int scanned = scan_number(text + sign, value);
+    if (scanned == 0) return 0;
+    if (*text == '-') *value = -*value;
+    return scanned + sign;
+}
+
+int regression_load(const char* path, RegressionData* data) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        printf("Could not open %s\n", path);
+        return 0;
+    }
+
+    long capacity = 0;
+    char line[REGRESSION_LINE_LENGTH];
+    data->x = data->y = NULL;
+    data->count = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        // Other programs write 1e-5 where the calculator writes 1E-5
+        for (char* c = line; *c; c++) {
+            if (*c == 'e') *c = 'E';
+        }
+        const char* p = line;
+        double x, y;
+        while (*p == ' ' || *p == '\t') p++;
+        int scanned = scan_signed(p, &x);
+        if (scanned == 0) continue;
+        p += scanned;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == ',' || *p == ';') p++;
+        while (*p == ' ' || *p == '\t') p++;
+        if (scan_signed(p, &y) == 0) continue;
+
+        if (data->count == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 1024;
+            double* grown_x = realloc(data->x, capacity * sizeof(double));
+            double* grown_y = grown_x != NULL ? realloc(data->y, capacity * sizeof(double)) : NULL;
+            if (grown_x != NULL) data->x = grown_x;
+            if (grown_y == NULL) {
+                printf("Error: Out of memory\n");
+                fclose(file);
+                regression_free(data);
+                return 0;
+            }
+            data->y = grown_y;
+        }
+        data->x[data->count] = x;
+        data->y[data->count] = y;
+        data->count++;
+    }
+    fclose(file);
+    printf("Read %ld points from %s\n", data->count, path);
+    return 1;
+}
+
+void regression_free(RegressionData* data) {
+    free(data->x);
+    free(data->y);
+    data->x = data->y = NULL;
+    data->count = 0;
+}
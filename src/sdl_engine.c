@@ -4,6 +4,14 @@
 #include <string.h>
 #include "sdl_engine.h"
 #include "math_engine.h"
+#include "graph.h"
+#include "table.h"
+#include "eval_worker.h"
+#include "profiler.h"
+#include "input_log.h"
+#include "format.h"
+#include "line_editor.h"
+#include "sequence.h"
 
 // Screen and window properties
 #define SCREEN_WIDTH 320
@@ -21,26 +29,66 @@
 #define DISPLAY_Y 30
 
 #define MAX_LINES 6  // Maximum number of lines to display
-#define LINE_LENGTH 256  // Maximum length of a line
-
-char screen_buffer[MAX_LINES][LINE_LENGTH] = {""};  // Circular buffer for 7 lines
-int current_line = 0;  // Index of the current line being entered
-int cursor_position = 0;  // Cursor position on the current line
-int total_lines = 0;  // Total lines on the screen (max 7)
-
-// Buffer to hold the expression shown on the calculator display
-char expression[256] = "";  // Screen buffer
+#define LINE_LENGTH 256  // Characters of a line kept for display; the input line itself has no limit
+#define MODE_LINES 7     // Lines of the MODE screen
+#define MODE_MAX_CHOICES 11
+
+
+// State of one calculator: the home screen, the MODE screen and the context its expressions
+// are evaluated in. Nothing else in this file belongs to a particular calculator.
+typedef struct {
+    char screen_buffer[MAX_LINES][LINE_LENGTH];  // Circular buffer of display lines
+    int current_line;        // Index of the current line being entered
+    int total_lines;         // Total lines on the screen
+    LineEditor line;         // The line being entered; screen_buffer gets a copy on ENTER
+    size_t line_scroll;      // First character of the line on the display, when it is wider than the display
+    long line_scroll_x;      // Width of the text before that character
+    int in_mode_screen;
+    int selected_option;     // Highlighted line of the MODE screen
+    int selected_choice;     // Cursor position along the highlighted MODE line
+    int scroll_offset;       // First MODE line shown
+    int mode_settings[MODE_LINES];  // Chosen settings of the MODE lines the context does not hold
+    int evaluation_pending;  // The home screen expression is being evaluated on the worker thread
+    CalcContext context;     // Lent to the evaluation worker while evaluation_pending is set
+} Calculator;
+
+static Calculator calc;
 
 static int cursor_visible = 1;  // Blinking flag for the cursor
 static Uint32 last_blink_time = 0;  // Timer for blinking
 
 SDL_Window* window = NULL;
 SDL_Renderer* renderer = NULL;
+SDL_Surface* offscreen = NULL;  // Render target in headless mode, instead of a window
 TTF_Font* font = NULL;
+static int glyph_advances[LINE_EDITOR_GLYPHS];  // Width of each character in the font, for placing the cursor
 
 int screen_on = 1; 
-int in_mode_screen = 0;
-int selected_option = 0;
+
+int in_y_equals_screen = 0;
+int in_graph_screen = 0;
+int selected_function = 0;  // Y= line being edited
+static char nmin_text[GRAPH_EXPRESSION_LENGTH] = "1";  // nMin as typed on the Y= screen in SEQ mode
+int function_scroll_offset = 0;
+int tracing = 0;            // TRACE cursor active on the graph screen
+int trace_slot = 0;         // Y= slot being traced
+int trace_column = DISPLAY_WIDTH / 2;
+static GraphPlot graph_plot = {0};
+
+int in_table_screen = 0;
+long table_top_row = 0;     // Row shown first, counted from TblStart
+int table_first_column = 0; // First Y= column shown
+int second_active = 0;      // 2ND pressed, waiting for the next key
+
+#define TABLE_VISIBLE_ROWS (MAX_LINES - 1)  // One line is the header
+#define TABLE_VISIBLE_COLUMNS 2             // Y columns shown beside X
+
+#define GRAPH_PAN_PIXELS 8  // Pixels moved per arrow key press on the graph screen
+
+
+#define BUSY_FRAME_MS 150  // How long each frame of the busy indicator stays up
+
+int profile_overlay = 0;  // Frame time and input latency shown over the window (F12)
 
 // Function prototypes
 void draw_button(int x, int y, int w, int h, SDL_Color color, const char* label);
@@ -52,13 +100,27 @@ void handle_mouse_click(int x, int y);
 void handle_on_button();
 void handle_q_button();
 void handle_enter();
+void show_result(const EvalResult* result);
 void clear_screen();
 void handle_del_button();
+void render_keypad();
 void render_mode_screen();
+void render_y_equals_screen();
+void render_graph_screen();
+void open_y_equals_screen();
+void open_graph_screen();
+void handle_graph_key(SDL_Keycode key);
+void open_table_screen();
+void close_table_screen();
+void render_table_screen();
+void handle_table_key(SDL_Keycode key);
+void move_trace_cursor(int columns);
+void append_to_function(const char* str);
 void draw_text(int x, int y, const char* text, SDL_Color color);
+void present_frame(int capture);
 
-// Initialize SDL and SDL_ttf
-int init_sdl() {
+// Initialize SDL and SDL_ttf, rendering to a window or, headless, to an offscreen surface
+static int init_display(int headless) {
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
         return 0;
@@ -69,13 +131,38 @@ int init_sdl() {
         return 0;
     }
 
-    window = SDL_CreateWindow("TI-84 Emulator", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
-    if (window == NULL) {
-        printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+    if (headless) {
+        offscreen = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+        if (offscreen == NULL) {
+            printf("Offscreen surface could not be created! SDL_Error: %s\n", SDL_GetError());
+            return 0;
+        }
+        renderer = SDL_CreateSoftwareRenderer(offscreen);
+    } else {
+        window = SDL_CreateWindow("TI-84 Emulator", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+        if (window == NULL) {
+            printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+            return 0;
+        }
+
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+        if (renderer == NULL) {
+            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);  // e.g. the dummy video driver
+        }
+    }
+    if (renderer == NULL) {
+        printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
         return 0;
     }
 
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    calc_context_init(&calc.context);
+    calc.context.sequences = &graph_sequences;  // Evaluated with the Y= editor's u, v and w
+    graph_set_context(&calc.context);
+    graph_reset_view(DISPLAY_WIDTH, DISPLAY_HEIGHT);  // ZStandard over the display
+
+    if (!eval_worker_start()) {
+        return 0;
+    }
 
     // Load font (adjust the path to where the font file is located)
     font = TTF_OpenFont("/usr/share/fonts/truetype/dejavu/DejaVuSans-Bold.ttf", 18);
@@ -84,13 +171,66 @@ int init_sdl() {
         return 0;
     }
 
+    // Measure every character once. Without kerning a line is exactly as wide as the sum of its
+    // characters, so the cursor is placed from these widths instead of measuring the text each frame.
+    TTF_SetFontKerning(font, 0);
+    for (int c = ' '; c < 127; c++) {
+        int min_x, max_x, min_y, max_y;
+        TTF_GlyphMetrics(font, (Uint16)c, &min_x, &max_x, &min_y, &max_y, &glyph_advances[c]);
+    }
+    if (!line_editor_init(&calc.line, glyph_advances)) {
+        printf("Error: Out of memory\n");
+        return 0;
+    }
+    snprintf(nmin_text, sizeof(nmin_text), "%ld", sequence_get_nmin(&graph_sequences));  // May have been set on the command line
+
     return 1;
 }
 
+int init_sdl() {
+    return init_display(0);
+}
+
+int init_sdl_headless() {
+    return init_display(1);
+}
+
+// The last frame rendered with capture set, read before it was presented: SDL leaves the back
+// buffer undefined after SDL_RenderPresent
+static unsigned char captured_pixels[SCREEN_WIDTH * SCREEN_HEIGHT * 3];
+static int frame_captured = 0;
+
+static void capture_frame() {
+    frame_captured = SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_RGB24, captured_pixels, SCREEN_WIDTH * 3) == 0;
+    if (!frame_captured) printf("Could not read the frame! SDL_Error: %s\n", SDL_GetError());
+}
+
+// Write the last captured frame as a binary PPM
+int save_screenshot(const char* path) {
+    if (!frame_captured) {
+        printf("No frame was captured for %s\n", path);
+        return 0;
+    }
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("Could not open %s\n", path);
+        return 0;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+    int ok = fwrite(captured_pixels, 1, sizeof(captured_pixels), file) == sizeof(captured_pixels);
+    return fclose(file) == 0 && ok;
+}
+
 // Clean up SDL and TTF resources
 void close_sdl() {
     // Free any resources you may have allocated during the program
     // Clean up SDL resources
+    input_log_finish(screen_checksum());
+    eval_worker_stop();
+    table_stop_generator();
+    graph_free_plot(&graph_plot);
+    line_editor_free(&calc.line);
+
     if (font) {
         TTF_CloseFont(font);
         font = NULL;
@@ -106,6 +246,11 @@ void close_sdl() {
         window = NULL;
     }
 
+    if (offscreen) {
+        SDL_FreeSurface(offscreen);
+        offscreen = NULL;
+    }
+
     // Clean up SDL_ttf and SDL subsystems
     TTF_Quit();
     SDL_Quit();
@@ -114,6 +259,8 @@ void close_sdl() {
 
 // Draw a button with text on it
 void draw_button(int x, int y, int w, int h, SDL_Color color, const char* label) {
+    PROFILE_SCOPE("draw_button");
+
     // Draw the button background
     SDL_Rect rect = { x, y, w, h };
     SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
@@ -144,10 +291,9 @@ void toggle_cursor_blink() {
     }
 }
 
-// Update the calculator screen with the current expression
+// Draw the home screen with the current expression; render_frame presents it
 void update_screen() {
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
+    PROFILE_SCOPE("update_screen");
 
     // Draw the calculator screen area
     SDL_Rect display_rect = { DISPLAY_X, DISPLAY_Y, DISPLAY_WIDTH, DISPLAY_HEIGHT };
@@ -158,7 +304,6 @@ void update_screen() {
         // Render a darker grey for the screen-off state
         SDL_SetRenderDrawColor(renderer, 100, 100, 100, 255);  // Dark grey display (OFF)
         SDL_RenderFillRect(renderer, &display_rect);  // Only darken the screen area
-        SDL_RenderPresent(renderer);  // Update the screen with the dark grey display
         return;  // Skip rendering the rest of the screen content
     }
     SDL_RenderFillRect(renderer, &display_rect);
@@ -170,13 +315,14 @@ void update_screen() {
 
     // Render each line from the screen buffer
     for (int i = 0; i < MAX_LINES; i++) {
-        if (strlen(screen_buffer[i]) > 0) {
+        if (i != calc.current_line && strlen(calc.screen_buffer[i]) > 0) {  // The current line is drawn from the editor
+            PROFILE_SCOPE("render text");
             SDL_Color textColor = {0, 0, 0, 255};  // Black text
-            SDL_Surface* textSurface = TTF_RenderText_Solid(font, screen_buffer[i], textColor);
+            SDL_Surface* textSurface = TTF_RenderText_Solid(font, calc.screen_buffer[i], textColor);
             SDL_Texture* text = SDL_CreateTextureFromSurface(renderer, textSurface);
             
             int text_width = 0, text_height = 0;
-            TTF_SizeText(font, screen_buffer[i], &text_width, &text_height);
+            TTF_SizeText(font, calc.screen_buffer[i], &text_width, &text_height);
 
             // For results (right-align): Check if the line contains a result (a number)
             if (i % 2 == 1) {
@@ -194,100 +340,127 @@ void update_screen() {
         }
     }    
 
-    // Render the current expression
+    // Render the line being entered: only the characters that fit, scrolled to keep the cursor in view
     SDL_Color textColor = {0, 0, 0, 255};  // Black text
-    SDL_Surface* textSurface = TTF_RenderText_Solid(font, expression, textColor);
-    SDL_Texture* text = SDL_CreateTextureFromSurface(renderer, textSurface);
-    
-    int text_width = 0, text_height = 0;
-    TTF_SizeText(font, expression, &text_width, &text_height);
-
-    // Render the expression at the top-left of the screen
-    SDL_Rect textRect = { line_start_x, line_start_y + (current_line * line_height), text_width, text_height };
-    SDL_RenderCopy(renderer, text, NULL, &textRect);
-
-    // Calculate the width of the text up to the cursor position
-    char temp_expression[LINE_LENGTH];
-    strncpy(temp_expression, screen_buffer[current_line], cursor_position);  // Take only up to the cursor
-    temp_expression[cursor_position] = '\0';  // Null-terminate
-
-    // Calculate where the cursor should be
-    int cursor_x = line_start_x;  // Start from the left edge
-    if (cursor_position > 0) {
-        // Get the width of the text up to the cursor position
-        int temp_width = 0, temp_height = 0;
-        TTF_SizeText(font, temp_expression, &temp_width, &temp_height);
-        cursor_x += temp_width;  // Move the cursor after the current text
+    LineEditor* line = &calc.line;
+    int line_y = line_start_y + (calc.current_line * line_height);
+    int visible_width = DISPLAY_WIDTH - 10 - glyph_advances['_'];
+    size_t cursor = line_editor_cursor(line);
+    if (cursor < calc.line_scroll || calc.line_scroll > line_editor_length(line)) {
+        calc.line_scroll = cursor;
+        calc.line_scroll_x = line->cursor_x;
+    }
+    while (line->cursor_x - calc.line_scroll_x > visible_width) {
+        calc.line_scroll_x += line_editor_advance(line, line_editor_char_at(line, calc.line_scroll++));
+    }
+    char visible[DISPLAY_WIDTH + 1];
+    int count = 0, visible_x = 0;
+    for (char c; count < DISPLAY_WIDTH && (c = line_editor_char_at(line, calc.line_scroll + count)) != '\0'; count++) {
+        if (visible_x + line_editor_advance(line, c) > visible_width) break;
+        visible[count] = c;
+        visible_x += line_editor_advance(line, c);
+    }
+    visible[count] = '\0';
+    if (count > 0) {
+        PROFILE_SCOPE("render text");
+        SDL_Surface* textSurface = TTF_RenderText_Solid(font, visible, textColor);
+        SDL_Texture* text = SDL_CreateTextureFromSurface(renderer, textSurface);
+        SDL_Rect textRect = { line_start_x, line_y, textSurface->w, textSurface->h };
+        SDL_RenderCopy(renderer, text, NULL, &textRect);
+        SDL_FreeSurface(textSurface);
+        SDL_DestroyTexture(text);
     }
 
     // Cursor blinking logic
     toggle_cursor_blink();
 
-    // Render the cursor after the current text in the expression if visible
+    // The cursor blinks as a block over the character it would replace, or as an underscore when inserting
     if (cursor_visible) {
-        char cursor_char[] = "_";
-        SDL_Surface* cursorSurface = TTF_RenderText_Solid(font, cursor_char, textColor);
-        SDL_Texture* cursorTexture = SDL_CreateTextureFromSurface(renderer, cursorSurface);
-
-        int cursor_width = 0, cursor_height = 0;
-        TTF_SizeText(font, cursor_char, &cursor_width, &cursor_height);
-
-        // Cursor should be placed based on the cursor_x
-        SDL_Rect cursorRect = { cursor_x, line_start_y + (current_line * line_height), cursor_width, cursor_height };
-        SDL_RenderCopy(renderer, cursorTexture, NULL, &cursorRect);
-
-        SDL_FreeSurface(cursorSurface);
-        SDL_DestroyTexture(cursorTexture);
+        int cursor_x = line_start_x + (int)(line->cursor_x - calc.line_scroll_x);
+        char under = line_editor_char_at(line, cursor);
+        SDL_Rect cursorRect = { cursor_x, line_y + 2, glyph_advances[(unsigned char)(under != '\0' ? under : '_')], line_height - 2 };
+        if (!line->overwrite) {
+            cursorRect.y = line_y + line_height - 4;
+            cursorRect.h = 2;
+        }
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderFillRect(renderer, &cursorRect);
     }
 
-    SDL_RenderPresent(renderer);
-
-    // Clean up
-    SDL_FreeSurface(textSurface);
-    SDL_DestroyTexture(text);
+    // Busy indicator: a dash moving down the top-right corner while the worker evaluates
+    if (calc.evaluation_pending) {
+        int frame = (SDL_GetTicks() / BUSY_FRAME_MS) % 4;
+        SDL_Rect busy_rect = { DISPLAY_X + DISPLAY_WIDTH - 6, DISPLAY_Y + 2 + frame * 3, 3, 3 };
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderFillRect(renderer, &busy_rect);
+    }
 }
 
-// Append full strings to the expression buffer (e.g., for functions like "sin(")
+// Type a string at the cursor (e.g., for functions like "sin(")
 void append_to_expression_string(const char* str) {
-    // Safeguard: Make sure the last part of the expression doesn't already contain this function
-    if (strlen(screen_buffer[current_line]) + strlen(str) < LINE_LENGTH - 1) {
-        // Append only if the last characters don't already match the function we're adding
-        if (strstr(screen_buffer[current_line], str) == NULL || strlen(screen_buffer[current_line]) == 0) {
-            strcat(screen_buffer[current_line], str);
-            cursor_position += strlen(str);
-            update_screen();  // Update the screen after adding a string
-        }
+    if (in_y_equals_screen) {
+        append_to_function(str);
+        return;
+    }
+    if (calc.evaluation_pending) return;  // The line is locked until its result is shown
+
+    if (!line_editor_insert(&calc.line, str)) {
+        printf("Error: Out of memory\n");
+        return;
     }
 }
 
-// Append characters to the screen's expression buffer
+// Type a character at the cursor
 void append_to_expression(char c) {
-    if (strlen(screen_buffer[current_line]) < LINE_LENGTH - 1) {
-        int len = strlen(screen_buffer[current_line]);
-        screen_buffer[current_line][len] = c;
-        screen_buffer[current_line][len + 1] = '\0';
-        cursor_position = len + 1;
-        update_screen();  // Update the screen after adding a character
-    }
-}
-
-// List of options for the Mode screen
-const char* mode_options[] = {
-    "NORMAL     SCI      ENG",   // Line 1
-    "FLOAT      INTEGER",        // Line 2
-    "RADIAN     DEGREE",         // Line 3
-    "FUNC   PAR   POL   SEQ",    // Line 4
-    "CONNECTED  DOT",            // Line 5
-    "SEQUENTIAL  DOT"            // Line 6
+    char str[2] = { c, '\0' };
+    append_to_expression_string(str);
+}
+
+// Choices on each line of the Mode screen
+const char* mode_options[MODE_LINES][MODE_MAX_CHOICES] = {
+    {"NORMAL", "SCI", "ENG"},                                     // Line 1: notation
+    {"FLOAT", "0", "1", "2", "3", "4", "5", "6", "7", "8", "9"},  // Line 2: decimals
+    {"RADIAN", "DEGREE"},                                         // Line 3: angle
+    {"FUNC", "PAR", "POL", "SEQ"},                                // Line 4
+    {"CONNECTED", "DOT"},                                         // Line 5
+    {"SEQUENTIAL", "SIMUL"},                                      // Line 6
+    {"REAL", "a+bi", "re^θi"}                                     // Line 7: complex results
 };
+const int mode_choice_counts[MODE_LINES] = {3, 11, 2, 4, 2, 2, 3};
+
+int num_options = MODE_LINES;
+
+// The setting in effect on a line of the Mode screen
+int mode_active_choice(int line) {
+    switch (line) {
+        case 0: return calc.context.notation;
+        case 1: return calc.context.fix_digits == CALC_FLOAT ? 0 : calc.context.fix_digits + 1;
+        case 2: return calc.context.angle == ANGLE_RADIAN ? 0 : 1;
+        case 3: return sequence_mode ? 3 : calc.mode_settings[line];
+        case 6: return calc.context.complex_mode;
+        default: return calc.mode_settings[line];
+    }
+}
 
-int num_options = sizeof(mode_options) / sizeof(mode_options[0]);
-int scroll_offset = 0;  // Tracks which part of the list is visible
+// ENTER on the Mode screen: make the choice under the cursor the setting of its line
+void apply_mode_choice(int line, int choice) {
+    switch (line) {
+        case 0: calc.context.notation = (NotationMode)choice; break;
+        case 1: calc.context.fix_digits = choice == 0 ? CALC_FLOAT : choice - 1; break;
+        case 2: calc.context.angle = choice == 0 ? ANGLE_RADIAN : ANGLE_DEGREE; break;
+        case 3:
+            calc.mode_settings[line] = choice;
+            sequence_mode = choice == 3;  // SEQ
+            break;
+        case 6: calc.context.complex_mode = (ComplexMode)choice; break;
+        default: calc.mode_settings[line] = choice; break;
+    }
+    graph_set_context(&calc.context);  // Graphs and the table follow the new modes
+}
 
 // Render the Mode screen
 void render_mode_screen() {
-    // Retain the rest of the calculator background and buttons
-    render_calculator();  // This will keep the buttons and outer layout the same
+    render_keypad();  // Keep the buttons and outer layout the same
     
     // Now draw the mode view only within the screen area
     SDL_Rect display_rect = {DISPLAY_X, DISPLAY_Y, DISPLAY_WIDTH, DISPLAY_HEIGHT};
@@ -299,22 +472,261 @@ void render_mode_screen() {
     int line_height = 20;  // Spacing between each option
     int start_y = DISPLAY_Y + 10;  // Start within the calculator screen
 
-    // Render each visible option within the calculator screen
-    for (int i = scroll_offset; i < scroll_offset + MAX_LINES && i < num_options; i++) {
-        SDL_Color current_color = (i == selected_option) ? highlight_color : text_color;
-        draw_text(DISPLAY_X + 5, start_y + (i - scroll_offset) * line_height, mode_options[i], current_color);
+    // Render each visible line, highlighting the settings in effect and underlining the cursor
+    for (int i = calc.scroll_offset; i < calc.scroll_offset + MAX_LINES && i < num_options; i++) {
+        int x = DISPLAY_X + 5;
+        int y = start_y + (i - calc.scroll_offset) * line_height;
+        for (int c = 0; c < mode_choice_counts[i]; c++) {
+            int width, height;
+            TTF_SizeUTF8(font, mode_options[i][c], &width, &height);
+            draw_text(x, y, mode_options[i][c], c == mode_active_choice(i) ? highlight_color : text_color);
+            if (i == calc.selected_option && c == calc.selected_choice) {
+                SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+                SDL_RenderDrawLine(renderer, x, y + height - 1, x + width - 1, y + height - 1);
+            }
+            x += width + (i == 1 && c > 0 ? 4 : 12);  // Digits of FIX sit close together
+        }
+    }
+
+}
+
+#define SEQUENCE_LINES (1 + 2 * SEQUENCE_COUNT)  // nMin, then u(n) and u(nMin) for each sequence
+
+// Lines of the Y= editor: Y1..Y0, or nMin and the sequences in SEQ mode
+static int y_equals_lines() {
+    return sequence_mode ? SEQUENCE_LINES : GRAPH_MAX_FUNCTIONS;
+}
+
+static const char* y_equals_text(int line) {
+    if (!sequence_mode) return graph_functions[line];
+    if (line == 0) return nmin_text;
+    return (line - 1) % 2 == 0 ? sequence_get(&graph_sequences, (line - 1) / 2) : sequence_get_initial(&graph_sequences, (line - 1) / 2);
+}
+
+static void y_equals_label(int line, char* out, size_t size) {
+    if (!sequence_mode) {
+        snprintf(out, size, "Y%d=", (line + 1) % 10);
+    } else if (line == 0) {
+        snprintf(out, size, "nMin=");
+    } else {
+        snprintf(out, size, (line - 1) % 2 == 0 ? "%c(n)=" : "%c(nMin)=", sequence_name((line - 1) / 2));
+    }
+}
+
+static void y_equals_set(int line, const char* text) {
+    if (!sequence_mode) {
+        graph_set_function(line, text);
+    } else if (line == 0) {
+        // nMin takes effect once what has been typed is a whole number
+        Program program;
+        CalcContext context;
+        snprintf(nmin_text, sizeof(nmin_text), "%s", text);
+        calc_context_init(&context);
+        if (compile_expression(nmin_text, &program)) sequence_set_nmin(&graph_sequences, run_program(&context, &program, 0.0));
+    } else if ((line - 1) % 2 == 0) {
+        sequence_set(&graph_sequences, (line - 1) / 2, text);
+    } else {
+        sequence_set_initial(&graph_sequences, (line - 1) / 2, text);
+    }
+}
+
+// Append text to the Y= line being edited
+void append_to_function(const char* str) {
+    char updated[GRAPH_EXPRESSION_LENGTH];
+    const char* text = y_equals_text(selected_function);
+    if (strlen(text) + strlen(str) < GRAPH_EXPRESSION_LENGTH - 1) {
+        snprintf(updated, sizeof(updated), "%s%s", text, str);
+        y_equals_set(selected_function, updated);
     }
+}
+
+void open_y_equals_screen() {
+    close_table_screen();
+    if (selected_function >= y_equals_lines()) {
+        selected_function = function_scroll_offset = 0;  // The MODE changed between Y1..Y0 and the sequences
+    }
+    calc.in_mode_screen = 0;
+    in_graph_screen = 0;
+    in_y_equals_screen = 1;
+}
 
-    SDL_RenderPresent(renderer);  // Update the screen with the mode view
+void open_graph_screen() {
+    close_table_screen();
+    calc.in_mode_screen = 0;
+    in_y_equals_screen = 0;
+    in_graph_screen = 1;
+}
+
+// TABLE: X against every Y= function, produced in the background as the user scrolls
+void open_table_screen() {
+    calc.in_mode_screen = 0;
+    in_y_equals_screen = 0;
+    in_graph_screen = 0;
+    in_table_screen = 1;
+    table_top_row = 0;
+    table_first_column = 0;
+    table_start_generator();  // Snapshot of the current functions and TBLSET
+    table_set_viewport(table_top_row, TABLE_VISIBLE_ROWS);
+}
+
+void close_table_screen() {
+    if (in_table_screen) {
+        in_table_screen = 0;
+        table_stop_generator();
+    }
+}
+
+void render_table_screen() {
+    render_keypad();
+
+    SDL_Rect display_rect = {DISPLAY_X, DISPLAY_Y, DISPLAY_WIDTH, DISPLAY_HEIGHT};
+    SDL_SetRenderDrawColor(renderer, 200, 200, 200, 255);
+    SDL_RenderFillRect(renderer, &display_rect);
+
+    SDL_Color text_color = {0, 0, 0, 255};
+    int line_height = 20;
+    int start_y = DISPLAY_Y + 10;
+    int column_width = DISPLAY_WIDTH / (TABLE_VISIBLE_COLUMNS + 1);
+    char cell[FORMAT_LENGTH];
+
+    // Header
+    draw_text(DISPLAY_X + 5, start_y, table_variable_name(), text_color);
+    for (int c = 0; c < TABLE_VISIBLE_COLUMNS && table_first_column + c < table_column_count(); c++) {
+        draw_text(DISPLAY_X + 5 + (c + 1) * column_width, start_y, table_column_name(table_first_column + c), text_color);
+    }
+
+    // Rows come from the generator's ring buffer; ones it hasn't reached yet show as "..."
+    table_set_viewport(table_top_row, TABLE_VISIBLE_ROWS);
+    for (int i = 0; i < TABLE_VISIBLE_ROWS; i++) {
+        TableRow row;
+        int y = start_y + (i + 1) * line_height;
+        if (!table_get_row(table_top_row + i, &row)) {
+            draw_text(DISPLAY_X + 5, y, "...", text_color);
+            continue;
+        }
+        format_number(graph_get_context(), row.x, FORMAT_CELL_DIGITS, cell);
+        draw_text(DISPLAY_X + 5, y, cell, text_color);
+        for (int c = 0; c < TABLE_VISIBLE_COLUMNS && table_first_column + c < table_column_count(); c++) {
+            format_number(graph_get_context(), row.y[table_first_column + c], FORMAT_CELL_DIGITS, cell);
+            draw_text(DISPLAY_X + 5 + (c + 1) * column_width, y, cell, text_color);
+        }
+    }
+}
+
+void handle_table_key(SDL_Keycode key) {
+    switch (key) {
+        case SDLK_UP:
+            table_top_row--;
+            break;
+        case SDLK_DOWN:
+            table_top_row++;
+            break;
+        case SDLK_PAGEUP:
+            table_top_row -= TABLE_VISIBLE_ROWS;
+            break;
+        case SDLK_PAGEDOWN:
+            table_top_row += TABLE_VISIBLE_ROWS;
+            break;
+        case SDLK_LEFT:
+            if (table_first_column > 0) table_first_column--;
+            break;
+        case SDLK_RIGHT:
+            if (table_first_column + TABLE_VISIBLE_COLUMNS < table_column_count()) table_first_column++;
+            break;
+        case SDLK_F1:
+            open_y_equals_screen();
+            break;
+        case SDLK_F5:
+            open_graph_screen();
+            break;
+        case SDLK_ESCAPE:
+            close_table_screen();  // Back to the home screen
+            break;
+        default:
+            break;
+    }
+}
+
+// Render the Y= editor
+void render_y_equals_screen() {
+    render_keypad();
+
+    SDL_Rect display_rect = {DISPLAY_X, DISPLAY_Y, DISPLAY_WIDTH, DISPLAY_HEIGHT};
+    SDL_SetRenderDrawColor(renderer, 200, 200, 200, 255);
+    SDL_RenderFillRect(renderer, &display_rect);
+
+    SDL_Color text_color = {0, 0, 0, 255};
+    SDL_Color highlight_color = {0, 0, 255, 255};  // Blue for the slot being edited
+    int line_height = 20;
+    int start_y = DISPLAY_Y + 10;
+
+    for (int i = function_scroll_offset; i < function_scroll_offset + MAX_LINES && i < y_equals_lines(); i++) {
+        char label[16], line[GRAPH_EXPRESSION_LENGTH + 16];
+        y_equals_label(i, label, sizeof(label));
+        snprintf(line, sizeof(line), "%s%s", label, y_equals_text(i));
+        draw_text(DISPLAY_X + 5, start_y + (i - function_scroll_offset) * line_height, line,
+                  i == selected_function ? highlight_color : text_color);
+    }
+}
+
+// Render the graph of every Y= function over the display area
+void render_graph_screen() {
+    render_keypad();
+
+    SDL_Rect display_rect = {DISPLAY_X, DISPLAY_Y, DISPLAY_WIDTH, DISPLAY_HEIGHT};
+    SDL_SetRenderDrawColor(renderer, 200, 200, 200, 255);
+    SDL_RenderFillRect(renderer, &display_rect);
+
+    // Only tiles not already cached are sampled, so this is cheap when nothing moved
+    graph_render(DISPLAY_WIDTH, DISPLAY_HEIGHT, &graph_plot);
+
+    // Axes
+    GraphWindow graph_window = graph_view_window(&graph_view, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    SDL_SetRenderDrawColor(renderer, 120, 120, 120, 255);
+    if (graph_window.xmin <= 0 && graph_window.xmax >= 0) {
+        int axis_x = DISPLAY_X + (int)(-graph_view.column);
+        SDL_RenderDrawLine(renderer, axis_x, DISPLAY_Y, axis_x, DISPLAY_Y + DISPLAY_HEIGHT - 1);
+    }
+    if (graph_window.ymin <= 0 && graph_window.ymax >= 0) {
+        int axis_y = DISPLAY_Y + (int)(-graph_view.row);
+        SDL_RenderDrawLine(renderer, DISPLAY_X, axis_y, DISPLAY_X + DISPLAY_WIDTH - 1, axis_y);
+    }
+
+    // Function pixels
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    for (int i = 0; i < graph_plot.count; i++) {
+        const GraphSpan* span = &graph_plot.spans[i];
+        SDL_Rect rect = { DISPLAY_X + span->x0, DISPLAY_Y + span->y0, span->x1 - span->x0 + 1, span->y1 - span->y0 + 1 };
+        SDL_RenderFillRect(renderer, &rect);
+    }
+
+    // TRACE cursor and readout, straight from the cached samples
+    double trace_x, trace_y;
+    if (tracing && graph_trace(trace_slot, trace_column, &trace_x, &trace_y)) {
+        int cursor_y = (int)(-trace_y / graph_pixel_height(&graph_view) - graph_view.row);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255);
+        if (cursor_y >= 0 && cursor_y < DISPLAY_HEIGHT) {
+            SDL_RenderDrawLine(renderer, DISPLAY_X + trace_column - 3, DISPLAY_Y + cursor_y, DISPLAY_X + trace_column + 3, DISPLAY_Y + cursor_y);
+            SDL_RenderDrawLine(renderer, DISPLAY_X + trace_column, DISPLAY_Y + cursor_y - 3, DISPLAY_X + trace_column, DISPLAY_Y + cursor_y + 3);
+        }
+
+        char readout[80], x_text[FORMAT_LENGTH], y_text[FORMAT_LENGTH];
+        SDL_Color text_color = {0, 0, 0, 255};
+        format_number(graph_get_context(), trace_x, FORMAT_CELL_DIGITS, x_text);
+        format_number(graph_get_context(), trace_y, FORMAT_CELL_DIGITS, y_text);
+        snprintf(readout, sizeof(readout), "Y%d X=%s Y=%s", (trace_slot + 1) % 10, x_text, y_text);
+        draw_text(DISPLAY_X + 5, DISPLAY_Y + DISPLAY_HEIGHT - 22, readout, text_color);
+    }
 }
 
 // Helper function to draw text on the screen
 void draw_text(int x, int y, const char* text, SDL_Color color) {
-    SDL_Surface* textSurface = TTF_RenderText_Solid(font, text, color);
+    PROFILE_SCOPE("render text");
+    SDL_Surface* textSurface = TTF_RenderUTF8_Solid(font, text, color);  // UTF-8, for the θ on the Mode screen
     SDL_Texture* textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
 
     int text_width, text_height;
-    TTF_SizeText(font, text, &text_width, &text_height);
+    TTF_SizeUTF8(font, text, &text_width, &text_height);
     SDL_Rect textRect = {x, y, text_width, text_height};
 
     SDL_RenderCopy(renderer, textTexture, NULL, &textRect);
@@ -322,10 +734,17 @@ void draw_text(int x, int y, const char* text, SDL_Color color) {
     SDL_DestroyTexture(textTexture);
 }
 
-// Render the entire calculator layout, including buttons
+// Draw the entire calculator layout, including buttons, with the home screen on the display
 void render_calculator() {
-                                 //
-    update_screen();  // Update the screen first
+    PROFILE_SCOPE("render_calculator");
+    render_keypad();
+    update_screen();
+}
+
+// Clear the window and draw the buttons around the display; each screen then draws the display
+void render_keypad() {
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
 
     // Define button color
     SDL_Color button_color = {100, 100, 100, 255};  // Gray  
@@ -420,46 +839,142 @@ void render_calculator() {
     // ALPHA (green) and 2ND (blue) buttons above MATH
     draw_button(right_x - 200, start_y - 120, BUTTON_WIDTH, BUTTON_HEIGHT, green_button_color, "ALPHA");
     draw_button(right_x - 200, start_y - 160, BUTTON_WIDTH, BUTTON_HEIGHT, blue_button_color, "2ND");
+}
+
+// Draw p50/p99 frame time above the display and key-to-present latency below the keypad
+void draw_profile_overlay() {
+    SDL_Color overlay_color = {255, 255, 0, 255};  // Yellow on the black window background
+    ProfileSummary summary = profile_summary();
+    char line[64];
 
-    // Present the updated rendering
-    SDL_RenderPresent(renderer);
+    snprintf(line, sizeof(line), "frame p50 %.1f p99 %.1f ms", summary.frame_p50, summary.frame_p99);
+    draw_text(DISPLAY_X, 4, line, overlay_color);
+    snprintf(line, sizeof(line), "input p50 %.1f p99 %.1f ms", summary.latency_p50, summary.latency_p99);
+    draw_text(DISPLAY_X, SCREEN_HEIGHT - 26, line, overlay_color);
+}
+
+static unsigned long checksum_bytes(unsigned long hash, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ul;  // FNV-1a
+    }
+    return hash;
+}
+
+// Hash of what the calculator shows: the active screen, its lines and cursor, and the graph and
+// table state. Pixels are left out, so the blinking cursor and busy indicator do not count.
+unsigned long screen_checksum() {
+    int screens[] = { screen_on, calc.in_mode_screen, calc.selected_option, in_y_equals_screen,
+                      selected_function, in_graph_screen, tracing, trace_slot, trace_column,
+                      in_table_screen, table_first_column, calc.current_line, (int)line_editor_cursor(&calc.line),
+                      calc.line.overwrite };
+    unsigned long hash = 14695981039346656037ul;
+
+    hash = checksum_bytes(hash, screens, sizeof(screens));
+    hash = checksum_bytes(hash, calc.screen_buffer, sizeof(calc.screen_buffer));
+    for (size_t i = 0; i < line_editor_length(&calc.line); i++) {
+        char c = line_editor_char_at(&calc.line, i);
+        hash = checksum_bytes(hash, &c, 1);
+    }
+    hash = checksum_bytes(hash, graph_functions, sizeof(graph_functions));
+    for (int s = 0; s < SEQUENCE_COUNT; s++) {
+        hash = checksum_bytes(hash, sequence_get(&graph_sequences, s), strlen(sequence_get(&graph_sequences, s)));
+        hash = checksum_bytes(hash, sequence_get_initial(&graph_sequences, s), strlen(sequence_get_initial(&graph_sequences, s)));
+    }
+    hash = checksum_bytes(hash, &sequence_mode, sizeof(sequence_mode));
+    hash = checksum_bytes(hash, &graph_view.zoom, sizeof(graph_view.zoom));
+    hash = checksum_bytes(hash, &graph_view.column, sizeof(graph_view.column));
+    hash = checksum_bytes(hash, &graph_view.row, sizeof(graph_view.row));
+    hash = checksum_bytes(hash, &table_top_row, sizeof(table_top_row));
+    return hash;
+}
+
+// Present the frame with the overlay on top, and close out the latency of keys pressed since the last one.
+// With capture, the finished frame is read back first.
+void present_frame(int capture) {
+    if (profile_overlay) draw_profile_overlay();
+    if (capture) capture_frame();
+    {
+        PROFILE_SCOPE("present");
+        SDL_RenderPresent(renderer);
+    }
+    profile_present_done();
 }
 
 // Handle key press events
 void handle_key(SDL_Keycode key) {
-    if (in_mode_screen) {
+    if (calc.in_mode_screen) {
         switch (key) {
             case SDLK_DOWN:
-                if (selected_option < num_options - 1) {
-                    selected_option++;
-                    if (selected_option >= scroll_offset + MAX_LINES) {
-                        scroll_offset++;
+                if (calc.selected_option < num_options - 1) {
+                    calc.selected_option++;
+                    calc.selected_choice = mode_active_choice(calc.selected_option);
+                    if (calc.selected_option >= calc.scroll_offset + MAX_LINES) {
+                        calc.scroll_offset++;
                     }
                 }
                 break;
             case SDLK_UP:
-                if (selected_option > 0) {
-                    selected_option--;
-                    if (selected_option < scroll_offset) {
-                        scroll_offset--;
+                if (calc.selected_option > 0) {
+                    calc.selected_option--;
+                    calc.selected_choice = mode_active_choice(calc.selected_option);
+                    if (calc.selected_option < calc.scroll_offset) {
+                        calc.scroll_offset--;
                     }
                 }
-                render_mode_screen();  // Re-render the Mode screen
+                break;
+            case SDLK_LEFT:
+                if (calc.selected_choice > 0) calc.selected_choice--;
+                break;
+            case SDLK_RIGHT:
+                if (calc.selected_choice < mode_choice_counts[calc.selected_option] - 1) calc.selected_choice++;
                 break;
             case SDLK_RETURN:
             case SDLK_KP_ENTER:
-                printf("Selected option: %s\n", mode_options[selected_option]);
-                // Implement mode option handling if needed
+                if (calc.evaluation_pending) break;  // The worker is using the context
+                printf("Selected option: %s\n", mode_options[calc.selected_option][calc.selected_choice]);
+                apply_mode_choice(calc.selected_option, calc.selected_choice);
                 break;
             case SDLK_ESCAPE:
-                in_mode_screen = 0;  // Exit the mode screen on Escape
-                render_calculator();  // Re-render calculator view
+                calc.in_mode_screen = 0;  // Exit the mode screen on Escape
                 break;
             default:
                 break;
         }
+    } else if (in_table_screen) {
+        handle_table_key(key);
+    } else if (in_graph_screen) {
+        handle_graph_key(key);
+    } else if (in_y_equals_screen && (key == SDLK_UP || key == SDLK_DOWN || key == SDLK_ESCAPE || key == SDLK_F5 ||
+                                      key == SDLK_RETURN || key == SDLK_KP_ENTER)) {
+        switch (key) {
+            case SDLK_DOWN:
+            case SDLK_RETURN:
+            case SDLK_KP_ENTER:
+                if (selected_function < y_equals_lines() - 1) {
+                    selected_function++;
+                    if (selected_function >= function_scroll_offset + MAX_LINES) {
+                        function_scroll_offset++;
+                    }
+                }
+                break;
+            case SDLK_UP:
+                if (selected_function > 0) {
+                    selected_function--;
+                    if (selected_function < function_scroll_offset) {
+                        function_scroll_offset--;
+                    }
+                }
+                break;
+            case SDLK_F5:
+                open_graph_screen();
+                break;
+            default:
+                in_y_equals_screen = 0;  // Escape: back to the home screen
+                break;
+        }
     } else {
-        // Regular calculator key handling
+        // Regular calculator key handling (also edits the selected function on the Y= screen)
         switch (key) {
             case SDLK_1:
                 append_to_expression('1');
@@ -480,13 +995,13 @@ void handle_key(SDL_Keycode key) {
                 append_to_expression('6');
                 break;
             case SDLK_7:
-                append_to_expression('7');
+                if (second_active) append_to_expression_string("u("); else append_to_expression('7');
                 break;
             case SDLK_8:
-                append_to_expression('8');
+                if (second_active) append_to_expression_string("v("); else append_to_expression('8');
                 break;
             case SDLK_9:
-                append_to_expression('9');
+                if (second_active) append_to_expression_string("w("); else append_to_expression('9');
                 break;
             case SDLK_0:
                 append_to_expression('0');
@@ -527,13 +1042,63 @@ void handle_key(SDL_Keycode key) {
             case SDLK_t:  // Tangent (tan)
                 append_to_expression_string("tan(");
                 break;
+            case SDLK_x:  // Variable X, or n in SEQ mode (X,T,θ,n)
+                append_to_expression(sequence_mode ? 'n' : 'X');
+                break;
+            case SDLK_u:  // Sequence u (2ND 7)
+                append_to_expression_string("u(");
+                break;
+            case SDLK_v:  // Sequence v (2ND 8)
+                append_to_expression_string("v(");
+                break;
+            case SDLK_w:  // Sequence w (2ND 9)
+                append_to_expression_string("w(");
+                break;
+            case SDLK_f:  // ►Frac (MATH 1)
+                append_to_expression_string(FRAC_SUFFIX);
+                break;
+            case SDLK_i:  // The imaginary unit (2ND .)
+                append_to_expression('i');
+                break;
+            case SDLK_r:  // Square root (2ND x^2)
+                append_to_expression_string("sqrt(");
+                break;
+            case SDLK_F1:  // Y=
+                open_y_equals_screen();
+                break;
+            case SDLK_F5:  // GRAPH, or TABLE after 2ND
+                if (second_active) open_table_screen(); else open_graph_screen();
+                break;
+            case SDLK_F6:  // TABLE shortcut
+                open_table_screen();
+                break;
             case SDLK_BACKSPACE:
-                handle_del_button();  // Handle delete (DEL) ke
+            case SDLK_DELETE:
+                handle_del_button();  // Handle delete (DEL) key
+                break;
+            case SDLK_INSERT:  // INS (2ND DEL)
+                if (!in_y_equals_screen) line_editor_toggle_insert(&calc.line);
+                break;
+            case SDLK_LEFT:
+                if (!in_y_equals_screen) line_editor_left(&calc.line);
+                break;
+            case SDLK_RIGHT:
+                if (!in_y_equals_screen) line_editor_right(&calc.line);
+                break;
+            case SDLK_HOME:
+                if (!in_y_equals_screen) line_editor_home(&calc.line);
+                break;
+            case SDLK_END:
+                if (!in_y_equals_screen) line_editor_end(&calc.line);
+                break;
+            case SDLK_ESCAPE:  // ON: BREAK a running computation
+                if (calc.evaluation_pending) handle_on_button();
                 break;
             case SDLK_MODE:
-                in_mode_screen = 1;  // Switch to mode screen
-                selected_option = 0;
-                scroll_offset = 0;
+                calc.in_mode_screen = 1;  // Switch to mode screen
+                calc.selected_option = 0;
+                calc.selected_choice = mode_active_choice(0);
+                calc.scroll_offset = 0;
                 break;
             default:
                 break;
@@ -541,6 +1106,79 @@ void handle_key(SDL_Keycode key) {
     }
 }
 
+// Move the TRACE cursor, panning when it runs off the edge of the display
+void move_trace_cursor(int columns) {
+    trace_column += columns;
+    if (trace_column < 0) {
+        graph_pan(trace_column, 0);
+        trace_column = 0;
+    } else if (trace_column >= DISPLAY_WIDTH) {
+        graph_pan(trace_column - DISPLAY_WIDTH + 1, 0);
+        trace_column = DISPLAY_WIDTH - 1;
+    }
+}
+
+// Keys on the graph screen: arrows pan (or move the TRACE cursor), + and - zoom
+void handle_graph_key(SDL_Keycode key) {
+    int center_x = tracing ? trace_column : DISPLAY_WIDTH / 2;
+    switch (key) {
+        case SDLK_LEFT:
+            if (tracing) move_trace_cursor(-1); else graph_pan(-GRAPH_PAN_PIXELS, 0);
+            break;
+        case SDLK_RIGHT:
+            if (tracing) move_trace_cursor(1); else graph_pan(GRAPH_PAN_PIXELS, 0);
+            break;
+        case SDLK_UP:
+            if (tracing) {
+                // Next defined function
+                for (int i = 1; i <= GRAPH_MAX_FUNCTIONS; i++) {
+                    int slot = (trace_slot + i) % GRAPH_MAX_FUNCTIONS;
+                    if (graph_get_program(slot) != NULL) { trace_slot = slot; break; }
+                }
+            } else {
+                graph_pan(0, -GRAPH_PAN_PIXELS);
+            }
+            break;
+        case SDLK_DOWN:
+            if (tracing) {
+                // Previous defined function
+                for (int i = 1; i <= GRAPH_MAX_FUNCTIONS; i++) {
+                    int slot = (trace_slot - i + GRAPH_MAX_FUNCTIONS) % GRAPH_MAX_FUNCTIONS;
+                    if (graph_get_program(slot) != NULL) { trace_slot = slot; break; }
+                }
+            } else {
+                graph_pan(0, GRAPH_PAN_PIXELS);
+            }
+            break;
+        case SDLK_PLUS:
+        case SDLK_KP_PLUS:
+            graph_zoom(1, center_x, DISPLAY_HEIGHT / 2);
+            break;
+        case SDLK_MINUS:
+        case SDLK_KP_MINUS:
+            graph_zoom(-1, center_x, DISPLAY_HEIGHT / 2);
+            break;
+        case SDLK_F4:  // TRACE
+            tracing = !tracing;
+            break;
+        case SDLK_F1:
+            open_y_equals_screen();
+            break;
+        case SDLK_F5:
+            if (second_active) open_table_screen();
+            break;
+        case SDLK_F6:
+            open_table_screen();
+            break;
+        case SDLK_ESCAPE:
+            tracing = 0;
+            in_graph_screen = 0;  // Back to the home screen
+            break;
+        default:
+            break;
+    }
+}
+
 // Detect mouse click events on buttons
 void handle_mouse_click(int x, int y) {
     // Right-side buttons layout
@@ -605,13 +1243,13 @@ void handle_mouse_click(int x, int y) {
     start_y -= 40;  // Adjust for next row
     if (x >= start_x && x <= start_x + BUTTON_WIDTH && y >= start_y && y <= start_y + BUTTON_HEIGHT) {
         printf("7 button clicked\n");
-        append_to_expression('7');
+        if (second_active) append_to_expression_string("u("); else append_to_expression('7');
     } else if (x >= start_x + 50 && x <= start_x + 50 + BUTTON_WIDTH && y >= start_y && y <= start_y + BUTTON_HEIGHT) {
         printf("8 button clicked\n");
-        append_to_expression('8');
+        if (second_active) append_to_expression_string("v("); else append_to_expression('8');
     } else if (x >= start_x + 100 && x <= start_x + 100 + BUTTON_WIDTH && y >= start_y && y <= start_y + BUTTON_HEIGHT) {
         printf("9 button clicked\n");
-        append_to_expression('9');
+        if (second_active) append_to_expression_string("w("); else append_to_expression('9');
     }
 
     // Additional buttons: "(", ")", ","
@@ -633,14 +1271,18 @@ void handle_mouse_click(int x, int y) {
 
     if (x >= new_row_start_x && x <= new_row_start_x + BUTTON_WIDTH * 1.5 && y >= new_row_start_y && y <= new_row_start_y + small_button_height) {
         printf("Y= button clicked\n");
+        open_y_equals_screen();
     } else if (x >= new_row_start_x + 90 && x <= new_row_start_x + 90 + BUTTON_WIDTH * 1.5 && y >= new_row_start_y && y <= new_row_start_y + small_button_height) {
         printf("WINDOW button clicked\n");
     } else if (x >= new_row_start_x + 180 && x <= new_row_start_x + 180 + BUTTON_WIDTH * 1.5 && y >= new_row_start_y && y <= new_row_start_y + small_button_height) {
         printf("ZOOM button clicked\n");
     } else if (x >= new_row_start_x + 270 && x <= new_row_start_x + 270 + BUTTON_WIDTH * 1.5 && y >= new_row_start_y && y <= new_row_start_y + small_button_height) {
         printf("TRACE button clicked\n");
+        open_graph_screen();
+        tracing = 1;
     } else if (x >= new_row_start_x + 360 && x <= new_row_start_x + 360 + BUTTON_WIDTH * 1.5 && y >= new_row_start_y && y <= new_row_start_y + small_button_height) {
         printf("GRAPH button clicked\n");
+        if (second_active) open_table_screen(); else open_graph_screen();
     }
 
     // "log", "ln", "sin", "cos", "tan"
@@ -700,15 +1342,38 @@ void handle_mouse_click(int x, int y) {
     // Check if the DEL button is clicked
     if (x >= right_x - 100 && x <= right_x - 100 + BUTTON_WIDTH && y >= start_y - 200 && y <= start_y - 200 + BUTTON_HEIGHT) {
         printf("DEL button clicked\n");
-        handle_del_button();  // Call the function to handle the delete action
+        if (second_active && !in_y_equals_screen) {
+            line_editor_toggle_insert(&calc.line);  // 2ND DEL is INS
+        } else {
+            handle_del_button();  // Call the function to handle the delete action
+        }
         return;
     }
 
+    // MATH button: its first entry, ►Frac (above "X^-1")
+    if (x >= right_x - 200 && x <= right_x - 200 + BUTTON_WIDTH && y >= start_y - 120 && y <= start_y - 120 + BUTTON_HEIGHT) {
+        printf("MATH button clicked\n");
+        append_to_expression_string(FRAC_SUFFIX);
+    }
+
+    // Check for "X" button click (above APPS)
+    if (x >= right_x - 150 && x <= right_x - 150 + BUTTON_WIDTH && y >= start_y - 160 && y <= start_y - 160 + BUTTON_HEIGHT) {
+        printf("X button clicked\n");
+        append_to_expression(sequence_mode ? 'n' : 'X');
+    }
+
+    // Check for "2ND" button click (above ALPHA)
+    if (x >= left_x && x <= left_x + BUTTON_WIDTH && y >= start_y - 200 && y <= start_y - 200 + BUTTON_HEIGHT) {
+        printf("2ND button clicked\n");
+        second_active = !second_active;
+        return;  // Stays active for the next key
+    }
+
     // MODE button detection
     if (x >= right_x - 150 && x <= right_x - 150 + BUTTON_WIDTH && y >= start_y - 200 && y <= start_y - 200 + BUTTON_HEIGHT) {
         printf("MODE button clicked\n");
-        in_mode_screen = 1;  // Switch to mode screen
-        render_mode_screen();  // Render the mode screen
+        calc.in_mode_screen = 1;  // Switch to mode screen
+        calc.selected_choice = mode_active_choice(calc.selected_option);
         return;
     }
 
@@ -716,58 +1381,102 @@ void handle_mouse_click(int x, int y) {
 
 // Function to clear the calculator's screen and reset the cursor
 void clear_screen() {
+    if (calc.evaluation_pending) return;  // Keep the line the result belongs to
+
     // Clear the screen buffer
     for (int i = 0; i < MAX_LINES; i++) {
-        memset(screen_buffer[i], 0, LINE_LENGTH);  // Clear each line in the buffer
+        memset(calc.screen_buffer[i], 0, LINE_LENGTH);  // Clear each line in the buffer
     }
 
-    // Reset the current line and cursor position
-    current_line = 0;
-    cursor_position = 0;
-
-    // Reset the expression buffer
-    memset(expression, 0, sizeof(expression));
+    // Reset the current line and the line being entered
+    calc.current_line = 0;
+    line_editor_clear(&calc.line);
 
     printf("Screen cleared\n");
-
-    // Update the screen after clearing
-    update_screen();
 }
 
 
+// How long an event waited in SDL's queue, for example through the main loop's delay: its timestamp
+// is in SDL_GetTicks milliseconds
+static uint64_t event_queue_time(const SDL_Event* event) {
+    Uint32 waited = SDL_GetTicks() - event->common.timestamp;
+    return waited < 60000 ? (uint64_t)waited * 1000000 : 0;  // A timestamp from the future wraps around
+}
+
 // Handle events
 void handle_input(int* quit) {
+    PROFILE_SCOPE("handle_input");
     SDL_Event event;
-    while (SDL_PollEvent(&event) != 0) {
+    while (input_poll_event(&event, calc.evaluation_pending) != 0) {
+        PROFILE_SCOPE("dispatch event");
         if (event.type == SDL_QUIT) {
             *quit = 1;
         } else if (event.type == SDL_KEYDOWN) {
+            profile_input_event(event_queue_time(&event));
+            if (event.key.keysym.sym == SDLK_F12) {
+                profile_overlay = !profile_overlay;
+                continue;
+            }
             handle_key(event.key.keysym.sym);
+            second_active = 0;  // 2ND applies to the next key only
         } else if (event.type == SDL_MOUSEBUTTONDOWN) {
+            profile_input_event(event_queue_time(&event));  // A click on a calculator key counts as a key press
+            int was_second = second_active;
             handle_mouse_click(event.button.x, event.button.y);
+            if (was_second) second_active = 0;
         }
     }
-    // Persist the mode screen if active
-    if (in_mode_screen) {
-        render_mode_screen();  // Keep rendering the mode screen
+
+    // Pick up finished evaluations without blocking, so the frame rate holds during long computations
+    EvalResult result;
+    while (input_log_result_due() && eval_worker_poll(&result)) {
+        show_result(&result);
+        input_log_result_shown();
+    }
+
+}
+
+// Draw the active screen and present it: once per frame, after the input it shows
+void render_frame(int capture) {
+    PROFILE_SCOPE("render_frame");
+    if (calc.in_mode_screen) {
+        render_mode_screen();
+    } else if (in_table_screen) {
+        render_table_screen();
+    } else if (in_y_equals_screen) {
+        render_y_equals_screen();
+    } else if (in_graph_screen) {
+        render_graph_screen();
     } else {
-        render_calculator();   // If not in mode, render calculator as usual
+        render_calculator();
     }
+    present_frame(capture);
 }
 
 void handle_del_button() {
-    if (cursor_position > 0) {
-        // Shift all characters after the cursor one position to the left
-        int len = strlen(screen_buffer[current_line]);
-        for (int i = cursor_position - 1; i < len; i++) {
-            screen_buffer[current_line][i] = screen_buffer[current_line][i + 1];
+    if (in_y_equals_screen) {
+        const char* function = y_equals_text(selected_function);
+        int len = strlen(function);
+        if (len > 0) {
+            char updated[GRAPH_EXPRESSION_LENGTH];
+            snprintf(updated, sizeof(updated), "%.*s", len - 1, function);
+            y_equals_set(selected_function, updated);
         }
-        cursor_position--;  // Move the cursor back one position
-        update_screen();     // Re-render the screen with the updated expression
+        return;
     }
+    if (calc.evaluation_pending) return;
+
+    // DEL removes the character under the cursor; at the end of the line there is none, so the one before it
+    if (!line_editor_delete(&calc.line)) line_editor_backspace(&calc.line);
 }
 
 void handle_on_button() {
+    if (calc.evaluation_pending) {
+        eval_worker_cancel();  // BREAK: the result comes back as ERR:BREAK
+        printf("Break\n");
+        return;
+    }
+
     if (screen_on) {
         screen_on = 0;  // Turn the screen off
         printf("Turning screen off\n");
@@ -775,7 +1484,6 @@ void handle_on_button() {
         screen_on = 1;  // Turn the screen on
         printf("Turning screen on\n");
     }
-    update_screen();  // Re-render the screen in its current state
 }
 
 void handle_q_button() {
@@ -788,23 +1496,44 @@ void handle_q_button() {
 }
 
 void handle_enter() {
+    if (calc.evaluation_pending) return;  // One computation at a time, like the real calculator
+
+    const char* expression = line_editor_text(&calc.line);
     printf("Enter button clicked. Expression: %s\n", expression);  // Log the expression
+    snprintf(calc.screen_buffer[calc.current_line], LINE_LENGTH, "%s", expression);  // Stays on screen above the result
 
-    // Pass the expression to the math engine
-    double result = evaluate_expression(screen_buffer[current_line]);
+    // Hand the expression to the worker thread; show_result picks up the answer
+    if (eval_worker_submit(&calc.context, expression) == 0) {
+        printf("Error: Evaluation queue is full\n");
+        return;
+    }
+    calc.evaluation_pending = 1;
+}
 
-    printf("Result of expression: %.2f\n", result);
+// Display a finished evaluation below its expression and start a new input line
+void show_result(const EvalResult* result) {
+    calc.evaluation_pending = 0;
+    graph_set_context(&calc.context);  // The context is back from the worker, with the new Ans
 
     // Display the result right-aligned on the next line
-    current_line = (current_line + 1) % MAX_LINES;
-    total_lines = total_lines < MAX_LINES ? total_lines + 1 : MAX_LINES;
-    snprintf(screen_buffer[current_line], LINE_LENGTH, "%10.2f", result);
+    calc.current_line = (calc.current_line + 1) % MAX_LINES;
+    calc.total_lines = calc.total_lines < MAX_LINES ? calc.total_lines + 1 : MAX_LINES;
+    if (result->status == EVAL_CANCELLED) {
+        printf("Evaluation cancelled\n");
+        snprintf(calc.screen_buffer[calc.current_line], LINE_LENGTH, "ERR:BREAK");
+    } else {
+        char text[FORMAT_COMPLEX_LENGTH];
+        if (!result->has_fraction || !format_fraction(result->fraction, text)) {
+            // ►Frac found none: decimal, like the TI-84
+            format_complex(&calc.context, result->value, result->imaginary, FORMAT_DISPLAY_DIGITS, text);
+        }
+        printf("Result of expression: %s\n", text);
+        snprintf(calc.screen_buffer[calc.current_line], LINE_LENGTH, "%10s", text);
+    }
 
     // Move to the next input line (empty line)
-    current_line = (current_line + 1) % MAX_LINES;
-    total_lines = total_lines < MAX_LINES ? total_lines + 1 : MAX_LINES;
-    screen_buffer[current_line][0] = '\0';  // Clear the new line
-    cursor_position = 0;  // Reset cursor position
-
-    update_screen();  // Render everything    
+    calc.current_line = (calc.current_line + 1) % MAX_LINES;
+    calc.total_lines = calc.total_lines < MAX_LINES ? calc.total_lines + 1 : MAX_LINES;
+    calc.screen_buffer[calc.current_line][0] = '\0';  // Clear the new line
+    line_editor_clear(&calc.line);
 }
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "sequence.h"
+#include "optimizer.h"
+#include "profiler.h"
+
+#define SEQUENCE_MAX_N 9007199254740992.0  // 2^53: beyond it not every n is a double
+
+int sequence_mode = 0;
+
+static atomic_uint next_version = 1;  // Versions are never reused, so a memo cannot mistake one set for another
+
+// What one thread knows about the sequences: the compiled definitions and a window of recent terms
+typedef struct {
+    const Sequences* owner;       // Set this was compiled from; NULL = never
+    unsigned version;             // Its version at the time
+    long nmin;
+    Program programs[SEQUENCE_COUNT];
+    int valid[SEQUENCE_COUNT];
+    int order[SEQUENCE_COUNT];    // How many terms back the definition goes; 0 = evaluated directly at n
+    double initial[SEQUENCE_COUNT][SEQUENCE_MAX_LAG];  // u(nMin), u(nMin+1)
+    unsigned long reads;          // Variables (A..Z, Ans) the definitions and initial terms read
+    long last;                    // Last term computed; the window holds the terms up to SEQUENCE_WINDOW before it
+    double window[SEQUENCE_WINDOW][SEQUENCE_COUNT];
+    CalcContext context;          // Modes and variables of the terms, with its own value stack
+} SequenceMemo;
+
+static _Thread_local SequenceMemo memo;
+
+// Called with the set's lock held
+static void changed(Sequences* sequences) {
+    atomic_store_explicit(&sequences->version, atomic_fetch_add(&next_version, 1), memory_order_release);
+}
+
+void sequences_init(Sequences* sequences) {
+    memset(sequences->definitions, 0, sizeof(sequences->definitions));
+    memset(sequences->initials, 0, sizeof(sequences->initials));
+    sequences->nmin = SEQUENCE_DEFAULT_NMIN;
+    pthread_mutex_init(&sequences->lock, NULL);
+    changed(sequences);
+}
+
+void sequence_set(Sequences* sequences, int which, const char* expression) {
+    if (which < 0 || which >= SEQUENCE_COUNT) return;
+    pthread_mutex_lock(&sequences->lock);
+    snprintf(sequences->definitions[which], SEQUENCE_EXPRESSION_LENGTH, "%s", expression);
+    changed(sequences);
+    pthread_mutex_unlock(&sequences->lock);
+}
+
+void sequence_set_initial(Sequences* sequences, int which, const char* values) {
+    if (which < 0 || which >= SEQUENCE_COUNT) return;
+    pthread_mutex_lock(&sequences->lock);
+    snprintf(sequences->initials[which], SEQUENCE_EXPRESSION_LENGTH, "%s", values);
+    changed(sequences);
+    pthread_mutex_unlock(&sequences->lock);
+}
+
+int sequence_set_nmin(Sequences* sequences, double value) {
+    if (!(value >= 0 && value < SEQUENCE_MAX_N) || value != floor(value)) return 0;
+    pthread_mutex_lock(&sequences->lock);
+    sequences->nmin = (long)value;
+    changed(sequences);
+    pthread_mutex_unlock(&sequences->lock);
+    return 1;
+}
+
+const char* sequence_get(const Sequences* sequences, int which) {
+    return sequences->definitions[which];
+}
+
+const char* sequence_get_initial(const Sequences* sequences, int which) {
+    return sequences->initials[which];
+}
+
+long sequence_get_nmin(const Sequences* sequences) {
+    return sequences->nmin;
+}
+
+int sequence_defined(const Sequences* sequences, int which) {
+    return sequences->definitions[which][0] != '\0';
+}
+
+char sequence_name(int which) {
+    return "uvw"[which];
+}
+
+// Replace each u(n-1) .. w(n-2) with the variable holding that term and find how far back the program
+// goes. Returns 0 for any other use of u, v or w: a definition refers only to earlier terms.
+static int resolve_terms(Program* program, int* order) {
+    int length = 0;
+    *order = 0;
+    for (int i = 0; i < program->length; i++) {
+        Token token = program->tokens[i];
+        if (token.type == TOKEN_FUNCTION && is_sequence_function(token.func)) {
+            // In postfix order the argument n-k is the three tokens X k - right before the call
+            if (length < 3) return 0;
+            const Token* argument = &program->tokens[length - 3];
+            if (argument[0].type != TOKEN_VARIABLE_X || argument[1].type != TOKEN_NUMBER ||
+                argument[2].type != TOKEN_OPERATOR || argument[2].op != '-' ||
+                (argument[1].value != 1.0 && argument[1].value != 2.0)) {
+                return 0;
+            }
+            int lag = (int)argument[1].value;
+            length -= 3;
+            token.type = TOKEN_VARIABLE;
+            token.variable = CALC_TERMS + (token.func - FUNC_SEQ_U) * SEQUENCE_MAX_LAG + lag - 1;
+            token.func = FUNC_UNKNOWN;
+            if (lag > *order) *order = lag;
+        }
+        program->tokens[length++] = token;
+    }
+    program->length = length;
+    return 1;
+}
+
+// Read the initial terms of a sequence, given as {u(nMin+1),u(nMin)} or a single u(nMin).
+// Returns the number of terms, or -1 if the list is invalid.
+static int read_initial(const char* text, double* terms) {
+    char list[SEQUENCE_EXPRESSION_LENGTH];
+    char* items[SEQUENCE_MAX_LAG];
+    int count = 0;
+
+    snprintf(list, sizeof(list), "%s", text);
+    char* item = list;
+    while (*item == ' ' || *item == '{') item++;
+    char* end = item + strlen(item);
+    while (end > item && (end[-1] == ' ' || end[-1] == '}')) *--end = '\0';
+    if (*item == '\0') return 0;
+
+    for (;;) {
+        if (count == SEQUENCE_MAX_LAG) return -1;
+        items[count++] = item;
+        char* comma = strchr(item, ',');
+        if (comma == NULL) break;
+        *comma = '\0';
+        item = comma + 1;
+    }
+    for (int i = 0; i < count; i++) {
+        Program program;
+        if (!compile_expression(items[i], &program)) return -1;
+        memo.reads |= program_variables_read(&program);
+        terms[count - 1 - i] = run_program(&memo.context, &program, 0.0);  // The list runs backwards from the last term
+    }
+    return count;
+}
+
+// Compile the current definitions of the caller's set for this thread, in its modes and variables
+static void compile_sequences(const CalcContext* context) {
+    char texts[SEQUENCE_COUNT][SEQUENCE_EXPRESSION_LENGTH];
+    char values[SEQUENCE_COUNT][SEQUENCE_EXPRESSION_LENGTH];
+    Sequences* sequences = context->sequences;
+
+    pthread_mutex_lock(&sequences->lock);
+    memcpy(texts, sequences->definitions, sizeof(texts));
+    memcpy(values, sequences->initials, sizeof(values));
+    memo.nmin = sequences->nmin;
+    memo.version = atomic_load_explicit(&sequences->version, memory_order_relaxed);
+    pthread_mutex_unlock(&sequences->lock);
+
+    calc_context_init(&memo.context);
+    calc_context_copy_modes(&memo.context, context);
+    memo.owner = sequences;
+    memo.reads = 0;
+    for (int s = 0; s < SEQUENCE_COUNT; s++) {
+        memo.valid[s] = 0;
+        if (texts[s][0] == '\0') continue;
+        if (!compile_expression(texts[s], &memo.programs[s])) continue;
+        if (!resolve_terms(&memo.programs[s], &memo.order[s])) {
+            printf("Error: %c(n) may only use the terms before it, like %c(n-1) and %c(n-2)\n",
+                   sequence_name(s), sequence_name(s), sequence_name(s));
+            continue;
+        }
+        optimize_program(&memo.context, &memo.programs[s]);  // Run once per term
+        memo.reads |= program_variables_read(&memo.programs[s]);
+
+        int count = read_initial(values[s], memo.initial[s]);
+        if (count < memo.order[s]) {
+            printf("Error: %c(nMin) needs %d initial term%s\n", sequence_name(s), memo.order[s], memo.order[s] > 1 ? "s" : "");
+            continue;
+        }
+        memo.valid[s] = 1;
+    }
+    memo.last = memo.nmin - 1;  // Nothing computed yet
+}
+
+// Make this thread's window match the caller's set and its modes and variables
+static void synchronize(const CalcContext* context) {
+    unsigned current = atomic_load_explicit(&context->sequences->version, memory_order_acquire);
+    if (context->sequences != memo.owner || current != memo.version || context->angle != memo.context.angle) {
+        compile_sequences(context);  // Constants like sin(30) are folded for the angle mode
+        return;
+    }
+    for (int v = 0; v < CALC_TERMS; v++) {
+        if ((memo.reads >> v & 1) && memcmp(&context->variables[v], &memo.context.variables[v], sizeof(double)) != 0) {
+            compile_sequences(context);  // The initial terms may change too
+            return;
+        }
+    }
+}
+
+static double term_at(int which, long n) {
+    return n < memo.nmin ? NAN : memo.window[n & (SEQUENCE_WINDOW - 1)][which];
+}
+
+// Compute term n of every sequence from the terms before it
+static void step(long n) {
+    double* terms = memo.context.variables + CALC_TERMS;
+    for (int s = 0; s < SEQUENCE_COUNT; s++) {
+        for (int lag = 1; lag <= SEQUENCE_MAX_LAG; lag++) {
+            terms[s * SEQUENCE_MAX_LAG + lag - 1] = term_at(s, n - lag);
+        }
+    }
+    double* out = memo.window[n & (SEQUENCE_WINDOW - 1)];
+    for (int s = 0; s < SEQUENCE_COUNT; s++) {
+        if (!memo.valid[s]) {
+            out[s] = NAN;
+        } else if (n < memo.nmin + memo.order[s]) {
+            out[s] = memo.initial[s][n - memo.nmin];
+        } else {
+            out[s] = run_program(&memo.context, &memo.programs[s], (double)n);
+        }
+    }
+}
+
+double sequence_term(const CalcContext* context, int which, double n) {
+    if (context->sequences == NULL) return NAN;
+    synchronize(context);
+    if (!memo.valid[which] || !(n >= memo.nmin && n < SEQUENCE_MAX_N) || n != floor(n)) return NAN;
+    if (memo.order[which] == 0) {
+        return run_program(&memo.context, &memo.programs[which], n);  // No earlier terms needed
+    }
+
+    long target = (long)n;
+    if (target <= memo.last - SEQUENCE_WINDOW) {
+        memo.last = memo.nmin - 1;  // Fell out of the window: start over
+    }
+    if (target > memo.last) {
+        PROFILE_SCOPE("sequence steps");
+        while (memo.last < target) {
+            step(++memo.last);
+            if ((memo.last & (SEQUENCE_CANCEL_INTERVAL - 1)) == 0 && evaluation_cancelled(context)) return NAN;
+        }
+    }
+    return term_at(which, target);
+}
@@ -0,0 +1,498 @@
+#define _GNU_SOURCE  // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include "server.h"
+#include "math_engine.h"
+#include "optimizer.h"
+#include "profiler.h"
+
+// A compiled expression, keyed by its text and the angle mode it was optimized for
+typedef struct {
+    uint64_t hash;
+    int angle;
+    char* expression;   // NULL when the slot is empty
+    Program program;
+    int valid;          // 0 if the expression did not compile: the error is remembered too
+    unsigned long used; // Cache clock at the last lookup
+} CacheEntry;
+
+typedef struct {
+    unsigned char* data;
+    size_t used;
+    size_t capacity;
+} Buffer;
+
+typedef struct Connection {
+    int fd;               // Open until the connection is freed, so its number is never reused early
+    pthread_mutex_t lock; // Guards everything down to next
+    Buffer input;         // Bytes read but not yet taken by a worker
+    Buffer output;        // Answers not yet written
+    size_t output_sent;
+    int scheduled;        // On the run queue or with a worker
+    int closed;           // The client left while scheduled: the worker frees it
+    int eof;              // The client shut down its side: answer what is in, then close
+    uint32_t events;      // What the connection is registered for in the epoll loop
+    struct Connection* next;  // Run queue
+    // Only the worker serving the connection touches these
+    CacheEntry* cache[SERVER_CACHE_SLOTS];  // Sets of SERVER_CACHE_WAYS slots, chosen by the hash
+    unsigned long cache_clock;
+    CalcContext context;
+} Connection;
+
+static int epoll_fd = -1;
+static volatile sig_atomic_t stop_requested = 0;
+
+// Connections with requests waiting for a worker
+static Connection* run_head = NULL;
+static Connection* run_tail = NULL;
+static pthread_mutex_t run_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t run_ready = PTHREAD_COND_INITIALIZER;
+static int workers_stopping = 0;
+
+static atomic_ulong requests_served;
+static atomic_ulong cache_hits;
+static atomic_ulong connections_accepted;
+
+static void handle_stop(int signal) {
+    (void)signal;
+    stop_requested = 1;
+}
+
+static int reserve(Buffer* buffer, size_t extra) {
+    if (buffer->used + extra <= buffer->capacity) return 1;
+    size_t capacity = buffer->capacity > 0 ? buffer->capacity : 4096;
+    while (capacity < buffer->used + extra) capacity *= 2;
+    unsigned char* data = realloc(buffer->data, capacity);
+    if (data == NULL) return 0;
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+static void run_queue_push(Connection* connection) {
+    pthread_mutex_lock(&run_lock);
+    connection->next = NULL;
+    if (run_tail != NULL) run_tail->next = connection; else run_head = connection;
+    run_tail = connection;
+    pthread_cond_signal(&run_ready);
+    pthread_mutex_unlock(&run_lock);
+}
+
+// Next connection to serve, or NULL when the workers are stopping
+static Connection* run_queue_pop() {
+    pthread_mutex_lock(&run_lock);
+    while (run_head == NULL && !workers_stopping) pthread_cond_wait(&run_ready, &run_lock);
+    Connection* connection = run_head;
+    if (connection != NULL) {
+        run_head = connection->next;
+        if (run_head == NULL) run_tail = NULL;
+    }
+    pthread_mutex_unlock(&run_lock);
+    return connection;
+}
+
+static void free_connection(Connection* connection) {
+    close(connection->fd);
+    for (int i = 0; i < SERVER_CACHE_SLOTS; i++) {
+        if (connection->cache[i] != NULL) free(connection->cache[i]->expression);
+        free(connection->cache[i]);
+    }
+    free(connection->input.data);
+    free(connection->output.data);
+    pthread_mutex_destroy(&connection->lock);
+    free(connection);
+}
+
+// Bytes at the start of the input that form whole requests, or -1 if a header is malformed
+static long complete_requests(const Buffer* input) {
+    size_t offset = 0;
+    while (input->used - offset >= sizeof(uint32_t)) {
+        uint32_t size;
+        memcpy(&size, input->data + offset, sizeof(size));
+        if (size < sizeof(ServerRequest) - sizeof(uint32_t) || size > SERVER_MAX_FRAME) return -1;
+        if (input->used - offset - sizeof(uint32_t) < size) break;
+        offset += sizeof(uint32_t) + size;
+    }
+    return (long)offset;
+}
+
+// Nothing left to do on a connection whose client has sent everything
+static int finished(const Connection* connection) {
+    return connection->eof && !connection->scheduled && connection->output_sent == connection->output.used &&
+           complete_requests(&connection->input) <= 0;
+}
+
+// Register for what the connection waits on. Reading stops while too much input waits for a worker or
+// too much output for the client, and resumes once the worker or EPOLLOUT drains it. A finished connection
+// waits for EPOLLOUT, which fires at once, so the loop closes it. Called with the lock held.
+static void update_events(Connection* connection) {
+    size_t unsent = connection->output.used - connection->output_sent;
+    uint32_t events = 0;
+    if (!connection->eof && unsent < SERVER_MAX_BUFFERED && connection->input.used < SERVER_MAX_BUFFERED) {
+        events |= EPOLLIN;
+    }
+    if (unsent > 0 || finished(connection)) events |= EPOLLOUT;
+    if (events != connection->events && !connection->closed) {
+        struct epoll_event event = { events, { .ptr = connection } };
+        connection->events = events;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    }
+}
+
+// Write as much output as the socket takes; wait for EPOLLOUT for the rest. Called with the lock held.
+static void flush_output(Connection* connection) {
+    while (connection->output_sent < connection->output.used) {
+        ssize_t sent = send(connection->fd, connection->output.data + connection->output_sent,
+                            connection->output.used - connection->output_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent > 0) {
+            connection->output_sent += sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            connection->output_sent = connection->output.used;  // The client is gone; the loop sees the hangup
+        }
+    }
+    if (connection->output_sent == connection->output.used) connection->output.used = connection->output_sent = 0;
+    update_events(connection);
+}
+
+static uint64_t hash_expression(const char* expression, size_t length, int angle) {
+    uint64_t hash = 14695981039346656037ull;  // FNV-1a
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)expression[i]) * 1099511628211ull;
+    }
+    return (hash ^ (uint64_t)angle) * 1099511628211ull;
+}
+
+// The compiled expression from the connection's cache, compiling it on a miss. NULL on a syntax error.
+static const Program* cached_program(Connection* connection, const char* expression, size_t length) {
+    int angle = connection->context.angle;
+    uint64_t hash = hash_expression(expression, length, angle);
+    CacheEntry** set = connection->cache + hash % (SERVER_CACHE_SLOTS / SERVER_CACHE_WAYS) * SERVER_CACHE_WAYS;
+    int victim = 0;
+
+    connection->cache_clock++;
+    for (int way = 0; way < SERVER_CACHE_WAYS; way++) {
+        CacheEntry* entry = set[way];
+        if (entry == NULL) {
+            victim = way;
+            break;
+        }
+        if (entry->hash == hash && entry->angle == angle && entry->expression != NULL &&
+            strncmp(entry->expression, expression, length) == 0 && entry->expression[length] == '\0') {
+            entry->used = connection->cache_clock;
+            atomic_fetch_add_explicit(&cache_hits, 1, memory_order_relaxed);
+            return entry->valid ? &entry->program : NULL;
+        }
+        if (entry->used < set[victim]->used) victim = way;
+    }
+
+    // Miss: take an empty slot or the least recently used
+    CacheEntry* entry = set[victim];
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(CacheEntry));
+        if (entry == NULL) return NULL;
+        set[victim] = entry;
+    }
+    free(entry->expression);
+    entry->expression = malloc(length + 1);
+    if (entry->expression == NULL) return NULL;
+    memcpy(entry->expression, expression, length);
+    entry->expression[length] = '\0';
+    entry->hash = hash;
+    entry->angle = angle;
+    entry->used = connection->cache_clock;
+    entry->valid = compile_expression(entry->expression, &entry->program);
+    if (entry->valid) optimize_program(&connection->context, &entry->program);  // Cached for the angle mode
+    return entry->valid ? &entry->program : NULL;
+}
+
+// Answer one request into out
+static void answer(Connection* connection, const unsigned char* frame, Buffer* out, double** values, size_t* values_capacity) {
+    ServerRequest request;
+    ServerResponse response = { sizeof(ServerResponse) - sizeof(uint32_t), 0, SERVER_OK, { 0 }, 0 };
+    memcpy(&request, frame, sizeof(request));
+    response.id = request.id;
+
+    size_t expected = sizeof(ServerRequest) + request.expression_length + (size_t)request.count * sizeof(double);
+    const Program* program = NULL;
+    if (request.op != SERVER_OP_EVALUATE || request.angle > ANGLE_DEGREE ||
+        expected != (size_t)request.size + sizeof(uint32_t)) {
+        response.status = SERVER_BAD_REQUEST;
+    } else {
+        connection->context.angle = (AngleMode)request.angle;
+        program = cached_program(connection, (const char*)frame + sizeof(request), request.expression_length);
+        if (program == NULL) response.status = SERVER_SYNTAX_ERROR;
+    }
+
+    if (response.status == SERVER_OK) {
+        if (*values_capacity < request.count) {
+            double* grown = realloc(*values, request.count * sizeof(double));
+            if (grown == NULL) {
+                response.status = SERVER_BAD_REQUEST;
+            } else {
+                *values = grown;
+                *values_capacity = request.count;
+            }
+        }
+    }
+    if (response.status == SERVER_OK) {
+        double* x = *values;
+        memcpy(x, frame + sizeof(request) + request.expression_length, request.count * sizeof(double));
+        response.count = request.count;
+        response.size += request.count * sizeof(double);
+        if (!program_is_real(&connection->context, program)) {
+            for (uint32_t i = 0; i < request.count; i++) x[i] = NAN;
+        } else if (request.count == 1) {
+            x[0] = run_program(&connection->context, program, x[0]);
+        } else {
+            run_program_batch(&connection->context, program, x, x, request.count);
+        }
+    }
+
+    if (!reserve(out, sizeof(uint32_t) + response.size)) return;
+    memcpy(out->data + out->used, &response, sizeof(response));
+    out->used += sizeof(response);
+    if (response.count > 0) {
+        memcpy(out->data + out->used, *values, response.count * sizeof(double));
+        out->used += response.count * sizeof(double);
+    }
+    atomic_fetch_add_explicit(&requests_served, 1, memory_order_relaxed);
+}
+
+// Answer every complete request of a connection, then give it back. Requests that arrive meanwhile are
+// taken in the next round, so the connection is never on the queue twice.
+static void serve_connection(Connection* connection, Buffer* requests, Buffer* answers, double** values, size_t* values_capacity) {
+    for (;;) {
+        pthread_mutex_lock(&connection->lock);
+        requests->used = 0;
+        long taken = connection->closed ? 0 : complete_requests(&connection->input);
+        if (taken > 0 && !reserve(requests, taken)) taken = 0;  // Out of memory: the requests wait for more input
+        if (taken <= 0) {
+            int closed = connection->closed;
+            connection->scheduled = 0;
+            update_events(connection);
+            pthread_mutex_unlock(&connection->lock);
+            if (closed) free_connection(connection);
+            return;
+        }
+        memcpy(requests->data, connection->input.data, taken);
+        requests->used = taken;
+        memmove(connection->input.data, connection->input.data + taken, connection->input.used - taken);
+        connection->input.used -= taken;
+        update_events(connection);
+        pthread_mutex_unlock(&connection->lock);
+
+        PROFILE_SCOPE("serve requests");
+        answers->used = 0;
+        for (size_t offset = 0; offset < requests->used;) {
+            uint32_t size;
+            memcpy(&size, requests->data + offset, sizeof(size));
+            answer(connection, requests->data + offset, answers, values, values_capacity);
+            offset += sizeof(uint32_t) + size;
+        }
+
+        pthread_mutex_lock(&connection->lock);
+        if (reserve(&connection->output, answers->used)) {
+            memcpy(connection->output.data + connection->output.used, answers->data, answers->used);
+            connection->output.used += answers->used;
+        }
+        flush_output(connection);
+        pthread_mutex_unlock(&connection->lock);
+    }
+}
+
+static void* worker_thread(void* arg) {
+    Buffer requests = { NULL, 0, 0 }, answers = { NULL, 0, 0 };
+    double* values = NULL;
+    size_t values_capacity = 0;
+    (void)arg;
+    profile_thread_name("server worker");
+
+    Connection* connection;
+    while ((connection = run_queue_pop()) != NULL) {
+        serve_connection(connection, &requests, &answers, &values, &values_capacity);
+    }
+    free(requests.data);
+    free(answers.data);
+    free(values);
+    return NULL;
+}
+
+static void accept_connections(int listen_fd) {
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;  // EAGAIN: no more waiting
+
+        Connection* connection = calloc(1, sizeof(Connection));
+        if (connection == NULL) {
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        pthread_mutex_init(&connection->lock, NULL);
+        calc_context_init(&connection->context);
+        connection->events = EPOLLIN;
+        struct epoll_event event = { EPOLLIN, { .ptr = connection } };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            free_connection(connection);
+            continue;
+        }
+        atomic_fetch_add_explicit(&connections_accepted, 1, memory_order_relaxed);
+    }
+}
+
+static void close_connection(Connection* connection) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    pthread_mutex_lock(&connection->lock);
+    int scheduled = connection->scheduled;
+    connection->closed = 1;
+    pthread_mutex_unlock(&connection->lock);
+    if (!scheduled) free_connection(connection);  // Otherwise its worker frees it
+}
+
+// Read what the client sent and queue the connection if a whole request is in. A client that shut down
+// its side still gets the answers to its complete requests. Returns 0 to close the connection.
+static int read_requests(Connection* connection) {
+    int open = 1, queue = 0;
+    pthread_mutex_lock(&connection->lock);
+    while (connection->input.used < SERVER_MAX_BUFFERED) {
+        if (!reserve(&connection->input, SERVER_READ_CHUNK)) {
+            open = 0;
+            break;
+        }
+        ssize_t received = recv(connection->fd, connection->input.data + connection->input.used, SERVER_READ_CHUNK, 0);
+        if (received > 0) {
+            connection->input.used += received;
+        } else if (received < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (received == 0) connection->eof = 1;
+            else open = errno == EAGAIN || errno == EWOULDBLOCK;
+            break;
+        }
+    }
+    long complete = complete_requests(&connection->input);
+    if (complete < 0) open = 0;  // Not speaking the protocol
+    if (open && complete > 0 && !connection->scheduled) {
+        connection->scheduled = queue = 1;
+    }
+    if (open && finished(connection)) open = 0;
+    if (open) update_events(connection);
+    pthread_mutex_unlock(&connection->lock);
+    if (queue) run_queue_push(connection);
+    return open;
+}
+
+// Listen on a fresh socket at path, replacing a stale socket file but nothing else
+static int listen_on(const char* path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    struct stat status;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("Error: Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    if (lstat(path, &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+            printf("Error: %s exists and is not a socket\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        printf("Error: Could not listen on %s: %s\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int server_run(const char* path, int workers) {
+    pthread_t threads[workers];
+    struct epoll_event events[SERVER_MAX_EVENTS];
+
+    int listen_fd = listen_on(path);
+    if (listen_fd < 0) return -1;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event listen_event = { EPOLLIN, { .ptr = NULL } };
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event) != 0) {
+        printf("Error: Could not create the event loop: %s\n", strerror(errno));
+        close(listen_fd);
+        unlink(path);
+        return -1;
+    }
+
+    struct sigaction action = { .sa_handler = handle_stop };
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    int started = 0;
+    for (; started < workers; started++) {
+        if (pthread_create(&threads[started], NULL, worker_thread, NULL) != 0) break;
+    }
+    printf("Serving on %s with %d workers\n", path, started);
+    fflush(stdout);
+
+    while (!stop_requested && started > 0) {
+        int count = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            printf("Error: epoll_wait: %s\n", strerror(errno));
+            break;
+        }
+        PROFILE_SCOPE("server events");
+        for (int i = 0; i < count; i++) {
+            Connection* connection = events[i].data.ptr;
+            if (connection == NULL) {
+                accept_connections(listen_fd);
+                continue;
+            }
+            // A hangup means the client closed both sides and cannot read the answers any more
+            if ((events[i].events & (EPOLLHUP | EPOLLERR)) ||
+                ((events[i].events & EPOLLIN) && !read_requests(connection))) {
+                close_connection(connection);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                pthread_mutex_lock(&connection->lock);
+                flush_output(connection);
+                int done = finished(connection);
+                pthread_mutex_unlock(&connection->lock);
+                if (done) close_connection(connection);
+            }
+        }
+    }
+
+    // Let the workers finish what they hold; clients still connected are cut off at exit
+    pthread_mutex_lock(&run_lock);
+    workers_stopping = 1;
+    pthread_cond_broadcast(&run_ready);
+    pthread_mutex_unlock(&run_lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    close(listen_fd);
+    close(epoll_fd);
+    unlink(path);
+    unsigned long served = atomic_load(&requests_served);
+    printf("Served %lu requests on %lu connections, %.1f%% from the expression cache\n", served,
+           atomic_load(&connections_accepted), served > 0 ? 100.0 * atomic_load(&cache_hits) / served : 0.0);
+    return 0;
+}
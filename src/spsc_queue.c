@@ -0,0 +1,37 @@
+#include <stdlib.h>
+#include <string.h>
+#include "spsc_queue.h"
+
+int spsc_init(SpscQueue* queue, size_t capacity, size_t item_size) {
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->capacity = capacity;
+    queue->item_size = item_size;
+    queue->items = malloc(capacity * item_size);
+    return queue->items != NULL;
+}
+
+void spsc_destroy(SpscQueue* queue) {
+    free(queue->items);
+    queue->items = NULL;
+}
+
+int spsc_push(SpscQueue* queue, const void* item) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - head == queue->capacity) return 0;
+
+    memcpy(queue->items + (tail % queue->capacity) * queue->item_size, item, queue->item_size);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);  // Publish the item
+    return 1;
+}
+
+int spsc_pop(SpscQueue* queue, void* item) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head == tail) return 0;
+
+    memcpy(item, queue->items + (head % queue->capacity) * queue->item_size, queue->item_size);
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);  // Hand the slot back
+    return 1;
+}
@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "table.h"
+#include "profiler.h"
+#include "format.h"
+#include "sequence.h"
+
+double table_start = 0.0;  // TblStart
+double table_step = 1.0;   // ΔTbl
+
+// Snapshot of the Y= functions the generator evaluates, so the UI can keep editing them
+static Program programs[GRAPH_MAX_FUNCTIONS];
+static int column_slots[GRAPH_MAX_FUNCTIONS];
+static int column_count = 0;
+static char column_names[GRAPH_MAX_FUNCTIONS][4];
+static int generator_sequences = 0;  // The columns are u, v and w: rows are terms n
+static double generator_start, generator_step;
+static CalcContext generator_context;  // Evaluation context owned by the generator thread
+
+// Ring buffer of rows [first_row, next_row); row r lives at ring[r mod TABLE_RING_ROWS]
+static TableRow ring[TABLE_RING_ROWS];
+static long first_row = 0;
+static long next_row = 0;
+static long view_top = 0;     // Rows at or after this are never overwritten
+static long wanted_row = 0;   // Produce rows up to (not including) this one
+static unsigned generation = 0;  // Bumped when the window restarts, so stale batches are dropped
+
+static pthread_t generator;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t rows_ready = PTHREAD_COND_INITIALIZER;
+static int generator_running = 0;
+static int stop_requested = 0;
+
+static TableRow* ring_slot(long row) {
+    long index = row % TABLE_RING_ROWS;
+    return &ring[index < 0 ? index + TABLE_RING_ROWS : index];
+}
+
+// Evaluate a batch of rows, one function at a time over every row through the vector kernels
+static void evaluate_rows(long row, int count, TableRow* rows) {
+    PROFILE_SCOPE("table batch");
+    double x[TABLE_BATCH_ROWS], y[TABLE_BATCH_ROWS];
+    for (int i = 0; i < count; i++) {
+        x[i] = rows[i].x = generator_start + (row + i) * generator_step;  // No accumulated rounding
+    }
+    for (int c = 0; c < column_count; c++) {
+        run_program_batch(&generator_context, &programs[c], x, y, count);
+        for (int i = 0; i < count; i++) {
+            rows[i].y[c] = y[i];
+        }
+    }
+}
+
+// Background thread: keep the ring filled ahead of the viewport, one batch at a time
+static void* generator_thread(void* arg) {
+    TableRow batch[TABLE_BATCH_ROWS];
+    (void)arg;
+    profile_thread_name("table generator");
+
+    pthread_mutex_lock(&lock);
+    while (!stop_requested) {
+        long limit = wanted_row < view_top + TABLE_RING_ROWS ? wanted_row : view_top + TABLE_RING_ROWS;
+        if (next_row >= limit) {
+            pthread_cond_wait(&work_ready, &lock);
+            continue;
+        }
+
+        long row = next_row;
+        int count = limit - row < TABLE_BATCH_ROWS ? (int)(limit - row) : TABLE_BATCH_ROWS;
+        unsigned batch_generation = generation;
+
+        pthread_mutex_unlock(&lock);
+        evaluate_rows(row, count, batch);
+        pthread_mutex_lock(&lock);
+
+        if (batch_generation != generation || row != next_row) continue;  // The viewport jumped meanwhile
+        for (int i = 0; i < count; i++) {
+            *ring_slot(row + i) = batch[i];
+        }
+        next_row += count;
+        if (next_row - first_row > TABLE_RING_ROWS) first_row = next_row - TABLE_RING_ROWS;
+        pthread_cond_broadcast(&rows_ready);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+// Start the background generator for the current Y= functions
+void table_start_generator() {
+    table_stop_generator();
+
+    calc_context_init(&generator_context);
+    calc_context_copy_modes(&generator_context, graph_get_context());
+    column_count = 0;
+    generator_sequences = sequence_mode;
+    if (generator_sequences) {
+        // A column of u(n) evaluated in batches steps through the terms in order, one step per row
+        for (int s = 0; s < SEQUENCE_COUNT; s++) {
+            char term[8];
+            snprintf(term, sizeof(term), "%c(n)", sequence_name(s));
+            if (sequence_defined(generator_context.sequences, s) && compile_expression(term, &programs[column_count])) {
+                column_slots[column_count] = s;
+                snprintf(column_names[column_count], sizeof(column_names[0]), "%c", sequence_name(s));
+                column_count++;
+            }
+        }
+    }
+    for (int i = 0; i < GRAPH_MAX_FUNCTIONS && !generator_sequences; i++) {
+        const Program* program = graph_get_program(i);
+        if (program != NULL) {
+            programs[column_count] = *program;
+            column_slots[column_count] = i;
+            snprintf(column_names[column_count], sizeof(column_names[0]), "Y%d", (i + 1) % 10);
+            column_count++;
+        }
+    }
+    generator_start = table_start;
+    generator_step = table_step;
+
+    first_row = next_row = view_top = wanted_row = 0;
+    generation++;
+    stop_requested = 0;
+    if (pthread_create(&generator, NULL, generator_thread, NULL) != 0) {
+        printf("Error: Could not start the table generator\n");
+        return;
+    }
+    generator_running = 1;
+}
+
+void table_stop_generator() {
+    if (!generator_running) return;
+
+    pthread_mutex_lock(&lock);
+    stop_requested = 1;
+    pthread_cond_signal(&work_ready);
+    pthread_mutex_unlock(&lock);
+
+    pthread_join(generator, NULL);
+    generator_running = 0;
+}
+
+// Move the window of produced rows to follow the viewport
+void table_set_viewport(long top_row, int visible_rows) {
+    pthread_mutex_lock(&lock);
+    if (top_row < first_row || top_row > next_row) {
+        // Jumped outside the produced rows: restart there, keeping a batch above for scrolling back
+        long restart = top_row < first_row ? top_row - TABLE_BATCH_ROWS : top_row;
+        first_row = next_row = restart;
+        generation++;
+    }
+    view_top = top_row;
+    wanted_row = top_row + visible_rows + TABLE_PREFETCH_ROWS;
+    pthread_cond_signal(&work_ready);
+    pthread_mutex_unlock(&lock);
+}
+
+// Copy a row out of the ring buffer
+int table_get_row(long row, TableRow* out) {
+    pthread_mutex_lock(&lock);
+    int available = row >= first_row && row < next_row;
+    if (available) *out = *ring_slot(row);
+    pthread_mutex_unlock(&lock);
+    return available;
+}
+
+int table_column_count() {
+    return column_count;
+}
+
+int table_column_slot(int column) {
+    return column_slots[column];
+}
+
+const char* table_variable_name() {
+    return generator_sequences ? "n" : "X";
+}
+
+const char* table_column_name(int column) {
+    return column_names[column];
+}
+
+// Stream rows [0, rows) to a CSV file: the generator fills the ring while this thread formats and writes
+int table_export_csv(FILE* file, long rows) {
+    static TableRow chunk[TABLE_RING_ROWS];
+    static char buffer[1 << 16];
+    size_t used = 0;
+
+    table_start_generator();
+    if (!generator_running) return 0;
+
+    used += snprintf(buffer + used, sizeof(buffer) - used, "%s", table_variable_name());
+    for (int c = 0; c < column_count; c++) {
+        used += snprintf(buffer + used, sizeof(buffer) - used, ",%s", column_names[c]);
+    }
+    buffer[used++] = '\n';
+
+    long row = 0;
+    while (row < rows) {
+        // Let the generator run up to a full ring ahead, then take whatever is ready
+        pthread_mutex_lock(&lock);
+        wanted_row = rows;
+        pthread_cond_signal(&work_ready);
+        while (next_row <= row) pthread_cond_wait(&rows_ready, &lock);
+        int count = 0;
+        for (; row + count < next_row; count++) {
+            chunk[count] = *ring_slot(row + count);
+        }
+        view_top = row + count;  // Copied out: the generator may refill those slots while we format
+        pthread_cond_signal(&work_ready);
+        pthread_mutex_unlock(&lock);
+
+        for (int i = 0; i < count; i++) {
+            if (sizeof(buffer) - used < (FORMAT_LENGTH + 1) * (GRAPH_MAX_FUNCTIONS + 1)) {
+                if (fwrite(buffer, 1, used, file) != used) {
+                    table_stop_generator();
+                    return 0;
+                }
+                used = 0;
+            }
+            // Shortest round-trip digits: exact values, and far cheaper than snprintf
+            used += format_shortest(chunk[i].x, buffer + used);
+            for (int c = 0; c < column_count; c++) {
+                buffer[used++] = ',';
+                used += format_shortest(chunk[i].y[c], buffer + used);
+            }
+            buffer[used++] = '\n';
+        }
+        row += count;
+    }
+
+    int ok = fwrite(buffer, 1, used, file) == used;
+    table_stop_generator();
+    return ok;
+}